@@ -0,0 +1,91 @@
+// Shared by cluster_cull.comp and cluster.task, the meshlet test of
+// `ClusterCuller`. CLUSTER_SET is the set of `ClusterCuller`'s buffers,
+// the mesh shader pipeline has the textures at set 0.
+
+// see `Meshlet` in MeshletBuilder.hpp
+struct Meshlet {
+    // model space center and radius
+    vec4 sphere;
+    // axis and sine of the half angle, 1 never culls
+    vec4 cone;
+    uint firstIndex;
+    uint triangleCount;
+    uint firstVertex;
+    uint vertexCount;
+    uint firstTriangle;
+};
+
+// see `ClusterCuller::Object`
+struct Object {
+    mat4 model;
+    mat4 modelViewProj;
+    // model space camera position, w is the largest model scale
+    vec4 camera;
+    uint firstMeshlet;
+    uint meshletCount;
+    uint firstCommand;
+    uint firstInstance;
+    int vertexOffset;
+    uint textureIndex;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = CLUSTER_SET, binding = 0) readonly buffer Meshlets {
+    Meshlet meshlets[];
+};
+layout(std430, set = CLUSTER_SET, binding = 1) readonly buffer Objects {
+    Object objects[];
+};
+layout(std430, set = CLUSTER_SET, binding = 2) writeonly buffer Commands {
+    DrawCommand commands[];
+};
+layout(std430, set = CLUSTER_SET, binding = 3) buffer Counter {
+    uint visibleCount;
+};
+
+// see `ClusterCuller::CullConstants`
+layout(push_constant) uniform CullConstants {
+    // world space, pointing inwards
+    vec4 planes[6];
+    uint objectCount;
+    // back facing meshlets are dropped
+    uint coneCulling;
+} cull;
+
+bool isMeshletVisible(Object object, Meshlet meshlet) {
+    vec3 center = meshlet.sphere.xyz;
+    float radius = meshlet.sphere.w;
+
+    // Every triangle faces away when the camera lies within the cone
+    // behind the meshlet, widened by the bounding sphere so it holds for
+    // any point of the meshlet (the test of meshoptimizer's
+    // meshopt_computeMeshletBounds)
+    if (cull.coneCulling != 0u && meshlet.cone.w < 1.0) {
+        vec3 offset = center - object.camera.xyz;
+        if (dot(offset, meshlet.cone.xyz) >=
+            meshlet.cone.w * length(offset) + radius) {
+            return false;
+        }
+    }
+
+    // the scale grows the sphere, the largest one keeps it around the
+    // meshlet
+    vec3 worldCenter = (object.model * vec4(center, 1.0)).xyz;
+    float worldRadius = radius * object.camera.w;
+    for (int i = 0; i < 6; i++) {
+        if (dot(cull.planes[i].xyz, worldCenter) + cull.planes[i].w <
+            -worldRadius) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,9 @@
+#version 450
+
+// `PipelineKey::overdraw`, blended additively so every fragment shaded at a
+// pixel makes it brighter. Ten or more saturate the red channel.
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = vec4(0.1, 0.05, 0.025, 1.0);
+}
@@ -1,11 +1,14 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTextureIndex;
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding = 1) uniform sampler2D texSampler;
+// every loaded texture, see `VulkanSetup::createDescriptorSets`
+layout(set = 0, binding = 0) uniform sampler2D textures[];
 
 void main() {
     // use colours to debug texture coordinates
@@ -16,19 +19,28 @@ void main() {
     // data using colors is the shader programming equivalent of printf 
     // debugging, for lack of a better option!
     // outColor = vec4(fragTexCoord, 0.0, 1.0);
-    outColor = texture(texSampler, fragTexCoord);
+#ifdef NONUNIFORM
+    // one mesh shader draw covers the meshlets of many objects, see
+    // `ClusterCuller`, so the index differs within the draw
+    outColor = texture(textures[nonuniformEXT(fragTextureIndex)],
+                       fragTexCoord);
+#else
+    // instanced draws only merge objects with the same texture, so the
+    // index is the same for the whole draw and needs no nonuniformEXT
+    outColor = texture(textures[fragTextureIndex], fragTexCoord);
+#endif
 
     // modify texture coordinates
-    // outColor = texture(texSampler, fragTexCoord * 4.0);
+    // outColor = texture(textures[fragTextureIndex], fragTexCoord * 4.0);
 
     // manipulate texture colours using the vertex colours
-    // outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
+    // outColor = vec4(fragColor * texture(textures[fragTextureIndex], fragTexCoord).rgb, 1.0);
 
     // pretty colours
     // vec3 color = vec3(fragTexCoord.x, fragTexCoord.y, 1.0);
     // vec3 color = vec3(fragTexCoord.x, fragTexCoord.y, 0.0);
     // outColor = vec4(color, 1.0);
 
-    // vec4 texColor = texture(texSampler, fragTexCoord);
+    // vec4 texColor = texture(textures[fragTextureIndex], fragTexCoord);
     // outColor = vec4(texColor.rgb * color, 1.0);
 }
\ No newline at end of file
@@ -1,33 +1,52 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
+// the header of the frame's region in `Render::frameData`, projection times
+// view so no vertex multiplies matrices
+layout(set = 1, binding = 0) uniform UniformBufferObject {
+    mat4 viewProj;
 } ubo;
 
-layout(push_constant) uniform PushConstants {
-    mat4 modelMatrix;
-} pc;
+// see `InstanceData` in Shader.hpp
+struct InstanceData {
+    mat4 transform;
+    uint textureIndex;
+};
+
+// the frame's region, gl_InstanceIndex includes the draw's first instance
+layout(std430, set = 1, binding = 1) readonly buffer Instances {
+    InstanceData instances[];
+};
 
 layout(location = 0) in vec3 inPosition;
+#ifndef POSITION_ONLY
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTextureIndex;
+#endif
 
-void main() {
-    // localPosition = ubo.model * pc.modelMatrix * vec4(inPosition, 1.0);
+// The depth pre-pass (POSITION_ONLY) and the color pass after it compare
+// depths with EQUAL, so both have to compute exactly the same position
+invariant gl_Position;
 
-    gl_Position = ubo.proj * ubo.view * ubo.model * pc.modelMatrix * vec4(inPosition, 1.0);
-    
-    // gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+void main() {
+    InstanceData instance = instances[gl_InstanceIndex];
 
-    // gl_Position = ubo.proj * ubo.view * ubo.model * pc.modelMatrix * vec4(inPosition.x, inPosition.z, inPosition.y, 1.0);
+#ifdef CPU_MVP
+    // `MvpVariant`, the CPU already multiplied in the view-projection
+    gl_Position = instance.transform * vec4(inPosition, 1.0);
+#else
+    // two matrix-vector products instead of three matrix products
+    gl_Position = ubo.viewProj * (instance.transform * vec4(inPosition, 1.0));
+#endif
 
-    // gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    // gl_Position = ubo.viewProj * (instance.transform * vec4(inPosition.x, inPosition.z, inPosition.y, 1.0));
 
+#ifndef POSITION_ONLY
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragTextureIndex = instance.textureIndex;
+#endif
 }
\ No newline at end of file
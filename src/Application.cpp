@@ -1,14 +1,69 @@
-#include <iostream> // std::cout
-#include <map>      // std::map
+#include <algorithm> // std::sort
+#include <chrono>    // std::chrono
+#include <fstream>   // std::ofstream
+#include <iostream>  // std::cout
+#include <map>       // std::map
 
 #include "Application.hpp"
+#include "Benchmark.hpp"
 #include "Models/Box.hpp"
+#include "Profiler.hpp"
 
 void Application::run() {
-    window.initWindow();
+    Profiler::get().setThreadName("main");
+
+    render.vulkanSetup.headless = options.headless;
+    // benchmark scenes are spawned after the vertex buffer is created
+    render.preloadModelClasses = options.benchmark;
+    render.recordingThreads = options.recordingThreads;
+    render.staticGeometryCaching = options.staticGeometryCaching;
+    render.cpuMvp = options.cpuMvp;
+    render.lodEnabled = options.lodEnabled;
+    render.occlusionCulling = options.occlusionCulling;
+    render.depthPrepass = options.depthPrepass;
+    render.clusterCulling = options.clusterCulling;
+    render.meshShaders = options.meshShaders;
+    render.setFramesInFlight(options.framesInFlight);
+    render.framePacer.lowLatency = options.lowLatency;
+    render.framePacer.sleepUntilPresent = options.lowLatency;
+    if (!options.presentMode.empty()) {
+        render.vulkanSetup.preferredPresentMode =
+            VulkanSetup::getPresentModeFromName(options.presentMode);
+    }
+    render.vulkanSetup.preferredImageCount = options.swapChainImages;
+
+    if (!options.headless) {
+        window.initWindow();
+    }
     render.initVulkan();
-    render.initImgui();
-    mainLoop();
+    if (!options.headless) {
+        render.initImgui();
+    }
+
+    if (options.benchSpawn) {
+        render.benchmarkSceneConstruction({10000, 100000});
+    } else if (options.benchBvh) {
+        render.benchmarkSceneBvh({1000, 10000, 100000});
+    } else if (options.benchmark) {
+        float width = render.vulkanSetup.swapChainExtent.width;
+        float height = render.vulkanSetup.swapChainExtent.height;
+        camera.setPerspective(60.0f, width / height, 0.05f, 256.0f);
+
+        Benchmark benchmark(render, camera);
+        benchmark.run(Benchmark::getDefaultSuite(), options.frames,
+                      options.benchmarkFilter,
+                      options.resultsPath.empty() ? "benchmark_results.json"
+                                                  : options.resultsPath);
+    } else if (options.headless) {
+        headlessLoop();
+    } else {
+        mainLoop();
+    }
+
+    if (!options.tracePath.empty()) {
+        Profiler::get().exportChromeTrace(options.tracePath);
+    }
+
     cleanup();
 }
 
@@ -37,95 +92,260 @@ void Application::mainLoop() {
     const float timeStep = 1.0f / 60.0f;
     float accumulator = 0.0f;
 
+    // Scene changes since the last physics step, recorded with the next step
+    std::vector<SceneCommand> pendingCommands;
+    uint32_t physicsStep = 0;
+
+    if (!options.recordPath.empty()) {
+        recorder.open(options.recordPath, timeStep, render.sceneObjectCount);
+    }
+
+    if (!options.replayPath.empty()) {
+        player.open(options.replayPath, timeStep, render.sceneObjectCount);
+    }
+
+    uint32_t replayFrames = 0;
+    double replayStart = glfwGetTime();
+
     while (!glfwWindowShouldClose(window.window)) {
+        Profiler::get().beginFrame();
+        PROFILE_ZONE("frame");
+
+        // Waiting for the GPU before sampling input instead of inside
+        // `drawFrame` means the input is fresh when the frame is submitted
+        if (render.framePacer.lowLatency) {
+            render.waitForFrame();
+        }
+
         tick();
         window.updateTitle(applicationName);
-        glfwPollEvents();
-        camera.updateCameraPos(tickObject.timeDelta, state.movementSpeed);
+
+        {
+            PROFILE_ZONE("poll events");
+            glfwPollEvents();
+            render.framePacer.markInputSampled();
+        }
+
+        // during a replay the camera follows the recording, see below
+        if (!player.isOpen()) {
+            PROFILE_ZONE("camera update");
+            camera.updateCameraPos(tickObject.timeDelta, state.movementSpeed);
+        }
 
         render.updateCharacterModelMatrix(camera.matrices.view);
 
         render.drawFrame(camera.matrices);
 
-        if (!state.paused) {
+        if (player.isOpen()) {
+            // exactly one step per frame, so the replay runs as fast as the
+            // renderer allows and is independent of the frame rate
+            accumulator += timeStep;
+            replayFrames++;
+
+            // user input must not change the recorded simulation
+            state.clearSpawnedObjects = false;
+            state.noUserIntendedBoxes = state.noBoxes;
+        } else if (!state.paused) {
             // Add the time difference in the accumulator
             accumulator += tickObject.timeDelta;
         }
 
+        if (state.clearSpawnedObjects) {
+            SceneCommand command;
+            command.type = SceneCommand::Clear;
+
+            executeCommand(command);
+            pendingCommands.push_back(command);
+
+            state.noUserIntendedBoxes = 0;
+            state.clearSpawnedObjects = false;
+        }
+
         if (state.noBoxes < state.noUserIntendedBoxes) {
             // Spawn the box slightly in front of the camera to avoid jarring pop-in
             float spawnDistance = 1.0f;
-            Box box = render.addModel<Box>(
-                camera.getSpawnPositionInFront(spawnDistance, -1.0f, -0.2f),
-                glm::vec3(state.newObjectScale,
-                          state.newObjectScale,
-                          state.newObjectScale));
 
-            rp3d::Vector3 velocity = rp3d::Vector3(
-                camera.getCameraDirection().x * state.newObjectVelocity,
-                camera.getCameraDirection().y * state.newObjectVelocity,
-                camera.getCameraDirection().z * state.newObjectVelocity);
+            SceneCommand command;
+            command.type = SceneCommand::Spawn;
+            command.position =
+                camera.getSpawnPositionInFront(spawnDistance, -1.0f, -0.2f);
+            command.velocity =
+                camera.getCameraDirection() * state.newObjectVelocity;
+            command.scale = state.newObjectScale;
+            command.mass = state.newObjectMass;
 
-            box.physicsBody->setLinearVelocity(velocity);
-            box.physicsBody->setMass(state.newObjectMass);
-
-            state.noBoxes += 1;
+            executeCommand(command);
+            pendingCommands.push_back(command);
         }
 
+        render.physicsProfiler.beginFrame();
+
         // While there is enough accumulated time to take
         // one or several physics steps
         while (accumulator >= timeStep) {
-            // Update the Dynamics world with a constant time step
-            render.world->update(timeStep);
-
-            // For each body in the world
-            // Get the updated position of the body
-            for (int i = 0; i < render.objects.size(); i++) {
-                // [TODO] move all this to a function in the Model class
-                glm::mat4 currentModelMatrix =
-                    render.objects[i]->getModelMatrix();
-                rp3d::RigidBody* body = render.objects[i]->physicsBody;
-
-                const rp3d::Transform& transform = body->getTransform();
-                const rp3d::Vector3& position = transform.getPosition();
-
-                // Update position
-                currentModelMatrix[3] = glm::vec4(
-                    glm::vec3(position.x, position.y, position.z), 1.0f);
-
-                // Get the orientation quaternion.
-                const rp3d::Quaternion r = transform.getOrientation();
-
-                // Convert the quaternion to a glm::quat
-                const glm::quat glm_quat(r.w, r.x, r.y, r.z);
-
-                // Convert the glm::quat to a rotation matrix
-                const glm::mat4 rotationMatrix = glm::mat4_cast(glm_quat);
-
-                // get current object scale from the current model matrix
-                glm::vec3 scale = glm::vec3(glm::length(currentModelMatrix[0]),
-                                            glm::length(currentModelMatrix[1]),
-                                            glm::length(currentModelMatrix[2]));
-
-                // Replace the rotation part of the model matrix with the new
-                // rotation matrix and re-apply the scale
-                currentModelMatrix = glm::scale(
-                    glm::mat4(rotationMatrix[0], rotationMatrix[1],
-                              rotationMatrix[2], currentModelMatrix[3]),
-                    scale);
-
-                render.objects[i]->setModelMatrix(currentModelMatrix);
+            ReplayStep replayStep;
+
+            if (player.isOpen()) {
+                if (player.isFinished(physicsStep)) {
+                    break;
+                }
+
+                player.readStep(physicsStep, replayStep);
+
+                applyReplayStep(replayStep);
+            } else if (recorder.isOpen()) {
+                replayStep.step = physicsStep;
+                replayStep.cameraPos = camera.cameraPos;
+                replayStep.cameraFront = camera.cameraFront;
+                replayStep.commands.swap(pendingCommands);
+
+                recorder.recordStep(replayStep);
             }
 
+            pendingCommands.clear();
+
+            render.updatePhysics(timeStep);
+
             // Decrease the accumulated time
             accumulator -= timeStep;
+            physicsStep++;
+        }
+
+        render.physicsProfiler.endFrame();
+
+        if (player.isOpen() && player.isFinished(physicsStep)) {
+            double seconds = glfwGetTime() - replayStart;
+
+            std::cout << "Application::mainLoop(), replayed " << physicsStep
+                      << " steps in " << replayFrames << " frames, "
+                      << seconds << " s (" << seconds * 1000.0 / replayFrames
+                      << " ms/frame)" << std::endl;
+
+            glfwSetWindowShouldClose(window.window, GLFW_TRUE);
+        }
+    }
+
+    recorder.close();
+
+    vkDeviceWaitIdle(render.vulkanSetup.device);
+}
+
+void Application::headlessLoop() {
+    float width = render.vulkanSetup.swapChainExtent.width;
+    float height = render.vulkanSetup.swapChainExtent.height;
+
+    camera.setPerspective(60.0f, width / height, 0.05f, 256.0f);
+
+    // Every frame advances the simulation by exactly one step, so a run only
+    // depends on the frame count and not on how fast the device is
+    const float timeStep = 1.0f / 60.0f;
+
+    if (!options.replayPath.empty()) {
+        player.open(options.replayPath, timeStep, render.sceneObjectCount);
+    }
+
+    std::vector<float> frameTimes;
+    frameTimes.reserve(options.frames);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t frame = 0; frame < options.frames; frame++) {
+        if (player.isOpen() && player.isFinished(frame)) {
+            break;
+        }
+
+        Profiler::get().beginFrame();
+        PROFILE_ZONE("frame");
+
+        auto frameStart = std::chrono::steady_clock::now();
+
+        if (player.isOpen()) {
+            ReplayStep replayStep;
+            player.readStep(frame, replayStep);
+            applyReplayStep(replayStep);
         }
+
+        render.physicsProfiler.beginFrame();
+        render.updatePhysics(timeStep);
+        render.physicsProfiler.endFrame();
+
+        render.drawFrame(camera.matrices);
+
+        std::chrono::duration<float, std::milli> frameTime =
+            std::chrono::steady_clock::now() - frameStart;
+        frameTimes.push_back(frameTime.count());
     }
 
     vkDeviceWaitIdle(render.vulkanSetup.device);
+
+    std::chrono::duration<float, std::milli> totalTime =
+        std::chrono::steady_clock::now() - start;
+
+    if (frameTimes.empty()) {
+        return;
+    }
+
+    std::vector<float> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+
+    std::cout << "Application::headlessLoop(), " << frameTimes.size()
+              << " frames in " << totalTime.count() << " ms\n"
+              << "  avg " << totalTime.count() / frameTimes.size()
+              << " ms, min " << sorted.front() << " ms, median "
+              << sorted[sorted.size() / 2] << " ms, p99 "
+              << sorted[sorted.size() * 99 / 100] << " ms, max "
+              << sorted.back() << " ms" << std::endl;
+
+    if (!options.resultsPath.empty()) {
+        std::ofstream file(options.resultsPath);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open file: " +
+                                     options.resultsPath + "!");
+        }
+
+        file << "frame,frameMs\n";
+        for (size_t i = 0; i < frameTimes.size(); i++) {
+            file << i << "," << frameTimes[i] << "\n";
+        }
+    }
+
+    if (!options.screenshotPath.empty()) {
+        render.saveLastFrame(options.screenshotPath);
+    }
+}
+
+void Application::applyReplayStep(const ReplayStep& replayStep) {
+    camera.cameraFront = replayStep.cameraFront;
+    camera.setCameraDirection(replayStep.cameraFront);
+    camera.setCameraPos(replayStep.cameraPos);
+
+    for (const SceneCommand& command : replayStep.commands) {
+        executeCommand(command);
+    }
+}
+
+void Application::executeCommand(const SceneCommand& command) {
+    PROFILE_ZONE("spawn");
+
+    if (command.type == SceneCommand::Clear) {
+        render.removeModelsFrom(render.sceneObjectCount);
+        state.noBoxes = 0;
+        return;
+    }
+
+    Box box = render.addModel<Box>(command.position, glm::vec3(command.scale));
+
+    box.physicsBody->setLinearVelocity(rp3d::Vector3(
+        command.velocity.x, command.velocity.y, command.velocity.z));
+    box.physicsBody->setMass(command.mass);
+
+    state.noBoxes += 1;
 }
 
 void Application::cleanup() {
     render.cleanup();
-    window.cleanup();
+    if (!options.headless) {
+        window.cleanup();
+    }
 }
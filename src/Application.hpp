@@ -1,7 +1,9 @@
 #pragma once
 
 #include "FPSCamera.hpp"
+#include "Options.hpp"
 #include "Render.hpp"
+#include "Replay.hpp"
 #include "State.hpp"
 #include "Window.hpp"
 
@@ -12,6 +14,7 @@ class Application {
     FPSCamera camera;
 
     gameState state;
+    launchOptions options;
 
 
     struct TickObject {
@@ -21,14 +24,25 @@ class Application {
 
     float timeLast = 0.0f;
 
-    Application()
-        : camera(), window(camera, tickObject.timeDelta, state), render(window, state) {}
+    ReplayRecorder recorder;
+    ReplayPlayer player;
+
+    Application(launchOptions options)
+        : camera(), window(camera, tickObject.timeDelta, state), render(window, state),
+          options(options) {}
     void run();
 
   private:
     std::string applicationName = "Vulkan Test";
 
     void mainLoop();
+    // Renders `options.frames` frames offscreen and reports frame timings
+    void headlessLoop();
+    void applyReplayStep(const ReplayStep& replayStep);
     void cleanup();
     void tick();
+
+    // Applies a spawn/clear to the scene. Live input and replays both go
+    // through here so the recorded commands reproduce the same bodies.
+    void executeCommand(const SceneCommand& command);
 };
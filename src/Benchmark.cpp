@@ -0,0 +1,344 @@
+#include <algorithm> // std::sort
+#include <chrono>    // std::chrono
+#include <cmath>     // cos, sin
+#include <cstdlib>   // atol
+#include <cstring>   // strncmp
+#include <fstream>   // std::ifstream, std::ofstream
+#include <iostream>  // std::cout
+#include <stdexcept> // std::runtime_error
+
+#include <glm/gtc/constants.hpp> // glm::two_pi
+
+#include "Benchmark.hpp"
+#include "Models/Box.hpp"
+#include "Models/Bridge.hpp"
+#include "Models/Commodore.hpp"
+#include "Models/Hatchet.hpp"
+#include "Models/House.hpp"
+#include "Models/Skull.hpp"
+#include "Profiler.hpp"
+
+static const float TIME_STEP = 1.0f / 60.0f;
+
+std::vector<BenchmarkScene> Benchmark::getDefaultSuite() {
+    return {
+        {"static_bricks_1k", BenchmarkScene::StaticBricks, 1000},
+        {"static_bricks_10k", BenchmarkScene::StaticBricks, 10000},
+        {"static_bricks_50k", BenchmarkScene::StaticBricks, 50000},
+        {"falling_boxes_1k", BenchmarkScene::FallingBoxes, 1000},
+        {"falling_boxes_5k", BenchmarkScene::FallingBoxes, 5000},
+        {"mixed_meshes_300", BenchmarkScene::MixedMeshes, 300},
+    };
+}
+
+void Benchmark::run(const std::vector<BenchmarkScene>& scenes,
+                    uint32_t frames, const std::string& filter,
+                    const std::string& jsonPath) {
+    std::vector<BenchmarkResult> results;
+
+    for (const BenchmarkScene& scene : scenes) {
+        if (!filter.empty() && scene.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        results.push_back(runScene(scene, frames));
+
+        const BenchmarkResult& result = results.back();
+        std::cout << "Benchmark::run(), " << result.scene << ": "
+                  << result.objects << " objects, frame avg "
+                  << result.frameMsAvg << " ms, p99 " << result.frameMsP99
+                  << " ms, gpu avg " << result.gpuMsAvg
+                  << " ms, physics avg " << result.physicsMsAvg << " ms, "
+                  << result.drawCalls << " draw calls" << std::endl;
+    }
+
+    if (results.empty()) {
+        throw std::runtime_error("no benchmark scene matches: " + filter);
+    }
+
+    writeJson(results, jsonPath);
+}
+
+BenchmarkResult Benchmark::runScene(const BenchmarkScene& scene,
+                                    uint32_t frames) {
+    // start every scene from an empty world
+    vkDeviceWaitIdle(render.vulkanSetup.device);
+    render.removeModelsFrom(0);
+    render.physicsCommon.destroyPhysicsWorld(render.world);
+    render.createPhysicsWorld();
+
+    buildScene(scene);
+
+    std::vector<float> frameTimes;
+    std::vector<float> physicsTimes;
+    std::vector<float> gpuTimes;
+    frameTimes.reserve(frames);
+    physicsTimes.reserve(frames);
+    gpuTimes.reserve(frames);
+
+    for (uint32_t frame = 0; frame < warmupFrames + frames; frame++) {
+        Profiler::get().beginFrame();
+        PROFILE_ZONE("frame");
+
+        auto frameStart = std::chrono::steady_clock::now();
+
+        updateCamera(frame, warmupFrames + frames);
+
+        render.physicsProfiler.beginFrame();
+        render.updatePhysics(TIME_STEP);
+        render.physicsProfiler.endFrame();
+
+        render.drawFrame(camera.matrices);
+
+        std::chrono::duration<float, std::milli> frameTime =
+            std::chrono::steady_clock::now() - frameStart;
+
+        if (frame >= warmupFrames) {
+            frameTimes.push_back(frameTime.count());
+            physicsTimes.push_back(
+                render.physicsProfiler.getLastStep().stepTimeMs);
+            // lags a few frames behind, which the warmup frames cover
+            gpuTimes.push_back(
+                render.gpuProfiler.getPassMs(GpuProfiler::GeometryPass));
+        }
+    }
+
+    vkDeviceWaitIdle(render.vulkanSetup.device);
+
+    BenchmarkResult result;
+    result.scene = scene.name;
+    result.objects = render.objects.size();
+    result.frames = frames;
+    result.drawCalls = render.drawCallCount;
+    result.instances = render.drawStats.instances;
+    result.textureChanges = render.drawStats.textureChanges;
+    result.meshChanges = render.drawStats.meshChanges;
+    result.occludedObjects = render.occlusionStats.occluded;
+    result.visibleClusters = render.clusterStats.visible;
+    result.testedClusters = render.clusterStats.tested;
+
+    float frameTotal = 0.0f;
+    for (float time : frameTimes) {
+        frameTotal += time;
+    }
+    float physicsTotal = 0.0f;
+    for (float time : physicsTimes) {
+        physicsTotal += time;
+    }
+    float gpuTotal = 0.0f;
+    for (float time : gpuTimes) {
+        gpuTotal += time;
+    }
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+    std::sort(physicsTimes.begin(), physicsTimes.end());
+    std::sort(gpuTimes.begin(), gpuTimes.end());
+
+    result.frameMsAvg = frameTotal / frames;
+    result.frameMsP50 = percentile(frameTimes, 0.50f);
+    result.frameMsP95 = percentile(frameTimes, 0.95f);
+    result.frameMsP99 = percentile(frameTimes, 0.99f);
+    result.frameMsMax = frameTimes.back();
+
+    result.physicsMsAvg = physicsTotal / frames;
+    result.physicsMsP99 = percentile(physicsTimes, 0.99f);
+
+    result.gpuMsAvg = gpuTotal / frames;
+    result.gpuMsP99 = percentile(gpuTimes, 0.99f);
+    result.pipelineStats = render.gpuProfiler.getPipelineStats();
+
+    result.residentKb = readProcStatusKb("VmRSS:");
+    result.peakResidentKb = readProcStatusKb("VmHWM:");
+
+    return result;
+}
+
+void Benchmark::buildScene(const BenchmarkScene& scene) {
+    // floor
+    render.addModel<Box>(glm::vec3(0.0f, -0.5f, 0.0f),
+                         glm::vec3(40.0f, 0.5f, 40.0f),
+                         rp3d::BodyType::STATIC);
+
+    std::vector<glm::vec3> positions;
+    positions.reserve(scene.count);
+
+    switch (scene.type) {
+    case BenchmarkScene::StaticBricks: {
+        // 50 x 50 layers of bricks
+        for (int i = 0; i < scene.count; i++) {
+            positions.push_back(glm::vec3((i % 50) - 25.0f,
+                                          (i / 2500) * 0.5f + 0.25f,
+                                          ((i / 50) % 50) - 25.0f));
+        }
+        render.addModels<Box>(positions, glm::vec3(0.5f, 0.25f, 0.5f),
+                              rp3d::BodyType::STATIC);
+        break;
+    }
+    case BenchmarkScene::FallingBoxes: {
+        // 20 x 20 layers, offset every other layer so the stacks topple
+        for (int i = 0; i < scene.count; i++) {
+            int layer = i / 400;
+            float offset = (layer % 2) * 0.3f;
+            positions.push_back(glm::vec3((i % 20) * 0.6f - 6.0f + offset,
+                                          2.0f + layer * 0.6f,
+                                          ((i / 20) % 20) * 0.6f - 6.0f));
+        }
+        render.addModels<Box>(positions, glm::vec3(0.2f, 0.2f, 0.2f));
+        break;
+    }
+    case BenchmarkScene::MixedMeshes: {
+        render.addModel<House>(glm::vec3(-12.0f, -1.0f, -12.0f),
+                               glm::vec3(3.0f, 2.0f, 3.0f),
+                               rp3d::BodyType::STATIC);
+        render.addModel<House>(glm::vec3(12.0f, -1.0f, -12.0f),
+                               glm::vec3(3.0f, 2.0f, 3.0f),
+                               rp3d::BodyType::STATIC);
+        render.addModel<Bridge>(glm::vec3(0.0f, -0.4f, 8.0f),
+                                glm::vec3(1.0f, 1.0f, 1.0f),
+                                rp3d::BodyType::STATIC);
+
+        std::vector<glm::vec3> skulls, hatchets, commodores;
+        for (int i = 0; i < scene.count; i++) {
+            glm::vec3 position = glm::vec3((i % 10) * 1.5f - 7.5f,
+                                           2.0f + (i / 100) * 1.5f,
+                                           ((i / 10) % 10) * 1.5f - 7.5f);
+
+            switch (i % 3) {
+            case 0:
+                skulls.push_back(position);
+                break;
+            case 1:
+                hatchets.push_back(position);
+                break;
+            case 2:
+                commodores.push_back(position);
+                break;
+            }
+        }
+
+        render.addModels<Skull>(skulls);
+        render.addModels<Hatchet>(hatchets, glm::vec3(0.02f, 0.02f, 0.02f));
+        render.addModels<Commodore>(commodores);
+        break;
+    }
+    }
+}
+
+void Benchmark::updateCamera(uint32_t frame, uint32_t frames) {
+    // one full orbit around the scene per run
+    float angle = glm::two_pi<float>() * frame / frames;
+    glm::vec3 target = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 position =
+        glm::vec3(cos(angle) * 25.0f, 10.0f, sin(angle) * 25.0f);
+
+    glm::vec3 front = glm::normalize(target - position);
+    camera.cameraFront = front;
+    camera.setCameraDirection(front);
+    camera.setCameraPos(position);
+}
+
+void Benchmark::writeJson(const std::vector<BenchmarkResult>& results,
+                          const std::string& jsonPath) {
+    std::ofstream file(jsonPath);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file: " + jsonPath + "!");
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(render.vulkanSetup.physicalDevice,
+                                  &properties);
+
+    file << "{\n"
+         << "  \"device\": \""
+         << Profiler::escapeJson(properties.deviceName) << "\",\n"
+         << "  \"width\": " << render.vulkanSetup.swapChainExtent.width
+         << ",\n"
+         << "  \"height\": " << render.vulkanSetup.swapChainExtent.height
+         << ",\n"
+         << "  \"warmupFrames\": " << warmupFrames << ",\n"
+         << "  \"recordingThreads\": " << render.getRecordingThreadCount()
+         << ",\n"
+         << "  \"framesInFlight\": " << render.getFramesInFlight() << ",\n"
+         << "  \"staticGeometryCaching\": "
+         << (render.staticGeometryCaching ? "true" : "false") << ",\n"
+         << "  \"cpuMvp\": " << (render.cpuMvp ? "true" : "false") << ",\n"
+         << "  \"lod\": " << (render.lodEnabled ? "true" : "false") << ",\n"
+         << "  \"occlusionCulling\": "
+         << (render.occlusionCulling ? "true" : "false") << ",\n"
+         << "  \"depthPrepass\": "
+         << (render.depthPrepass ? "true" : "false") << ",\n"
+         << "  \"clusterCulling\": "
+         << (render.clusterCulling ? "true" : "false") << ",\n"
+         << "  \"meshShaders\": "
+         << (render.meshShaders ? "true" : "false") << ",\n"
+         << "  \"scenes\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+
+        file << "    {\n"
+             << "      \"name\": \"" << Profiler::escapeJson(result.scene)
+             << "\",\n"
+             << "      \"objects\": " << result.objects << ",\n"
+             << "      \"frames\": " << result.frames << ",\n"
+             << "      \"frameMs\": {\"avg\": " << result.frameMsAvg
+             << ", \"p50\": " << result.frameMsP50
+             << ", \"p95\": " << result.frameMsP95
+             << ", \"p99\": " << result.frameMsP99
+             << ", \"max\": " << result.frameMsMax << "},\n"
+             << "      \"physicsStepMs\": {\"avg\": " << result.physicsMsAvg
+             << ", \"p99\": " << result.physicsMsP99 << "},\n"
+             << "      \"gpuGeometryMs\": {\"avg\": " << result.gpuMsAvg
+             << ", \"p99\": " << result.gpuMsP99 << "},\n"
+             << "      \"pipelineStats\": {\"vertexInvocations\": "
+             << result.pipelineStats.vertexInvocations
+             << ", \"clippingPrimitives\": "
+             << result.pipelineStats.clippingPrimitives
+             << ", \"fragmentInvocations\": "
+             << result.pipelineStats.fragmentInvocations << "},\n"
+             << "      \"drawCalls\": " << result.drawCalls << ",\n"
+             << "      \"instances\": " << result.instances << ",\n"
+             << "      \"textureChanges\": " << result.textureChanges
+             << ",\n"
+             << "      \"meshChanges\": " << result.meshChanges << ",\n"
+             << "      \"occludedObjects\": " << result.occludedObjects
+             << ",\n"
+             << "      \"visibleClusters\": " << result.visibleClusters
+             << ",\n"
+             << "      \"testedClusters\": " << result.testedClusters
+             << ",\n"
+             << "      \"residentKb\": " << result.residentKb << ",\n"
+             << "      \"peakResidentKb\": " << result.peakResidentKb << "\n"
+             << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    file << "  ]\n"
+         << "}\n";
+
+    std::cout << "Benchmark::writeJson(), wrote " << jsonPath << std::endl;
+}
+
+float Benchmark::percentile(const std::vector<float>& sorted, float p) {
+    if (sorted.empty()) {
+        return 0.0f;
+    }
+
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5f);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+long Benchmark::readProcStatusKb(const char* field) {
+    // Linux only, reports 0 elsewhere
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    size_t length = strlen(field);
+
+    while (std::getline(status, line)) {
+        if (strncmp(line.c_str(), field, length) == 0) {
+            return atol(line.c_str() + length);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string> // std::string
+#include <vector> // std::vector
+
+#include "FPSCamera.hpp"
+#include "Render.hpp"
+
+struct BenchmarkScene {
+    enum Type {
+        // `count` static boxes stacked in a grid
+        StaticBricks,
+        // `count` dynamic boxes dropped onto the floor
+        FallingBoxes,
+        // `count` dynamic Skulls, Hatchets and Commodores between static
+        // Houses and Bridges, one texture per model class
+        MixedMeshes,
+    };
+
+    std::string name;
+    Type type;
+    int count;
+};
+
+struct BenchmarkResult {
+    std::string scene;
+    size_t objects = 0;
+    uint32_t frames = 0;
+
+    // CPU time of a whole frame (physics step, recording and submission)
+    float frameMsAvg = 0.0f;
+    float frameMsP50 = 0.0f;
+    float frameMsP95 = 0.0f;
+    float frameMsP99 = 0.0f;
+    float frameMsMax = 0.0f;
+
+    float physicsMsAvg = 0.0f;
+    float physicsMsP99 = 0.0f;
+
+    // GPU time of the geometry pass, 0 without timestamp support
+    float gpuMsAvg = 0.0f;
+    float gpuMsP99 = 0.0f;
+    // pipeline statistics of the last measured frame, 0 if unsupported
+    GpuProfiler::PipelineStats pipelineStats;
+
+    // instanced draws of objects sharing mesh and texture count once
+    uint32_t drawCalls = 0;
+    uint32_t instances = 0;
+    // of the last frame, see `Render::drawSorting`
+    uint32_t textureChanges = 0;
+    uint32_t meshChanges = 0;
+    // hidden by the last occlusion test, see `Render::occlusionCulling`
+    uint32_t occludedObjects = 0;
+    // meshlets drawn and tested by the last cluster test, see
+    // `Render::clusterCulling`
+    uint32_t visibleClusters = 0;
+    uint32_t testedClusters = 0;
+
+    // resident set size after the scene ran and the process peak so far
+    long residentKb = 0;
+    long peakResidentKb = 0;
+};
+
+// Runs a suite of generated scenes headless for a fixed number of frames each
+// and writes the results as JSON. The camera follows the same orbit in every
+// run and the simulation advances one fixed step per frame, so two runs of
+// the same build do the same work. Needs `Render::preloadModelClasses`.
+class Benchmark {
+    Render& render;
+    FPSCamera& camera;
+
+  public:
+    Benchmark(Render& render, FPSCamera& camera)
+        : render(render), camera(camera) {}
+
+    // frames rendered before measuring, lets the physics and caches settle
+    uint32_t warmupFrames = 30;
+
+    static std::vector<BenchmarkScene> getDefaultSuite();
+
+    // Runs every scene whose name contains `filter` (all if empty)
+    void run(const std::vector<BenchmarkScene>& scenes, uint32_t frames,
+             const std::string& filter, const std::string& jsonPath);
+
+  private:
+    BenchmarkResult runScene(const BenchmarkScene& scene, uint32_t frames);
+    void buildScene(const BenchmarkScene& scene);
+    void updateCamera(uint32_t frame, uint32_t frames);
+    void writeJson(const std::vector<BenchmarkResult>& results,
+                   const std::string& jsonPath);
+
+    static float percentile(const std::vector<float>& sorted, float p);
+    static long readProcStatusKb(const char* field);
+};
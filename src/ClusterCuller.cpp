@@ -0,0 +1,677 @@
+#include <algorithm> // std::max, std::min
+#include <cstring>   // memcpy
+#include <iostream>  // std::cout, std::cerr
+#include <stdexcept> // std::runtime_error
+
+#include "ClusterCuller.hpp"
+
+static_assert(sizeof(ClusterCuller::Object) == 176,
+              "std430 stride of cluster_cull.glsl's Object");
+
+// local sizes of cluster_cull.comp and cluster.task
+static const uint32_t CULL_GROUP_SIZE = 64;
+static const uint32_t TASK_GROUP_SIZE = 32;
+
+// the meshlets, objects, commands, counter, meshlet vertices, meshlet
+// triangles and vertices
+static const uint32_t BINDING_COUNT = 7;
+
+void ClusterCuller::create(VulkanSetup* vulkanSetup,
+                           VkCommandPool* commandPool,
+                           const std::vector<Meshlet>& meshlets,
+                           const std::vector<uint32_t>& meshletVertices,
+                           const std::vector<uint32_t>& meshletTriangles,
+                           VkDescriptorSetLayout textureSetLayout,
+                           VkRenderPass renderPass,
+                           VkPipelineCache pipelineCache) {
+    this->vulkanSetup = vulkanSetup;
+    this->pipelineCache = pipelineCache;
+    device = vulkanSetup->device;
+
+    if (meshlets.empty()) {
+        std::cout << "ClusterCuller::create(), no mesh is big enough for "
+                     "cluster culling"
+                  << std::endl;
+        return;
+    }
+
+    supported = vulkanSetup->drawIndirectFirstInstanceSupported;
+    if (!supported) {
+        std::cout << "ClusterCuller::create(), indirect draws need a first "
+                     "instance of 0, cluster culling is unavailable"
+                  << std::endl;
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vulkanSetup->physicalDevice, &properties);
+    maxDrawIndirectCount = properties.limits.maxDrawIndirectCount;
+
+    createStaticBuffer(meshlets.data(), meshlets.size() * sizeof(Meshlet),
+                       commandPool, meshletBuffer, meshletMemory);
+    createStaticBuffer(meshletVertices.data(),
+                       meshletVertices.size() * sizeof(uint32_t),
+                       commandPool, meshletVertexBuffer, meshletVertexMemory);
+    createStaticBuffer(meshletTriangles.data(),
+                       meshletTriangles.size() * sizeof(uint32_t),
+                       commandPool, meshletTriangleBuffer,
+                       meshletTriangleMemory);
+
+    VkShaderStageFlags stages = VK_SHADER_STAGE_COMPUTE_BIT;
+#ifdef VK_EXT_mesh_shader
+    if (vulkanSetup->meshShaderSupported) {
+        stages |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
+#endif
+
+    std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+    for (uint32_t binding = 0; binding < bindings.size(); binding++) {
+        bindings[binding].binding = binding;
+        bindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[binding].descriptorCount = 1;
+        bindings[binding].stageFlags = stages;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
+                                    &setLayout) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to create cluster culling descriptor set layout!");
+    }
+
+    // one set per frame in flight
+    descriptorAllocator.create(
+        device, MAX_FRAMES_IN_FLIGHT,
+        {{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, float(BINDING_COUNT)}});
+
+    try {
+        createCullPipeline();
+    } catch (const std::exception& exception) {
+        // like a missing shader variant, only this feature is lost
+        std::cerr << "ClusterCuller::create(), cluster culling is "
+                     "unavailable: "
+                  << exception.what() << std::endl;
+        supported = false;
+        return;
+    }
+
+    try {
+        createMeshPipeline(textureSetLayout, renderPass);
+    } catch (const std::exception& exception) {
+        std::cerr << "ClusterCuller::create(), no mesh shaders: "
+                  << exception.what() << std::endl;
+        vkDestroyPipelineLayout(device, meshLayout, nullptr);
+        meshLayout = VK_NULL_HANDLE;
+    }
+
+    std::cout << "ClusterCuller::create(), " << meshlets.size()
+              << " meshlets, "
+              << (isMeshShaderSupported() ? "mesh shaders" : "indirect draws")
+              << std::endl;
+}
+
+void ClusterCuller::destroy() {
+    destroyFrameBuffers();
+    descriptorAllocator.destroy();
+
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipeline(device, meshPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullLayout, nullptr);
+    vkDestroyPipelineLayout(device, meshLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+
+    vkDestroyBuffer(device, meshletBuffer, nullptr);
+    vkFreeMemory(device, meshletMemory, nullptr);
+    vkDestroyBuffer(device, meshletVertexBuffer, nullptr);
+    vkFreeMemory(device, meshletVertexMemory, nullptr);
+    vkDestroyBuffer(device, meshletTriangleBuffer, nullptr);
+    vkFreeMemory(device, meshletTriangleMemory, nullptr);
+
+    cullPipeline = VK_NULL_HANDLE;
+    meshPipeline = VK_NULL_HANDLE;
+    cullLayout = VK_NULL_HANDLE;
+    meshLayout = VK_NULL_HANDLE;
+    setLayout = VK_NULL_HANDLE;
+    meshletBuffer = VK_NULL_HANDLE;
+    meshletMemory = VK_NULL_HANDLE;
+    meshletVertexBuffer = VK_NULL_HANDLE;
+    meshletVertexMemory = VK_NULL_HANDLE;
+    meshletTriangleBuffer = VK_NULL_HANDLE;
+    meshletTriangleMemory = VK_NULL_HANDLE;
+    supported = false;
+}
+
+VkShaderModule ClusterCuller::loadShaderModule(const std::string& filename) {
+    std::vector<char> code = Shader::readFile(filename);
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create shader module!");
+    }
+
+    return shaderModule;
+}
+
+void ClusterCuller::createStaticBuffer(const void* data, VkDeviceSize size,
+                                       VkCommandPool* commandPool,
+                                       VkBuffer& buffer,
+                                       VkDeviceMemory& memory) {
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    vulkanSetup->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              stagingBuffer, stagingBufferMemory);
+
+    void* mapped;
+    vkMapMemory(device, stagingBufferMemory, 0, size, 0, &mapped);
+    memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    vulkanSetup->createBuffer(size,
+                              VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer,
+                              memory);
+
+    vulkanSetup->copyBuffer(stagingBuffer, buffer, size, commandPool);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+void ClusterCuller::createCullPipeline() {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+                               &cullLayout) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to create cluster culling pipeline layout!");
+    }
+
+    VkShaderModule shaderModule =
+        loadShaderModule("shaders/cluster_cull.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = cullLayout;
+
+    VkResult result = vkCreateComputePipelines(
+        device, pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline);
+
+    // the pipeline keeps what it needs
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+}
+
+void ClusterCuller::createMeshPipeline(VkDescriptorSetLayout textureSetLayout,
+                                       VkRenderPass renderPass) {
+#ifdef VK_EXT_mesh_shader
+    if (!vulkanSetup->meshShaderSupported) {
+        return;
+    }
+
+    drawMeshTasksFunction =
+        vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+    if (drawMeshTasksFunction == nullptr) {
+        return;
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags =
+        VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {textureSetLayout,
+                                                       setLayout};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount =
+        static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+                               &meshLayout) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to create mesh shader pipeline layout!");
+    }
+
+    // the fragment shader of every other pipeline, but with a non-uniform
+    // texture index since one draw covers the meshlets of many objects
+    std::array<VkShaderModule, 3> modules = {};
+    try {
+        modules[0] = loadShaderModule("shaders/cluster_task.spv");
+        modules[1] = loadShaderModule("shaders/cluster_mesh.spv");
+        modules[2] = loadShaderModule("shaders/frag_nonuniform.spv");
+    } catch (...) {
+        for (VkShaderModule module : modules) {
+            vkDestroyShaderModule(device, module, nullptr);
+        }
+        throw;
+    }
+
+    std::array<VkPipelineShaderStageCreateInfo, 3> shaderStages{};
+    VkShaderStageFlagBits stages[] = {VK_SHADER_STAGE_TASK_BIT_EXT,
+                                      VK_SHADER_STAGE_MESH_BIT_EXT,
+                                      VK_SHADER_STAGE_FRAGMENT_BIT};
+    for (size_t i = 0; i < shaderStages.size(); i++) {
+        shaderStages[i].sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].stage = stages[i];
+        shaderStages[i].module = modules[i];
+        shaderStages[i].pName = "main";
+    }
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    // the default `PipelineKey`
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+                                                   VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount =
+        static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // no vertex input or input assembly, the mesh shader emits triangles
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = meshLayout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+
+    VkResult result = vkCreateGraphicsPipelines(
+        device, pipelineCache, 1, &pipelineInfo, nullptr, &meshPipeline);
+
+    for (VkShaderModule module : modules) {
+        vkDestroyShaderModule(device, module, nullptr);
+    }
+
+    if (result != VK_SUCCESS) {
+        meshPipeline = VK_NULL_HANDLE;
+        throw std::runtime_error("failed to create mesh shader pipeline!");
+    }
+#endif
+}
+
+void ClusterCuller::createFrameBuffers() {
+    const VkMemoryPropertyFlags hostFlags =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    for (FrameBuffers& frame : frames) {
+        vulkanSetup->createBuffer(objectCapacity * sizeof(Object),
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  hostFlags, frame.objects,
+                                  frame.objectsMemory);
+        vulkanSetup->createBuffer(
+            commandCapacity * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands,
+            frame.commandsMemory);
+        // cleared on the GPU before every test
+        vulkanSetup->createBuffer(sizeof(uint32_t),
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                  hostFlags, frame.counter,
+                                  frame.counterMemory);
+
+        void* data;
+        vkMapMemory(device, frame.objectsMemory, 0, VK_WHOLE_SIZE, 0, &data);
+        frame.mappedObjects = static_cast<Object*>(data);
+        vkMapMemory(device, frame.counterMemory, 0, VK_WHOLE_SIZE, 0, &data);
+        frame.mappedCounter = static_cast<uint32_t*>(data);
+
+        frame.objectCount = 0;
+        frame.commandCount = 0;
+    }
+}
+
+void ClusterCuller::destroyFrameBuffers() {
+    for (FrameBuffers& frame : frames) {
+        if (frame.objects == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        vkUnmapMemory(device, frame.objectsMemory);
+        vkUnmapMemory(device, frame.counterMemory);
+
+        vkDestroyBuffer(device, frame.objects, nullptr);
+        vkFreeMemory(device, frame.objectsMemory, nullptr);
+        vkDestroyBuffer(device, frame.commands, nullptr);
+        vkFreeMemory(device, frame.commandsMemory, nullptr);
+        vkDestroyBuffer(device, frame.counter, nullptr);
+        vkFreeMemory(device, frame.counterMemory, nullptr);
+
+        frame = FrameBuffers();
+    }
+}
+
+void ClusterCuller::writeSets() {
+    // nothing allocated from it is pending, see `reserve`
+    descriptorAllocator.reset();
+
+    for (FrameBuffers& frame : frames) {
+        VkBuffer buffers[BINDING_COUNT] = {
+            meshletBuffer,         frame.objects,
+            frame.commands,        frame.counter,
+            meshletVertexBuffer,   meshletTriangleBuffer,
+            vulkanSetup->vertexBuffer};
+
+        std::vector<DescriptorBinding> bindings;
+        for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+            DescriptorBinding binding;
+            binding.binding = i;
+            binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            binding.buffer = buffers[i];
+            binding.offset = 0;
+            binding.range = VK_WHOLE_SIZE;
+            bindings.push_back(binding);
+        }
+
+        frame.set = descriptorAllocator.allocate(setLayout);
+        descriptorAllocator.write(frame.set, bindings);
+    }
+}
+
+void ClusterCuller::reserve(size_t objectCount, size_t commandCount) {
+    if (objectCount <= objectCapacity && commandCount <= commandCapacity) {
+        return;
+    }
+
+    // the other frames may still read the buffers
+    vkDeviceWaitIdle(device);
+    destroyFrameBuffers();
+
+    objectCapacity =
+        std::max(objectCount, std::max<size_t>(objectCapacity * 2, 64));
+    commandCapacity =
+        std::max(commandCount, std::max<size_t>(commandCapacity * 2, 4096));
+    createFrameBuffers();
+    writeSets();
+
+    std::cout << "ClusterCuller::reserve(), " << objectCapacity
+              << " objects, " << commandCapacity << " meshlets" << std::endl;
+}
+
+void ClusterCuller::cull(VkCommandBuffer commandBuffer, uint32_t frame,
+                         const std::vector<Object>& objects,
+                         uint32_t commandCount, const glm::mat4& viewProj,
+                         bool coneCulling, bool meshShaders) {
+    reserve(objects.size(), commandCount);
+
+    FrameBuffers& buffers = frames[frame];
+    if (!objects.empty()) {
+        memcpy(buffers.mappedObjects, objects.data(),
+               objects.size() * sizeof(Object));
+    }
+    buffers.objectCount = static_cast<uint32_t>(objects.size());
+    buffers.commandCount = commandCount;
+    buffers.maxMeshlets = 0;
+    for (const Object& object : objects) {
+        buffers.maxMeshlets = std::max(buffers.maxMeshlets,
+                                       object.meshletCount);
+    }
+
+    // The planes of the clip space cube in world space (Gribb and Hartmann
+    // 2001), z goes from 0 to 1. The rows of the column major matrix.
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i],
+                            viewProj[3][i]);
+    }
+
+    CullConstants& constants = buffers.constants;
+    constants.planes[0] = rows[3] + rows[0];
+    constants.planes[1] = rows[3] - rows[0];
+    constants.planes[2] = rows[3] + rows[1];
+    constants.planes[3] = rows[3] - rows[1];
+    constants.planes[4] = rows[2];
+    constants.planes[5] = rows[3] - rows[2];
+    for (glm::vec4& plane : constants.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    constants.objectCount = buffers.objectCount;
+    constants.coneCulling = coneCulling ? 1 : 0;
+
+    // Counted from zero. The previous test of this frame was read back
+    // after its fence, the other frames have counters of their own.
+    vkCmdFillBuffer(commandBuffer, buffers.counter, 0, sizeof(uint32_t), 0);
+
+    VkBufferMemoryBarrier counterBarrier{};
+    counterBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    counterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    counterBarrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.buffer = buffers.counter;
+    counterBarrier.offset = 0;
+    counterBarrier.size = VK_WHOLE_SIZE;
+
+    VkPipelineStageFlags counterStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+#ifdef VK_EXT_mesh_shader
+    if (meshShaders) {
+        counterStage = VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+    }
+#endif
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         counterStage, 0, 0, nullptr, 1, &counterBarrier, 0,
+                         nullptr);
+
+    // the task shader tests the meshlets while it draws
+    if (meshShaders || objects.empty()) {
+        return;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            cullLayout, 0, 1, &buffers.set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(constants), &constants);
+    // a row of meshlets per object
+    vkCmdDispatch(commandBuffer,
+                  (buffers.maxMeshlets + CULL_GROUP_SIZE - 1) /
+                      CULL_GROUP_SIZE,
+                  buffers.objectCount, 1);
+
+    // the commands are read by the draws and the counter by the CPU after
+    // the fence
+    std::array<VkBufferMemoryBarrier, 2> bufferBarriers{};
+    bufferBarriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    bufferBarriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    bufferBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarriers[0].buffer = buffers.commands;
+    bufferBarriers[0].offset = 0;
+    bufferBarriers[0].size = VK_WHOLE_SIZE;
+
+    bufferBarriers[1] = bufferBarriers[0];
+    bufferBarriers[1].dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarriers[1].buffer = buffers.counter;
+
+    vkCmdPipelineBarrier(
+        commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+        nullptr, static_cast<uint32_t>(bufferBarriers.size()),
+        bufferBarriers.data(), 0, nullptr);
+}
+
+void ClusterCuller::draw(VkCommandBuffer commandBuffer, uint32_t frame) {
+    const FrameBuffers& buffers = frames[frame];
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    if (buffers.commandCount == 0) {
+        return;
+    }
+
+    if (vulkanSetup->multiDrawIndirectSupported) {
+        for (uint32_t first = 0; first < buffers.commandCount;
+             first += maxDrawIndirectCount) {
+            uint32_t count =
+                std::min(buffers.commandCount - first, maxDrawIndirectCount);
+            vkCmdDrawIndexedIndirect(commandBuffer, buffers.commands,
+                                     static_cast<VkDeviceSize>(first) * stride,
+                                     count, stride);
+        }
+        return;
+    }
+
+    // one command per call without multiDrawIndirect
+    for (uint32_t i = 0; i < buffers.commandCount; i++) {
+        vkCmdDrawIndexedIndirect(commandBuffer, buffers.commands,
+                                 static_cast<VkDeviceSize>(i) * stride, 1,
+                                 stride);
+    }
+}
+
+void ClusterCuller::drawMeshTasks(VkCommandBuffer commandBuffer,
+                                  uint32_t frame, VkDescriptorSet textureSet,
+                                  VkExtent2D extent) {
+#ifdef VK_EXT_mesh_shader
+    const FrameBuffers& buffers = frames[frame];
+
+    if (meshPipeline == VK_NULL_HANDLE || buffers.objectCount == 0) {
+        return;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      meshPipeline);
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    std::array<VkDescriptorSet, 2> sets = {textureSet, buffers.set};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            meshLayout, 0, static_cast<uint32_t>(sets.size()),
+                            sets.data(), 0, nullptr);
+    vkCmdPushConstants(commandBuffer, meshLayout,
+                       VK_SHADER_STAGE_TASK_BIT_EXT |
+                           VK_SHADER_STAGE_MESH_BIT_EXT,
+                       0, sizeof(CullConstants), &buffers.constants);
+
+    // like the compute dispatch, a task workgroup per 32 meshlets
+    auto drawMeshTasks =
+        reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(drawMeshTasksFunction);
+    drawMeshTasks(commandBuffer,
+                  (buffers.maxMeshlets + TASK_GROUP_SIZE - 1) /
+                      TASK_GROUP_SIZE,
+                  buffers.objectCount, 1);
+#endif
+}
+
+void ClusterCuller::finishMeshTasks(VkCommandBuffer commandBuffer,
+                                    uint32_t frame) {
+#ifdef VK_EXT_mesh_shader
+    VkBufferMemoryBarrier counterBarrier{};
+    counterBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    counterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    counterBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.buffer = frames[frame].counter;
+    counterBarrier.offset = 0;
+    counterBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                         &counterBarrier, 0, nullptr);
+#endif
+}
+
+uint32_t ClusterCuller::getVisibleCount(uint32_t frame,
+                                        uint32_t& tested) const {
+    const FrameBuffers& buffers = frames[frame];
+
+    // every meshlet of every object has a command, drawn or not
+    tested = buffers.commandCount;
+    return buffers.mappedCounter != nullptr ? *buffers.mappedCounter : 0;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>  // std::array
+#include <string> // std::string
+#include <vector> // std::vector
+
+#include <vulkan/vulkan.h>
+
+#include "MeshletBuilder.hpp"
+#include "Shader.hpp"
+#include "VulkanSetup.hpp"
+
+// Culls the meshlets of big meshes one by one, so the parts of an object
+// that face away from the camera or are outside of the frustum are not
+// drawn. A meshlet is dropped when its normal cone points away from the
+// camera, which is tested in model space, or when its bounding sphere is
+// outside of a frustum plane.
+//
+// Without mesh shaders a compute shader writes one indexed indirect draw
+// per meshlet of every object, whose instance count is 0 if it was culled.
+// The meshlets are ranges of the shared index buffer, so the draws use the
+// frame's pipeline. With VK_EXT_mesh_shader a task shader runs the same
+// test and launches a mesh shader workgroup per visible meshlet instead,
+// which only works with the default rasterization, see `Render`.
+class ClusterCuller {
+  public:
+    // One object of `cull`, 176 bytes like its std430 counterpart
+    struct Object {
+        glm::mat4 model;
+        // for the mesh shaders, which have no camera of their own
+        glm::mat4 modelViewProj;
+        // camera position in model space, w is the largest model scale
+        glm::vec4 camera;
+        // its meshlets, and the first of as many indirect draws
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t firstCommand;
+        // the instance the indirect draws point to
+        uint32_t firstInstance;
+        int32_t vertexOffset;
+        uint32_t textureIndex;
+        uint32_t padding[2];
+    };
+
+    // objects go along y of a dispatch, whose minimum limit this is
+    static constexpr uint32_t MAX_OBJECTS = 65535;
+
+    // Uploads the meshlets, `meshlets` already point into the shared
+    // index buffer and into `meshletVertices` and `meshletTriangles`.
+    // Needs indirect draws with a first instance, see `isSupported`, and
+    // mesh shaders are optional. Missing shaders only disable it. The
+    // pipelines are created through `pipelineCache`.
+    void create(VulkanSetup* vulkanSetup, VkCommandPool* commandPool,
+                const std::vector<Meshlet>& meshlets,
+                const std::vector<uint32_t>& meshletVertices,
+                const std::vector<uint32_t>& meshletTriangles,
+                VkDescriptorSetLayout textureSetLayout,
+                VkRenderPass renderPass, VkPipelineCache pipelineCache);
+    void destroy();
+
+    bool isSupported() const { return supported; }
+    bool isMeshShaderSupported() const {
+        return meshPipeline != VK_NULL_HANDLE;
+    }
+
+    // Records the test of the meshlets of `objects` outside of a render
+    // pass. With `meshShaders` only the objects are uploaded, the task
+    // shader of `drawMeshTasks` tests them. Back facing meshlets are only
+    // dropped with `coneCulling`, the wireframe shows them.
+    void cull(VkCommandBuffer commandBuffer, uint32_t frame,
+              const std::vector<Object>& objects, uint32_t commandCount,
+              const glm::mat4& viewProj, bool coneCulling, bool meshShaders);
+    // Records the indirect draws of the last `cull` of `frame`, with the
+    // pipeline, the sets and the vertex and index buffers bound
+    void draw(VkCommandBuffer commandBuffer, uint32_t frame);
+    // Records the mesh shader draw of the last `cull` of `frame`, binds its
+    // own pipeline and sets, `textureSet` is set 0 of every pipeline
+    void drawMeshTasks(VkCommandBuffer commandBuffer, uint32_t frame,
+                       VkDescriptorSet textureSet, VkExtent2D extent);
+    // Makes the count of the task shaders visible to the host, recorded
+    // after the render pass of `drawMeshTasks`
+    void finishMeshTasks(VkCommandBuffer commandBuffer, uint32_t frame);
+
+    // Meshlets of the last `cull` of `frame` that passed, and all of them.
+    // Only valid once the frame's fence signalled.
+    uint32_t getVisibleCount(uint32_t frame, uint32_t& tested) const;
+
+  private:
+    // see the push constants of cluster_cull.glsl
+    struct CullConstants {
+        // left, right, bottom, top, near and far, pointing inwards
+        glm::vec4 planes[6];
+        uint32_t objectCount;
+        uint32_t coneCulling;
+        uint32_t padding[2];
+    };
+
+    // Written by the CPU, the commands only live on the GPU and the
+    // counter is read back after the fence
+    struct FrameBuffers {
+        VkBuffer objects = VK_NULL_HANDLE;
+        VkDeviceMemory objectsMemory = VK_NULL_HANDLE;
+        Object* mappedObjects = nullptr;
+
+        VkBuffer commands = VK_NULL_HANDLE;
+        VkDeviceMemory commandsMemory = VK_NULL_HANDLE;
+
+        VkBuffer counter = VK_NULL_HANDLE;
+        VkDeviceMemory counterMemory = VK_NULL_HANDLE;
+        uint32_t* mappedCounter = nullptr;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        // of the last `cull`
+        uint32_t objectCount = 0;
+        uint32_t commandCount = 0;
+        // most meshlets of any object, the dispatch width
+        uint32_t maxMeshlets = 0;
+        CullConstants constants{};
+    };
+
+    VulkanSetup* vulkanSetup = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    bool supported = false;
+
+    // meshlets, their vertices and their packed triangles
+    VkBuffer meshletBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory meshletMemory = VK_NULL_HANDLE;
+    VkBuffer meshletVertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory meshletVertexMemory = VK_NULL_HANDLE;
+    VkBuffer meshletTriangleBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory meshletTriangleMemory = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullLayout = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    // set 0 are the textures, set 1 the same set as `cullLayout`'s 0
+    VkPipelineLayout meshLayout = VK_NULL_HANDLE;
+    VkPipeline meshPipeline = VK_NULL_HANDLE;
+    // vkCmdDrawMeshTasksEXT, older headers do not declare its type
+    PFN_vkVoidFunction drawMeshTasksFunction = nullptr;
+    // the sets are written again when the buffers change
+    DescriptorAllocator descriptorAllocator;
+
+    std::array<FrameBuffers, MAX_FRAMES_IN_FLIGHT> frames;
+    // objects and commands that fit into every frame's buffers
+    size_t objectCapacity = 0;
+    size_t commandCapacity = 0;
+    // commands per `vkCmdDrawIndexedIndirect` with multiDrawIndirect
+    uint32_t maxDrawIndirectCount = 1;
+
+    VkShaderModule loadShaderModule(const std::string& filename);
+    // device local, `data` is copied in with a staging buffer
+    void createStaticBuffer(const void* data, VkDeviceSize size,
+                            VkCommandPool* commandPool, VkBuffer& buffer,
+                            VkDeviceMemory& memory);
+    void createCullPipeline();
+    void createMeshPipeline(VkDescriptorSetLayout textureSetLayout,
+                            VkRenderPass renderPass);
+    // Makes room for `objectCount` objects and `commandCount` commands in
+    // every frame's buffers, waits on the device if they are replaced
+    void reserve(size_t objectCount, size_t commandCount);
+    void createFrameBuffers();
+    void destroyFrameBuffers();
+    void writeSets();
+};
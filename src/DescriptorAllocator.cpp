@@ -0,0 +1,142 @@
+#include <algorithm>  // std::max, std::min
+#include <iostream>   // std::cout
+#include <stdexcept>  // std::runtime_error
+
+#include "DescriptorAllocator.hpp"
+
+void DescriptorAllocator::create(VkDevice device, uint32_t setsPerPool,
+                                 const std::vector<PoolRatio>& ratios,
+                                 VkDescriptorPoolCreateFlags flags) {
+    this->device = device;
+    this->ratios = ratios;
+    this->flags = flags;
+    this->setsPerPool = setsPerPool;
+
+    readyPools.push_back(createPool(setsPerPool));
+}
+
+void DescriptorAllocator::destroy() {
+    for (VkDescriptorPool pool : readyPools) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    for (VkDescriptorPool pool : fullPools) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+
+    readyPools.clear();
+    fullPools.clear();
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount) {
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (const PoolRatio& ratio : ratios) {
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = ratio.type;
+        poolSize.descriptorCount =
+            std::max(1u, static_cast<uint32_t>(ratio.ratio * setCount));
+        poolSizes.push_back(poolSize);
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = flags;
+    poolInfo.maxSets = setCount;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    return pool;
+}
+
+VkDescriptorPool DescriptorAllocator::getPool() {
+    if (!readyPools.empty()) {
+        return readyPools.back();
+    }
+
+    // every new pool is larger, so a growing scene needs only a few
+    setsPerPool = std::min(setsPerPool * 2, MAX_SETS_PER_POOL);
+
+    std::cout << "DescriptorAllocator::getPool(), growing to "
+              << getPoolCount() + 1 << " pools" << std::endl;
+
+    readyPools.push_back(createPool(setsPerPool));
+    return readyPools.back();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = getPool();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet set;
+    VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY ||
+        result == VK_ERROR_FRAGMENTED_POOL) {
+        // retire the pool and try once more with a fresh one
+        fullPools.push_back(readyPools.back());
+        readyPools.pop_back();
+
+        allocInfo.descriptorPool = getPool();
+        result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+    }
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    return set;
+}
+
+void DescriptorAllocator::write(
+    VkDescriptorSet set, const std::vector<DescriptorBinding>& bindings) {
+    // the infos have to outlive `vkUpdateDescriptorSets`
+    std::vector<VkDescriptorBufferInfo> bufferInfos(bindings.size());
+    std::vector<VkDescriptorImageInfo> imageInfos(bindings.size());
+    std::vector<VkWriteDescriptorSet> writes(bindings.size());
+
+    for (size_t i = 0; i < bindings.size(); i++) {
+        const DescriptorBinding& binding = bindings[i];
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = binding.binding;
+        writes[i].dstArrayElement = 0;
+        writes[i].descriptorType = binding.type;
+        writes[i].descriptorCount = 1;
+
+        if (binding.buffer != VK_NULL_HANDLE) {
+            bufferInfos[i].buffer = binding.buffer;
+            bufferInfos[i].offset = binding.offset;
+            bufferInfos[i].range = binding.range;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        } else {
+            imageInfos[i].imageView = binding.imageView;
+            imageInfos[i].sampler = binding.sampler;
+            imageInfos[i].imageLayout = binding.imageLayout;
+            writes[i].pImageInfo = &imageInfos[i];
+        }
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()),
+                           writes.data(), 0, nullptr);
+}
+
+void DescriptorAllocator::reset() {
+    for (VkDescriptorPool pool : readyPools) {
+        vkResetDescriptorPool(device, pool, 0);
+    }
+    for (VkDescriptorPool pool : fullPools) {
+        vkResetDescriptorPool(device, pool, 0);
+        readyPools.push_back(pool);
+    }
+
+    fullPools.clear();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector> // std::vector
+
+#include <vulkan/vulkan.h>
+
+// One binding written by `DescriptorAllocator::write`, either a buffer or
+// an image
+struct DescriptorBinding {
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize range = 0;
+
+    VkImageView imageView = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkImageLayout imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+// Hands out descriptor sets from a list of pools. When a pool runs out a new,
+// larger one is created, so sets can be allocated at any time without knowing
+// the total up front. Sets are freed all at once by `reset`, before the
+// resources they point to are written again, or with `destroy`.
+class DescriptorAllocator {
+  public:
+    // descriptors of `type` per set in a pool
+    struct PoolRatio {
+        VkDescriptorType type;
+        float ratio;
+    };
+
+    // largest pool created when growing
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    void create(VkDevice device, uint32_t setsPerPool,
+                const std::vector<PoolRatio>& ratios,
+                VkDescriptorPoolCreateFlags flags = 0);
+    void destroy();
+
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+    // Writes `bindings` into `set`. Unless they are update-after-bind the
+    // set must not be in use by a pending command buffer, and command
+    // buffers it was bound in have to be recorded again.
+    void write(VkDescriptorSet set,
+               const std::vector<DescriptorBinding>& bindings);
+    // Returns every set to the pools. The sets must not be in use by a
+    // pending command buffer.
+    void reset();
+
+    size_t getPoolCount() const {
+        return readyPools.size() + fullPools.size();
+    }
+
+  private:
+    VkDevice device = VK_NULL_HANDLE;
+    std::vector<PoolRatio> ratios;
+    VkDescriptorPoolCreateFlags flags = 0;
+    // size of the next pool
+    uint32_t setsPerPool = 0;
+
+    // pools with room left, the last one is allocated from
+    std::vector<VkDescriptorPool> readyPools;
+    std::vector<VkDescriptorPool> fullPools;
+
+    VkDescriptorPool getPool();
+    VkDescriptorPool createPool(uint32_t setCount);
+};
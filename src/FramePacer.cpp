@@ -0,0 +1,91 @@
+#include <cfloat> // FLT_MAX
+#include <cstdio> // snprintf
+#include <thread> // std::this_thread
+
+#include "imgui/imgui.h"
+
+#include "FramePacer.hpp"
+
+static float millisecondsBetween(std::chrono::steady_clock::time_point from,
+                                 std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<float, std::milli>(to - from).count();
+}
+
+void FramePacer::markInputSampled() {
+    inputTime = clock::now();
+    inputSampled = true;
+}
+
+void FramePacer::frameCompleted(uint32_t frame) {
+    clock::time_point now = clock::now();
+
+    if (hasCompletion) {
+        float period = millisecondsBetween(lastCompletion, now);
+        if (framePeriodMs == 0.0f) {
+            framePeriodMs = period;
+        } else {
+            framePeriodMs += SMOOTHING * (period - framePeriodMs);
+        }
+    }
+    lastCompletion = now;
+    hasCompletion = true;
+
+    if (submitted[frame]) {
+        latencyMs = millisecondsBetween(submittedInputTime[frame], now);
+        submitted[frame] = false;
+
+        latencyHistory[historyOffset] = latencyMs;
+        historyOffset = (historyOffset + 1) % HISTORY_SIZE;
+    }
+}
+
+void FramePacer::frameSubmitted(uint32_t frame) {
+    // frames drawn without sampling input (headless, benchmark) are not
+    // part of the latency
+    if (!inputSampled) {
+        return;
+    }
+
+    float cpu = millisecondsBetween(inputTime, clock::now());
+    if (cpuMs == 0.0f) {
+        cpuMs = cpu;
+    } else {
+        cpuMs += SMOOTHING * (cpu - cpuMs);
+    }
+
+    submittedInputTime[frame] = inputTime;
+    submitted[frame] = true;
+    inputSampled = false;
+}
+
+void FramePacer::sleepUntilPredictedStart(float gpuMs) {
+    sleepMs = 0.0f;
+
+    if (!hasCompletion || framePeriodMs == 0.0f) {
+        return;
+    }
+
+    // the next frame is expected to complete one period after the last one,
+    // start just early enough to get the CPU and GPU work done by then
+    float startMs = framePeriodMs - cpuMs - gpuMs - SLEEP_MARGIN_MS;
+    float elapsedMs = millisecondsBetween(lastCompletion, clock::now());
+
+    if (startMs <= elapsedMs) {
+        return;
+    }
+
+    sleepMs = startMs - elapsedMs;
+    std::this_thread::sleep_for(
+        std::chrono::duration<float, std::milli>(sleepMs));
+}
+
+void FramePacer::drawImgui() {
+    char overlay[64];
+
+    snprintf(overlay, sizeof(overlay), "latency %.2f ms", latencyMs);
+    ImGui::PlotLines("input latency", latencyHistory.data(), HISTORY_SIZE,
+                     historyOffset, overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+    ImGui::Text("frame period %.2f ms, input to submit %.2f ms, slept %.2f ms",
+                framePeriodMs, cpuMs, sleepMs);
+}
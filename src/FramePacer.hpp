@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono> // std::chrono
+#include <vector> // std::vector
+
+#include "VulkanSetup.hpp"
+
+// Measures input latency and implements the low latency mode: the frame
+// waits for its fence before input is sampled instead of after, and can
+// additionally sleep until the latest point that still makes the predicted
+// next present, so the input is as fresh as possible when it is rendered.
+//
+// Latency is taken from the moment input was sampled for a frame until its
+// fence is seen signaled. Without a present timing extension the wait for
+// scan-out is not included, it adds up to one refresh interval with FIFO.
+class FramePacer {
+  public:
+    // number of samples shown in the rolling graph
+    static const int HISTORY_SIZE = 240;
+
+    bool lowLatency = false;
+    // only used in low latency mode
+    bool sleepUntilPresent = false;
+
+    // call right after polling input
+    void markInputSampled();
+    // call after the fence of `frame` was waited on, before it is recorded
+    void frameCompleted(uint32_t frame);
+    // call after the command buffer of `frame` was submitted
+    void frameSubmitted(uint32_t frame);
+    // Sleeps until `gpuMs` plus the measured CPU time before the predicted
+    // next frame completion
+    void sleepUntilPredictedStart(float gpuMs);
+
+    float getLatencyMs() const { return latencyMs; }
+    float getFramePeriodMs() const { return framePeriodMs; }
+
+    // Draws the pacing graphs into the current ImGui window
+    void drawImgui();
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    // safety margin kept when sleeping, a missed present costs a whole frame
+    static constexpr float SLEEP_MARGIN_MS = 1.0f;
+    // weight of the newest sample in the moving averages
+    static constexpr float SMOOTHING = 0.1f;
+
+    clock::time_point inputTime;
+    bool inputSampled = false;
+
+    // input time of the frame submitted in every slot
+    clock::time_point submittedInputTime[MAX_FRAMES_IN_FLIGHT];
+    bool submitted[MAX_FRAMES_IN_FLIGHT] = {};
+
+    clock::time_point lastCompletion;
+    bool hasCompletion = false;
+
+    float framePeriodMs = 0.0f;
+    // input sample to submission
+    float cpuMs = 0.0f;
+    float latencyMs = 0.0f;
+    float sleepMs = 0.0f;
+
+    std::vector<float> latencyHistory = std::vector<float>(HISTORY_SIZE);
+    int historyOffset = 0;
+};
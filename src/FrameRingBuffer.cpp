@@ -0,0 +1,179 @@
+#include <algorithm> // std::max
+#include <iostream>  // std::cout
+#include <stdexcept> // std::runtime_error
+
+#include "FrameRingBuffer.hpp"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void FrameRingBuffer::create(VkDevice device, VkPhysicalDevice physicalDevice,
+                             VkBufferUsageFlags usage, uint32_t regionCount,
+                             VkDeviceSize regionSize,
+                             VkDeviceSize headerSize) {
+    this->device = device;
+    this->physicalDevice = physicalDevice;
+    this->usage = usage;
+    this->regionCount = regionCount;
+    this->headerSize = headerSize;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // both are powers of two, the larger one is a multiple of the other
+    offsetAlignment =
+        std::max(properties.limits.minUniformBufferOffsetAlignment,
+                 properties.limits.minStorageBufferOffsetAlignment);
+
+    heads.reset(new std::atomic<VkDeviceSize>[regionCount]);
+
+    this->regionSize = alignUp(std::max(regionSize, headerSize),
+                               offsetAlignment);
+    createBuffer();
+}
+
+void FrameRingBuffer::destroy() {
+    destroyBuffer();
+    heads.reset();
+}
+
+void FrameRingBuffer::resize(VkDeviceSize regionSize) {
+    destroyBuffer();
+
+    this->regionSize = alignUp(std::max(regionSize, headerSize),
+                               offsetAlignment);
+    createBuffer();
+
+    std::cout << "FrameRingBuffer::resize(), " << this->regionSize
+              << " bytes per frame" << std::endl;
+}
+
+void FrameRingBuffer::createBuffer() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // the whole region is bound as one storage buffer
+    if ((usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) &&
+        regionSize > properties.limits.maxStorageBufferRange) {
+        throw std::runtime_error("frame ring buffer region is too large!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = regionSize * regionCount;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create frame ring buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    // Device local memory the CPU can write saves the GPU from reading the
+    // data over the bus, plain host memory works everywhere
+    const VkMemoryPropertyFlags hostFlags =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkMemoryPropertyFlags preferred[] = {
+        hostFlags | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hostFlags};
+
+    VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    for (VkMemoryPropertyFlags flags : preferred) {
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            if (!(memRequirements.memoryTypeBits & (1 << i)) ||
+                (memProperties.memoryTypes[i].propertyFlags & flags) !=
+                    flags) {
+                continue;
+            }
+
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = memRequirements.size;
+            allocInfo.memoryTypeIndex = i;
+
+            // the device local heap can be small, fall back if it is full
+            result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+            if (result == VK_SUCCESS) {
+                deviceLocal =
+                    flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ? true : false;
+                break;
+            }
+        }
+
+        if (result == VK_SUCCESS) {
+            break;
+        }
+    }
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to allocate frame ring buffer memory!");
+    }
+
+    vkBindBufferMemory(device, buffer, memory, 0);
+
+    // mapped for as long as the buffer lives
+    void* data;
+    if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to map frame ring buffer memory!");
+    }
+    mapped = static_cast<char*>(data);
+
+    for (uint32_t region = 0; region < regionCount; region++) {
+        heads[region] = headerSize;
+    }
+}
+
+void FrameRingBuffer::destroyBuffer() {
+    if (buffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkUnmapMemory(device, memory);
+    vkDestroyBuffer(device, buffer, nullptr);
+    vkFreeMemory(device, memory, nullptr);
+
+    buffer = VK_NULL_HANDLE;
+    memory = VK_NULL_HANDLE;
+    mapped = nullptr;
+}
+
+void FrameRingBuffer::reset(uint32_t region) {
+    heads[region].store(headerSize, std::memory_order_relaxed);
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::allocate(uint32_t region,
+                                                      VkDeviceSize size,
+                                                      VkDeviceSize alignment) {
+    std::atomic<VkDeviceSize>& head = heads[region];
+
+    // the recording threads allocate at the same time
+    VkDeviceSize used = head.load(std::memory_order_relaxed);
+    VkDeviceSize offset;
+    do {
+        offset = alignUp(used, alignment);
+        if (offset + size > regionSize) {
+            throw std::runtime_error("frame ring buffer is full!");
+        }
+    } while (!head.compare_exchange_weak(used, offset + size,
+                                         std::memory_order_relaxed));
+
+    Allocation allocation;
+    allocation.offset = offset;
+    allocation.data = mapped + getRegionOffset(region) + offset;
+    return allocation;
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::getHeader(uint32_t region) const {
+    Allocation allocation;
+    allocation.offset = 0;
+    allocation.data = mapped + getRegionOffset(region);
+    return allocation;
+}
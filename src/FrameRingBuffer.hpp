@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic> // std::atomic
+#include <memory> // std::unique_ptr
+
+#include <vulkan/vulkan.h>
+
+// One persistently mapped buffer split into a region per frame in flight.
+// Data that changes every frame (camera, per-instance transforms, material
+// parameters) is written into the region of the frame being recorded and
+// read by the shaders through dynamic offsets, so nothing is allocated per
+// draw. A region is reset as a whole once its frame's fence signalled.
+//
+// Host visible and coherent, device local as well where such memory exists
+// (resizable BAR, integrated GPUs). It is usually write-combined, so it is
+// only ever written front to back and never read from the CPU.
+class FrameRingBuffer {
+  public:
+    struct Allocation {
+        // from the start of the region, see `getRegionOffset`
+        VkDeviceSize offset = 0;
+        void* data = nullptr;
+    };
+
+    // `headerSize` bytes at the start of every region are reserved for data
+    // with a fixed place, see `getHeader`
+    void create(VkDevice device, VkPhysicalDevice physicalDevice,
+                VkBufferUsageFlags usage, uint32_t regionCount,
+                VkDeviceSize regionSize, VkDeviceSize headerSize = 0);
+    void destroy();
+    // Replaces the buffer with one of at least `regionSize` per region, which
+    // drops the data and changes `getBuffer`. Nothing may be pending.
+    void resize(VkDeviceSize regionSize);
+
+    // Frees every allocation of `region`, its frame must not be pending
+    void reset(uint32_t region);
+    // `size` bytes at a multiple of `alignment` from the region start. Safe
+    // to call from several threads for the same region. Throws if the
+    // region is full.
+    Allocation allocate(uint32_t region, VkDeviceSize size,
+                        VkDeviceSize alignment);
+    Allocation getHeader(uint32_t region) const;
+
+    VkBuffer getBuffer() const { return buffer; }
+    // The dynamic offset of `region`. Multiple of the uniform and storage
+    // buffer offset alignment, so bindings starting at offset 0 can use it.
+    VkDeviceSize getRegionOffset(uint32_t region) const {
+        return region * regionSize;
+    }
+    VkDeviceSize getRegionSize() const { return regionSize; }
+    bool isDeviceLocal() const { return deviceLocal; }
+
+  private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkBufferUsageFlags usage = 0;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    char* mapped = nullptr;
+    bool deviceLocal = false;
+
+    uint32_t regionCount = 0;
+    VkDeviceSize regionSize = 0;
+    VkDeviceSize headerSize = 0;
+    // of the dynamic offsets
+    VkDeviceSize offsetAlignment = 1;
+
+    // bytes used of every region
+    std::unique_ptr<std::atomic<VkDeviceSize>[]> heads;
+
+    void createBuffer();
+    void destroyBuffer();
+};
@@ -0,0 +1,235 @@
+#include <cfloat>    // FLT_MAX
+#include <cstdio>    // snprintf
+#include <iostream>  // std::cout
+#include <stdexcept> // std::runtime_error
+
+#include "imgui/imgui.h"
+
+#include "GpuProfiler.hpp"
+
+const char* GpuProfiler::passNames[PASS_COUNT] = {"geometry", "imgui"};
+
+// counted for the geometry pass, results are returned in bit order
+static const VkQueryPipelineStatisticFlags STATISTICS_FLAGS =
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+void GpuProfiler::create(VkDevice device, VkPhysicalDevice physicalDevice,
+                         uint32_t queueFamilyIndex, uint32_t framesInFlight,
+                         bool pipelineStatistics) {
+    this->device = device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                             nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                             queueFamilies.data());
+
+    uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+
+    timestampsSupported =
+        validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+    statisticsSupported = pipelineStatistics;
+    timestampPeriod = properties.limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    writtenQueries.assign(framesInFlight, 0);
+    for (std::vector<float>& history : passHistory) {
+        history.assign(HISTORY_SIZE, 0.0f);
+    }
+
+    if (timestampsSupported) {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = framesInFlight * PASS_COUNT * 2;
+
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampPool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    if (statisticsSupported) {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = framesInFlight;
+        poolInfo.pipelineStatistics = STATISTICS_FLAGS;
+
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &statisticsPool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                "failed to create pipeline statistics query pool!");
+        }
+    }
+
+    std::cout << "GpuProfiler::create(), timestamps "
+              << (timestampsSupported ? "on" : "off") << " ("
+              << timestampPeriod << " ns/tick, " << validBits
+              << " bits), pipeline statistics "
+              << (statisticsSupported ? "on" : "off") << std::endl;
+}
+
+void GpuProfiler::destroy() {
+    if (timestampPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, timestampPool, nullptr);
+        timestampPool = VK_NULL_HANDLE;
+    }
+
+    if (statisticsPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, statisticsPool, nullptr);
+        statisticsPool = VK_NULL_HANDLE;
+    }
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+    currentFrame = frame;
+
+    readResults(frame);
+    writtenQueries[frame] = 0;
+
+    if (timestampsSupported) {
+        vkCmdResetQueryPool(commandBuffer, timestampPool,
+                            timestampQuery(frame, GeometryPass, false),
+                            PASS_COUNT * 2);
+    }
+
+    if (statisticsSupported) {
+        vkCmdResetQueryPool(commandBuffer, statisticsPool, frame, 1);
+    }
+}
+
+void GpuProfiler::beginPass(VkCommandBuffer commandBuffer, Pass pass,
+                            bool withStatistics) {
+    if (timestampsSupported) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            timestampPool,
+                            timestampQuery(currentFrame, pass, false));
+        writtenQueries[currentFrame] |= 1u << pass;
+    }
+
+    if (pass == GeometryPass && statisticsSupported && statisticsEnabled &&
+        withStatistics) {
+        vkCmdBeginQuery(commandBuffer, statisticsPool, currentFrame, 0);
+        writtenQueries[currentFrame] |= 1u << PASS_COUNT;
+    }
+}
+
+void GpuProfiler::endPass(VkCommandBuffer commandBuffer, Pass pass) {
+    if (pass == GeometryPass &&
+        (writtenQueries[currentFrame] & (1u << PASS_COUNT))) {
+        vkCmdEndQuery(commandBuffer, statisticsPool, currentFrame);
+    }
+
+    if (timestampsSupported) {
+        vkCmdWriteTimestamp(commandBuffer,
+                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            timestampPool,
+                            timestampQuery(currentFrame, pass, true));
+    }
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler::getActiveStatistics() const {
+    if (writtenQueries[currentFrame] & (1u << PASS_COUNT)) {
+        return STATISTICS_FLAGS;
+    }
+    return 0;
+}
+
+void GpuProfiler::readResults(uint32_t frame) {
+    uint32_t written = writtenQueries[frame];
+
+    if (written == 0) {
+        return;
+    }
+
+    for (int pass = 0; pass < PASS_COUNT; pass++) {
+        uint64_t timestamps[2];
+
+        // No VK_QUERY_RESULT_WAIT_BIT, the fence of this frame was waited on
+        // before recording so VK_NOT_READY would only mean a lost frame
+        if (!(written & (1u << pass)) ||
+            vkGetQueryPoolResults(
+                device, timestampPool,
+                timestampQuery(frame, static_cast<Pass>(pass), false), 2,
+                sizeof(timestamps), timestamps, sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            passMs[pass] = 0.0f;
+        } else {
+            uint64_t ticks =
+                ((timestamps[1] & timestampMask) -
+                 (timestamps[0] & timestampMask)) &
+                timestampMask;
+            passMs[pass] = ticks * timestampPeriod / 1000000.0f;
+        }
+
+        passHistory[pass][historyOffset] = passMs[pass];
+    }
+
+    historyOffset = (historyOffset + 1) % HISTORY_SIZE;
+
+    if (written & (1u << PASS_COUNT)) {
+        uint64_t statistics[3];
+
+        if (vkGetQueryPoolResults(device, statisticsPool, frame, 1,
+                                  sizeof(statistics), statistics,
+                                  sizeof(statistics),
+                                  VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            pipelineStats.vertexInvocations = statistics[0];
+            pipelineStats.clippingPrimitives = statistics[1];
+            pipelineStats.fragmentInvocations = statistics[2];
+        }
+    }
+}
+
+float GpuProfiler::getTotalMs() const {
+    float total = 0.0f;
+    for (float ms : passMs) {
+        total += ms;
+    }
+    return total;
+}
+
+void GpuProfiler::drawImgui(float cpuFrameMs) {
+    if (!timestampsSupported) {
+        ImGui::Text("timestamp queries are not supported on this queue");
+        return;
+    }
+
+    char overlay[64];
+
+    for (int pass = 0; pass < PASS_COUNT; pass++) {
+        snprintf(overlay, sizeof(overlay), "%s %.3f ms", passNames[pass],
+                 passMs[pass]);
+        ImGui::PlotLines(passNames[pass], passHistory[pass].data(),
+                         HISTORY_SIZE, historyOffset, overlay, 0.0f, FLT_MAX,
+                         ImVec2(0, 40));
+    }
+
+    // The passes are timed back to back, so a GPU total close to the CPU
+    // frame time means the CPU is waiting on the GPU
+    float gpuMs = getTotalMs();
+    ImGui::Text("gpu %.3f ms / cpu frame %.3f ms, %s bound", gpuMs,
+                cpuFrameMs, gpuMs > 0.9f * cpuFrameMs ? "GPU" : "CPU");
+
+    if (!statisticsSupported) {
+        return;
+    }
+
+    ImGui::Checkbox("pipeline statistics", &statisticsEnabled);
+
+    if (statisticsEnabled) {
+        ImGui::Text("vertex invocations = %llu",
+                    (unsigned long long)pipelineStats.vertexInvocations);
+        ImGui::Text("clipping primitives = %llu",
+                    (unsigned long long)pipelineStats.clippingPrimitives);
+        ImGui::Text("fragment invocations = %llu",
+                    (unsigned long long)pipelineStats.fragmentInvocations);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector> // std::vector
+
+#include <vulkan/vulkan.h>
+
+// Measures GPU time of the passes recorded in `Render::recordCommandBuffer`
+// with timestamp queries, and optionally counts pipeline statistics for the
+// geometry pass. Every frame in flight owns its own range of queries, which
+// are read back the next time that frame is recorded. Its fence has been
+// waited on by then, so the results are available without stalling and lag
+// as many frames behind as there are frames in flight.
+class GpuProfiler {
+  public:
+    enum Pass {
+        GeometryPass,
+        ImguiPass,
+        PASS_COUNT,
+    };
+
+    // number of samples shown in the rolling graphs
+    static const int HISTORY_SIZE = 240;
+
+    struct PipelineStats {
+        uint64_t vertexInvocations = 0;
+        uint64_t clippingPrimitives = 0;
+        uint64_t fragmentInvocations = 0;
+    };
+
+    // Needs a logical device created with `pipelineStatisticsQuery` for
+    // `pipelineStatistics`, timestamps are disabled if the queue family does
+    // not support them
+    void create(VkDevice device, VkPhysicalDevice physicalDevice,
+                uint32_t queueFamilyIndex, uint32_t framesInFlight,
+                bool pipelineStatistics);
+    void destroy();
+
+    // Reads back the results of the last submission of `frame` and resets its
+    // queries. Has to be recorded outside of a render pass.
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+    // The statistics query of the geometry pass is skipped if
+    // `withStatistics` is false, e.g. when the draws are executed from
+    // secondary command buffers that cannot inherit it
+    void beginPass(VkCommandBuffer commandBuffer, Pass pass,
+                   bool withStatistics = true);
+    void endPass(VkCommandBuffer commandBuffer, Pass pass);
+    // Statistics counted by the active query of the current frame, for the
+    // inheritance info of secondary command buffers
+    VkQueryPipelineStatisticFlags getActiveStatistics() const;
+
+    bool isEnabled() const { return timestampsSupported; }
+    bool hasPipelineStatistics() const { return statisticsSupported; }
+    // GPU time of `pass` in the most recent frame that has results
+    float getPassMs(Pass pass) const { return passMs[pass]; }
+    float getTotalMs() const;
+    const PipelineStats& getPipelineStats() const { return pipelineStats; }
+
+    // Draws the GPU times into the current ImGui window. `cpuFrameMs` is only
+    // used to tell whether the frame is bound by the CPU or the GPU.
+    void drawImgui(float cpuFrameMs);
+
+    // Set to false to skip the pipeline statistics query
+    bool statisticsEnabled = true;
+
+  private:
+    static const char* passNames[PASS_COUNT];
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueryPool timestampPool = VK_NULL_HANDLE;
+    VkQueryPool statisticsPool = VK_NULL_HANDLE;
+
+    bool timestampsSupported = false;
+    bool statisticsSupported = false;
+    // nanoseconds per timestamp tick
+    float timestampPeriod = 1.0f;
+    uint64_t timestampMask = ~0ull;
+
+    uint32_t currentFrame = 0;
+    // bitmask of the passes written by the last submission of every frame,
+    // bit PASS_COUNT is the statistics query
+    std::vector<uint32_t> writtenQueries;
+
+    float passMs[PASS_COUNT] = {};
+    PipelineStats pipelineStats;
+
+    // ring buffers for the ImGui graphs, `historyOffset` is the oldest value
+    std::vector<float> passHistory[PASS_COUNT];
+    int historyOffset = 0;
+
+    void readResults(uint32_t frame);
+    uint32_t timestampQuery(uint32_t frame, Pass pass, bool end) const {
+        return (frame * PASS_COUNT + pass) * 2 + (end ? 1 : 0);
+    }
+};
@@ -0,0 +1,432 @@
+#include <algorithm>     // std::nth_element, std::replace
+#include <cmath>         // std::sqrt, std::cos, std::sin
+#include <filesystem>    // std::filesystem
+#include <fstream>       // std::ifstream, std::ofstream
+#include <iostream>      // std::cout
+#include <limits>        // std::numeric_limits
+#include <set>           // std::set
+#include <stdexcept>     // std::runtime_error
+#include <unordered_set> // std::unordered_set
+
+#include "MeshCollider.hpp"
+
+// bump when the hull generation or the file layout changes
+static const uint32_t CACHE_VERSION = 1;
+static const char CACHE_MAGIC[4] = {'H', 'U', 'L', 'L'};
+
+void MeshCollider::build(const std::string& meshPath, ColliderType type,
+                         const std::vector<Vertex>& vertices,
+                         const std::vector<uint32_t>& indices,
+                         ColliderSettings settings) {
+    this->meshPath = meshPath;
+    this->type = type;
+    this->settings = settings;
+
+    positions.clear();
+    positions.reserve(vertices.size() * 3);
+    for (const Vertex& vertex : vertices) {
+        positions.push_back(vertex.pos.x);
+        positions.push_back(vertex.pos.y);
+        positions.push_back(vertex.pos.z);
+    }
+    triangleIndices = indices;
+
+    if (type == ColliderType::Box || type == ColliderType::TriangleMesh) {
+        // nothing to precompute, the triangle mesh is created on first use
+        return;
+    }
+
+    std::vector<std::vector<glm::vec3>> hulls;
+    if (!loadCache(hulls)) {
+        hulls = computeHulls(type, vertices, indices, settings);
+        saveCache(hulls);
+    }
+
+    createConvexMeshes(hulls);
+
+    std::cout << "MeshCollider::build(), " << meshPath << ": "
+              << convexMeshes.size() << " hull(s)" << std::endl;
+}
+
+void MeshCollider::attach(rp3d::RigidBody* body, glm::vec3 scale) {
+    rp3d::Vector3 scaling(scale.x, scale.y, scale.z);
+
+    if (type == ColliderType::Box) {
+        body->addCollider(shapeCache->getBoxShape(scaling),
+                          rp3d::Transform::identity());
+    } else if (body->getType() == rp3d::BodyType::STATIC ||
+               type == ColliderType::TriangleMesh) {
+        // rp3d only supports concave shapes on static bodies, so a dynamic
+        // body asking for a triangle mesh is a setup error
+        if (body->getType() != rp3d::BodyType::STATIC) {
+            throw std::runtime_error(
+                "triangle mesh colliders require a static body: " + meshPath);
+        }
+
+        if (triangleMesh == nullptr) {
+            createTriangleMesh();
+        }
+
+        body->addCollider(
+            shapeCache->getConcaveMeshShape(triangleMesh, scaling),
+            rp3d::Transform::identity());
+    } else {
+        for (rp3d::ConvexMesh* convexMesh : convexMeshes) {
+            body->addCollider(
+                shapeCache->getConvexMeshShape(convexMesh, scaling),
+                rp3d::Transform::identity());
+        }
+    }
+
+    body->updateMassPropertiesFromColliders();
+}
+
+void MeshCollider::detach(rp3d::RigidBody* body, ShapeCache* shapeCache) {
+    while (body->getNbColliders() > 0) {
+        rp3d::Collider* collider = body->getCollider(0);
+        rp3d::CollisionShape* shape = collider->getCollisionShape();
+
+        body->removeCollider(collider);
+        shapeCache->release(shape);
+    }
+}
+
+void MeshCollider::createTriangleMesh() {
+    rp3d::TriangleVertexArray triangleArray(
+        static_cast<rp3d::uint32>(positions.size() / 3), positions.data(),
+        3 * sizeof(float),
+        static_cast<rp3d::uint32>(triangleIndices.size() / 3),
+        triangleIndices.data(), 3 * sizeof(uint32_t),
+        rp3d::TriangleVertexArray::VertexDataType::VERTEX_FLOAT_TYPE,
+        rp3d::TriangleVertexArray::IndexDataType::INDEX_INTEGER_TYPE);
+
+    std::vector<rp3d::Message> messages;
+    triangleMesh = physicsCommon->createTriangleMesh(triangleArray, messages);
+
+    if (triangleMesh == nullptr) {
+        for (const rp3d::Message& message : messages) {
+            std::cerr << "MeshCollider: " << message.text << std::endl;
+        }
+        throw std::runtime_error("failed to create triangle mesh collider: " +
+                                 meshPath);
+    }
+}
+
+void MeshCollider::createConvexMeshes(
+    const std::vector<std::vector<glm::vec3>>& hulls) {
+    for (const std::vector<glm::vec3>& hull : hulls) {
+        // rp3d runs quickhull on the reduced point set
+        rp3d::VertexArray vertexArray(
+            hull.data(), sizeof(glm::vec3),
+            static_cast<rp3d::uint32>(hull.size()),
+            rp3d::VertexArray::DataType::VERTEX_FLOAT_TYPE);
+
+        std::vector<rp3d::Message> messages;
+        rp3d::ConvexMesh* convexMesh =
+            physicsCommon->createConvexMesh(vertexArray, messages);
+
+        // degenerate (e.g. flat) parts cannot form a hull, skip them
+        if (convexMesh == nullptr) {
+            for (const rp3d::Message& message : messages) {
+                std::cerr << "MeshCollider: " << message.text << std::endl;
+            }
+            continue;
+        }
+
+        convexMeshes.push_back(convexMesh);
+    }
+
+    if (convexMeshes.empty()) {
+        throw std::runtime_error("failed to create convex collider: " +
+                                 meshPath);
+    }
+}
+
+std::vector<std::vector<glm::vec3>>
+MeshCollider::computeHulls(ColliderType type,
+                           const std::vector<Vertex>& vertices,
+                           const std::vector<uint32_t>& indices,
+                           ColliderSettings settings) {
+    std::vector<std::vector<glm::vec3>> hulls;
+
+    if (type == ColliderType::ConvexHull) {
+        std::vector<glm::vec3> points;
+        points.reserve(vertices.size());
+        for (const Vertex& vertex : vertices) {
+            points.push_back(vertex.pos);
+        }
+
+        hulls.push_back(reduceToBudget(points, settings.vertexBudget));
+        return hulls;
+    }
+
+    // Approximate convex decomposition: start with the whole mesh as a single
+    // part and keep splitting the part with the largest bounding volume at
+    // the median triangle centroid along its longest axis. This follows the
+    // V-HACD idea of recursive plane cuts, with the bounding volume standing
+    // in for the concavity measure.
+    size_t triangleCount = indices.size() / 3;
+
+    std::vector<std::vector<uint32_t>> parts(1);
+    parts[0].resize(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        parts[0][t] = t;
+    }
+
+    auto centroid = [&](uint32_t t) {
+        return (vertices[indices[3 * t + 0]].pos +
+                vertices[indices[3 * t + 1]].pos +
+                vertices[indices[3 * t + 2]].pos) /
+               3.0f;
+    };
+
+    auto bounds = [&](const std::vector<uint32_t>& part, glm::vec3& min,
+                      glm::vec3& max) {
+        min = glm::vec3(std::numeric_limits<float>::max());
+        max = glm::vec3(std::numeric_limits<float>::lowest());
+        for (uint32_t t : part) {
+            for (int k = 0; k < 3; k++) {
+                min = glm::min(min, vertices[indices[3 * t + k]].pos);
+                max = glm::max(max, vertices[indices[3 * t + k]].pos);
+            }
+        }
+    };
+
+    while (static_cast<int>(parts.size()) < settings.maxHulls) {
+        int largest = -1;
+        float largestVolume = 0.0f;
+        glm::vec3 largestExtent;
+
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (parts[i].size() < 2) {
+                continue;
+            }
+
+            glm::vec3 min, max;
+            bounds(parts[i], min, max);
+            glm::vec3 extent = max - min;
+            float volume = extent.x * extent.y * extent.z;
+
+            if (largest == -1 || volume > largestVolume) {
+                largest = static_cast<int>(i);
+                largestVolume = volume;
+                largestExtent = extent;
+            }
+        }
+
+        if (largest == -1) {
+            break;
+        }
+
+        int axis = 0;
+        if (largestExtent.y > largestExtent[axis]) {
+            axis = 1;
+        }
+        if (largestExtent.z > largestExtent[axis]) {
+            axis = 2;
+        }
+
+        std::vector<uint32_t>& part = parts[largest];
+        auto middle = part.begin() + part.size() / 2;
+        std::nth_element(part.begin(), middle, part.end(),
+                         [&](uint32_t a, uint32_t b) {
+                             return centroid(a)[axis] < centroid(b)[axis];
+                         });
+
+        std::vector<uint32_t> upper(middle, part.end());
+        part.erase(middle, part.end());
+        parts.push_back(std::move(upper));
+    }
+
+    for (const std::vector<uint32_t>& part : parts) {
+        std::unordered_set<uint32_t> used;
+        std::vector<glm::vec3> points;
+
+        for (uint32_t t : part) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t index = indices[3 * t + k];
+                if (used.insert(index).second) {
+                    points.push_back(vertices[index].pos);
+                }
+            }
+        }
+
+        // a hull needs at least a tetrahedron
+        if (points.size() < 4) {
+            continue;
+        }
+
+        hulls.push_back(reduceToBudget(points, settings.vertexBudget));
+    }
+
+    return hulls;
+}
+
+std::vector<glm::vec3>
+MeshCollider::reduceToBudget(const std::vector<glm::vec3>& points,
+                             int vertexBudget) {
+    if (static_cast<int>(points.size()) <= vertexBudget) {
+        return points;
+    }
+
+    // Keep the support point of the set in `vertexBudget` directions spread
+    // evenly over the sphere (the 6 axis directions first so the bounds are
+    // preserved exactly). Every support point lies on the hull, so the reduced
+    // hull is contained in the original one and has at most `vertexBudget`
+    // vertices.
+    std::vector<glm::vec3> directions = {
+        glm::vec3(1.0f, 0.0f, 0.0f),  glm::vec3(-1.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f),  glm::vec3(0.0f, -1.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f),  glm::vec3(0.0f, 0.0f, -1.0f)};
+
+    const float goldenAngle = 3.14159265f * (3.0f - std::sqrt(5.0f));
+    int sphereCount = std::max(vertexBudget - 6, 0);
+    for (int i = 0; i < sphereCount; i++) {
+        float y = 1.0f - 2.0f * (i + 0.5f) / sphereCount;
+        float radius = std::sqrt(1.0f - y * y);
+        float phi = goldenAngle * i;
+        directions.push_back(
+            glm::vec3(std::cos(phi) * radius, y, std::sin(phi) * radius));
+    }
+
+    std::set<size_t> selected;
+    for (const glm::vec3& direction : directions) {
+        size_t best = 0;
+        float bestDistance = std::numeric_limits<float>::lowest();
+
+        for (size_t i = 0; i < points.size(); i++) {
+            float distance = glm::dot(points[i], direction);
+            if (distance > bestDistance) {
+                bestDistance = distance;
+                best = i;
+            }
+        }
+
+        selected.insert(best);
+    }
+
+    std::vector<glm::vec3> reduced;
+    reduced.reserve(selected.size());
+    for (size_t i : selected) {
+        reduced.push_back(points[i]);
+    }
+
+    return reduced;
+}
+
+std::string MeshCollider::getCachePath() {
+    std::string name = meshPath;
+    std::replace(name.begin(), name.end(), '/', '_');
+    return "cache/colliders/" + name + ".hulls";
+}
+
+// Cache layout (native endianness):
+//   char[4] magic, uint32 version, uint32 type, int32 vertexBudget,
+//   int32 maxHulls, uint64 source size, int64 source mtime, uint32 hullCount,
+//   hullCount * (uint32 pointCount, pointCount * float[3])
+bool MeshCollider::loadCache(std::vector<std::vector<glm::vec3>>& hulls) {
+    std::ifstream file(getCachePath(), std::ios::binary);
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version, cachedType, hullCount;
+    int32_t vertexBudget, maxHulls;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&cachedType), sizeof(cachedType));
+    file.read(reinterpret_cast<char*>(&vertexBudget), sizeof(vertexBudget));
+    file.read(reinterpret_cast<char*>(&maxHulls), sizeof(maxHulls));
+    file.read(reinterpret_cast<char*>(&sourceSize), sizeof(sourceSize));
+    file.read(reinterpret_cast<char*>(&sourceTime), sizeof(sourceTime));
+    file.read(reinterpret_cast<char*>(&hullCount), sizeof(hullCount));
+
+    std::error_code error;
+    uint64_t currentSize = std::filesystem::file_size(meshPath, error);
+    int64_t currentTime =
+        std::filesystem::last_write_time(meshPath, error)
+            .time_since_epoch()
+            .count();
+
+    if (!file || std::string(magic, 4) != std::string(CACHE_MAGIC, 4) ||
+        version != CACHE_VERSION ||
+        cachedType != static_cast<uint32_t>(type) ||
+        vertexBudget != settings.vertexBudget ||
+        maxHulls != settings.maxHulls || sourceSize != currentSize ||
+        sourceTime != currentTime) {
+        return false;
+    }
+
+    hulls.resize(hullCount);
+    for (std::vector<glm::vec3>& hull : hulls) {
+        uint32_t pointCount;
+        file.read(reinterpret_cast<char*>(&pointCount), sizeof(pointCount));
+
+        hull.resize(pointCount);
+        for (glm::vec3& point : hull) {
+            file.read(reinterpret_cast<char*>(&point.x), sizeof(float));
+            file.read(reinterpret_cast<char*>(&point.y), sizeof(float));
+            file.read(reinterpret_cast<char*>(&point.z), sizeof(float));
+        }
+    }
+
+    if (!file) {
+        hulls.clear();
+        return false;
+    }
+
+    std::cout << "MeshCollider::loadCache(), " << getCachePath() << std::endl;
+
+    return true;
+}
+
+void MeshCollider::saveCache(const std::vector<std::vector<glm::vec3>>& hulls) {
+    std::error_code error;
+    std::filesystem::create_directories("cache/colliders", error);
+
+    std::ofstream file(getCachePath(), std::ios::binary);
+
+    // the cache is only an optimisation, carry on without it
+    if (!file.is_open()) {
+        std::cerr << "MeshCollider: failed to write " << getCachePath()
+                  << std::endl;
+        return;
+    }
+
+    uint32_t cachedType = static_cast<uint32_t>(type);
+    int32_t vertexBudget = settings.vertexBudget;
+    int32_t maxHulls = settings.maxHulls;
+    uint64_t sourceSize = std::filesystem::file_size(meshPath, error);
+    int64_t sourceTime = std::filesystem::last_write_time(meshPath, error)
+                             .time_since_epoch()
+                             .count();
+    uint32_t hullCount = static_cast<uint32_t>(hulls.size());
+
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&CACHE_VERSION),
+               sizeof(CACHE_VERSION));
+    file.write(reinterpret_cast<const char*>(&cachedType), sizeof(cachedType));
+    file.write(reinterpret_cast<const char*>(&vertexBudget),
+               sizeof(vertexBudget));
+    file.write(reinterpret_cast<const char*>(&maxHulls), sizeof(maxHulls));
+    file.write(reinterpret_cast<const char*>(&sourceSize), sizeof(sourceSize));
+    file.write(reinterpret_cast<const char*>(&sourceTime), sizeof(sourceTime));
+    file.write(reinterpret_cast<const char*>(&hullCount), sizeof(hullCount));
+
+    for (const std::vector<glm::vec3>& hull : hulls) {
+        uint32_t pointCount = static_cast<uint32_t>(hull.size());
+        file.write(reinterpret_cast<const char*>(&pointCount),
+                   sizeof(pointCount));
+
+        for (const glm::vec3& point : hull) {
+            file.write(reinterpret_cast<const char*>(&point.x), sizeof(float));
+            file.write(reinterpret_cast<const char*>(&point.y), sizeof(float));
+            file.write(reinterpret_cast<const char*>(&point.z), sizeof(float));
+        }
+    }
+}
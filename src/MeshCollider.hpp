@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string> // std::string
+#include <vector> // std::vector
+
+#include <glm/glm.hpp> // glm::vec3
+
+#include <reactphysics3d/reactphysics3d.h>
+
+#include "ShapeCache.hpp"
+#include "Vertex.hpp"
+
+enum class ColliderType {
+    // box with half-extents equal to the model scale (cube.obj spans -1..1)
+    Box,
+    // single convex hull around the whole mesh
+    ConvexHull,
+    // several convex hulls around spatial parts of the mesh
+    ConvexDecomposition,
+    // exact triangles, rp3d only allows these on static bodies
+    TriangleMesh,
+};
+
+struct ColliderSettings {
+    // maximum number of points kept on each hull
+    int vertexBudget = 32;
+    // upper bound of hulls produced by ConvexDecomposition
+    int maxHulls = 8;
+};
+
+// Physics geometry generated from the mesh of one model class. The hulls are
+// computed once, cached to disk in `cache/colliders/` relative to the
+// working directory and shared by every instance of the class; only the
+// per-instance scale differs.
+class MeshCollider {
+    rp3d::PhysicsCommon* physicsCommon;
+    ShapeCache* shapeCache;
+
+  public:
+    MeshCollider(rp3d::PhysicsCommon* physicsCommon, ShapeCache* shapeCache)
+        : physicsCommon(physicsCommon), shapeCache(shapeCache) {}
+
+    ColliderType type = ColliderType::Box;
+    ColliderSettings settings;
+
+    std::vector<rp3d::ConvexMesh*> convexMeshes;
+    rp3d::TriangleMesh* triangleMesh = nullptr;
+
+    void build(const std::string& meshPath, ColliderType type,
+               const std::vector<Vertex>& vertices,
+               const std::vector<uint32_t>& indices,
+               ColliderSettings settings = ColliderSettings());
+
+    // Adds this class' colliders to `body`. Static bodies get the triangle
+    // mesh, every other body type gets the convex hulls. Shapes come from the
+    // ShapeCache and have to be released with `detach`.
+    void attach(rp3d::RigidBody* body, glm::vec3 scale);
+    static void detach(rp3d::RigidBody* body, ShapeCache* shapeCache);
+
+  private:
+    std::string meshPath;
+
+    // kept for the lazily created triangle mesh
+    std::vector<float> positions;
+    std::vector<uint32_t> triangleIndices;
+
+    void createTriangleMesh();
+    void createConvexMeshes(const std::vector<std::vector<glm::vec3>>& hulls);
+
+    static std::vector<std::vector<glm::vec3>>
+    computeHulls(ColliderType type, const std::vector<Vertex>& vertices,
+                 const std::vector<uint32_t>& indices,
+                 ColliderSettings settings);
+    static std::vector<glm::vec3>
+    reduceToBudget(const std::vector<glm::vec3>& points, int vertexBudget);
+
+    std::string getCachePath();
+    bool loadCache(std::vector<std::vector<glm::vec3>>& hulls);
+    void saveCache(const std::vector<std::vector<glm::vec3>>& hulls);
+};
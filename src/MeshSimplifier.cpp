@@ -0,0 +1,304 @@
+#include <algorithm>     // std::sort, std::max, std::min
+#include <cmath>         // std::sqrt
+#include <unordered_map> // std::unordered_map
+
+#include "MeshSimplifier.hpp"
+
+// Sum of squared distances to a set of planes, weighted by the area of the
+// triangles they came from. Symmetric, so only the upper triangle is kept.
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    // plane dot(normal, p) + d = 0 with a unit normal
+    void addPlane(const glm::dvec3& normal, double d, double planeWeight) {
+        a00 += planeWeight * normal.x * normal.x;
+        a01 += planeWeight * normal.x * normal.y;
+        a02 += planeWeight * normal.x * normal.z;
+        a03 += planeWeight * normal.x * d;
+        a11 += planeWeight * normal.y * normal.y;
+        a12 += planeWeight * normal.y * normal.z;
+        a13 += planeWeight * normal.y * d;
+        a22 += planeWeight * normal.z * normal.z;
+        a23 += planeWeight * normal.z * d;
+        a33 += planeWeight * d * d;
+        weight += planeWeight;
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a03 += other.a03;
+        a11 += other.a11;
+        a12 += other.a12;
+        a13 += other.a13;
+        a22 += other.a22;
+        a23 += other.a23;
+        a33 += other.a33;
+        weight += other.weight;
+        return *this;
+    }
+
+    // root of the weighted mean squared distance of `p` to the planes
+    double distance(const glm::dvec3& p) const {
+        if (weight <= 0.0) {
+            return 0.0;
+        }
+
+        double sum = a00 * p.x * p.x + 2 * a01 * p.x * p.y +
+                     2 * a02 * p.x * p.z + 2 * a03 * p.x + a11 * p.y * p.y +
+                     2 * a12 * p.y * p.z + 2 * a13 * p.y + a22 * p.z * p.z +
+                     2 * a23 * p.z + a33;
+        return std::sqrt(std::max(0.0, sum) / weight);
+    }
+};
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+// whether moving `from` onto `to` turns any remaining triangle of `from`
+// around
+static bool flipsTriangle(const std::vector<glm::dvec3>& positions,
+                          const std::vector<uint32_t>& indices,
+                          const uint32_t* triangles, size_t triangleCount,
+                          uint32_t from, uint32_t to) {
+    for (size_t i = 0; i < triangleCount; i++) {
+        const uint32_t* triangle = &indices[triangles[i] * 3];
+
+        // collapses into an edge and is dropped
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+            continue;
+        }
+
+        glm::dvec3 before[3];
+        glm::dvec3 after[3];
+        for (int corner = 0; corner < 3; corner++) {
+            before[corner] = positions[triangle[corner]];
+            after[corner] = triangle[corner] == from ? positions[to]
+                                                     : before[corner];
+        }
+
+        glm::dvec3 normalBefore =
+            glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::dvec3 normalAfter =
+            glm::cross(after[1] - after[0], after[2] - after[0]);
+
+        if (glm::dot(normalBefore, normalAfter) <= 0.0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+SimplifiedMesh simplifyMesh(const std::vector<Vertex>& vertices,
+                            const std::vector<uint32_t>& indices,
+                            size_t targetIndexCount) {
+    SimplifiedMesh result;
+    result.indices = indices;
+
+    std::vector<uint32_t>& current = result.indices;
+    const size_t vertexCount = vertices.size();
+    targetIndexCount = targetIndexCount / 3 * 3;
+
+    if (current.size() <= targetIndexCount) {
+        return result;
+    }
+
+    std::vector<glm::dvec3> positions(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        positions[v] = glm::dvec3(vertices[v].pos);
+    }
+
+    // the same position with different texture coordinates, a seam
+    std::unordered_map<glm::vec3, uint32_t> positionCounts;
+    for (const Vertex& vertex : vertices) {
+        positionCounts[vertex.pos]++;
+    }
+    std::vector<bool> locked(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        locked[v] = positionCounts[vertices[v].pos] > 1;
+    }
+
+    // planes of the original triangles, merged as vertices collapse
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i + 2 < current.size(); i += 3) {
+        const glm::dvec3& p0 = positions[current[i + 0]];
+        glm::dvec3 normal = glm::cross(positions[current[i + 1]] - p0,
+                                       positions[current[i + 2]] - p0);
+        double length = glm::length(normal);
+        if (length == 0.0) {
+            continue;
+        }
+        normal /= length;
+
+        double d = -glm::dot(normal, p0);
+        for (int corner = 0; corner < 3; corner++) {
+            quadrics[current[i + corner]].addPlane(normal, d, length * 0.5);
+        }
+    }
+
+    std::vector<uint32_t> remap(vertexCount);
+    double maxError = 0.0;
+
+    // Every pass collapses independent edges from cheapest to most
+    // expensive, then rebuilds the triangles. A vertex is only touched once
+    // per pass, so the adjacency stays valid within it.
+    while (current.size() > targetIndexCount) {
+        const size_t triangleCount = current.size() / 3;
+
+        // triangles around every vertex
+        std::vector<uint32_t> triangleStart(vertexCount + 1, 0);
+        for (uint32_t index : current) {
+            triangleStart[index + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            triangleStart[v + 1] += triangleStart[v];
+        }
+        std::vector<uint32_t> vertexTriangles(current.size());
+        std::vector<uint32_t> fill(triangleStart.begin(),
+                                   triangleStart.end() - 1);
+        for (size_t i = 0; i < current.size(); i++) {
+            vertexTriangles[fill[current[i]]++] =
+                static_cast<uint32_t>(i / 3);
+        }
+
+        // every triangle side, lower vertex in the high bits
+        std::vector<uint64_t> edgeKeys;
+        edgeKeys.reserve(current.size());
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t a = current[t * 3 + corner];
+                uint32_t b = current[t * 3 + (corner + 1) % 3];
+                edgeKeys.push_back(
+                    static_cast<uint64_t>(std::min(a, b)) << 32 |
+                    std::max(a, b));
+            }
+        }
+        std::sort(edgeKeys.begin(), edgeKeys.end());
+
+        // an edge of only one triangle is open, its vertices are on the
+        // border
+        std::vector<bool> border(vertexCount, false);
+        for (size_t i = 0; i < edgeKeys.size();) {
+            size_t next = i + 1;
+            while (next < edgeKeys.size() && edgeKeys[next] == edgeKeys[i]) {
+                next++;
+            }
+            if (next - i == 1) {
+                border[edgeKeys[i] >> 32] = true;
+                border[edgeKeys[i] & 0xffffffff] = true;
+            }
+            i = next;
+        }
+
+        std::vector<Collapse> collapses;
+        for (size_t i = 0; i < edgeKeys.size();) {
+            size_t next = i + 1;
+            while (next < edgeKeys.size() && edgeKeys[next] == edgeKeys[i]) {
+                next++;
+            }
+            bool borderEdge = next - i == 1;
+            uint32_t a = static_cast<uint32_t>(edgeKeys[i] >> 32);
+            uint32_t b = static_cast<uint32_t>(edgeKeys[i] & 0xffffffff);
+            i = next;
+
+            // border vertices only move along the border
+            auto allowed = [&](uint32_t from) {
+                return !locked[from] && (!border[from] || borderEdge);
+            };
+
+            Quadric merged = quadrics[a];
+            merged += quadrics[b];
+
+            Collapse best{0, 0, -1.0};
+            if (allowed(a)) {
+                best = {a, b, merged.distance(positions[b])};
+            }
+            if (allowed(b)) {
+                double cost = merged.distance(positions[a]);
+                if (best.cost < 0.0 || cost < best.cost) {
+                    best = {b, a, cost};
+                }
+            }
+            if (best.cost >= 0.0) {
+                collapses.push_back(best);
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& a, const Collapse& b) {
+                      return a.cost < b.cost;
+                  });
+
+        for (size_t v = 0; v < vertexCount; v++) {
+            remap[v] = static_cast<uint32_t>(v);
+        }
+        std::vector<bool> touched(vertexCount, false);
+
+        size_t trianglesToRemove = (current.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+
+        for (const Collapse& collapse : collapses) {
+            if (removed >= trianglesToRemove) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            const uint32_t* triangles =
+                &vertexTriangles[triangleStart[collapse.from]];
+            size_t count = triangleStart[collapse.from + 1] -
+                           triangleStart[collapse.from];
+
+            if (flipsTriangle(positions, current, triangles, count,
+                              collapse.from, collapse.to)) {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            maxError = std::max(maxError, collapse.cost);
+
+            // the neighbours' triangles change, they wait for the next pass
+            for (size_t i = 0; i < count; i++) {
+                const uint32_t* triangle = &current[triangles[i] * 3];
+                bool shared = false;
+                for (int corner = 0; corner < 3; corner++) {
+                    touched[triangle[corner]] = true;
+                    shared = shared || triangle[corner] == collapse.to;
+                }
+                removed += shared ? 1 : 0;
+            }
+        }
+
+        if (removed == 0) {
+            break;
+        }
+
+        size_t written = 0;
+        for (size_t i = 0; i + 2 < current.size(); i += 3) {
+            uint32_t a = remap[current[i + 0]];
+            uint32_t b = remap[current[i + 1]];
+            uint32_t c = remap[current[i + 2]];
+
+            if (a != b && b != c && a != c) {
+                current[written++] = a;
+                current[written++] = b;
+                current[written++] = c;
+            }
+        }
+        current.resize(written);
+    }
+
+    result.error = static_cast<float>(maxError);
+    return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint> // uint32_t
+#include <vector>  // std::vector
+
+#include "Vertex.hpp"
+
+struct SimplifiedMesh {
+    // into the same vertices as the input
+    std::vector<uint32_t> indices;
+    // Largest distance from a removed vertex to the planes of the triangles
+    // it was part of, in model space. Scaled to screen space this decides
+    // when the mesh can stand in for the original.
+    float error = 0.0f;
+};
+
+// Reduces a triangle list to about `targetIndexCount` indices with quadric
+// error metric edge collapses (Garland and Heckbert 1997). Every collapse
+// moves a vertex onto one of its neighbours, so the result indexes the
+// input vertices and only needs an index buffer of its own.
+//
+// Vertices on an open edge only slide along it, which keeps the outline.
+// Vertices sharing their position with another one (texture seams) are
+// never removed, otherwise the seam would open up. Stops early if no
+// further collapse is possible.
+SimplifiedMesh simplifyMesh(const std::vector<Vertex>& vertices,
+                            const std::vector<uint32_t>& indices,
+                            size_t targetIndexCount);
@@ -0,0 +1,250 @@
+#include <algorithm> // std::min, std::max
+#include <cmath>     // std::sqrt
+#include <limits>    // std::numeric_limits
+
+#include "MeshletBuilder.hpp"
+
+// not part of the meshlet being built
+static const uint8_t NO_LOCAL_INDEX = 0xFF;
+static const uint32_t NO_TRIANGLE = 0xFFFFFFFF;
+
+// Bounding sphere and normal cone of a finished meshlet
+static void computeBounds(const std::vector<Vertex>& vertices,
+                          const MeshletMesh& mesh, Meshlet& meshlet) {
+    // center of the bounding box and the farthest vertex from it, like the
+    // bounds of whole meshes
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(-std::numeric_limits<float>::max());
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        const glm::vec3& position =
+            vertices[mesh.vertices[meshlet.firstVertex + i]].pos;
+        low = glm::min(low, position);
+        high = glm::max(high, position);
+    }
+    glm::vec3 center = (low + high) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        const glm::vec3& position =
+            vertices[mesh.vertices[meshlet.firstVertex + i]].pos;
+        radius = std::max(radius, glm::length(position - center));
+    }
+    meshlet.sphere = glm::vec4(center, radius);
+
+    // Counter-clockwise triangles face their normal, see `Shader`. Without
+    // any area a triangle never covers a pixel, so it has no say.
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.triangleCount);
+    glm::vec3 axis(0.0f);
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+        const uint32_t* triangle = &mesh.indices[meshlet.firstIndex + t * 3];
+        const glm::vec3& a = vertices[triangle[0]].pos;
+        const glm::vec3& b = vertices[triangle[1]].pos;
+        const glm::vec3& c = vertices[triangle[2]].pos;
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f) {
+            continue;
+        }
+        normal /= length;
+
+        normals.push_back(normal);
+        axis += normal;
+    }
+
+    meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    float axisLength = glm::length(axis);
+    if (normals.empty() || axisLength <= 1e-6f) {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const glm::vec3& normal : normals) {
+        minDot = std::min(minDot, glm::dot(axis, normal));
+    }
+
+    // past 90 degrees some triangle faces the camera from any side
+    if (minDot <= 0.0f) {
+        return;
+    }
+
+    // the cosine of the half angle, turned into its sine for the test
+    meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+}
+
+MeshletMesh buildMeshlets(const std::vector<Vertex>& vertices,
+                          const std::vector<uint32_t>& indices,
+                          uint32_t maxVertices, uint32_t maxTriangles) {
+    MeshletMesh mesh;
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return mesh;
+    }
+
+    // the local indices have to fit into 8 bits next to `NO_LOCAL_INDEX`
+    maxVertices = std::min<uint32_t>(std::max(maxVertices, 3u), 255);
+    maxTriangles = std::max(maxTriangles, 1u);
+
+    // The triangles of every vertex, those of vertex v are
+    // adjacency[adjacencyOffsets[v], adjacencyOffsets[v + 1])
+    std::vector<uint32_t> adjacencyOffsets(vertices.size() + 1, 0);
+    for (uint32_t index : indices) {
+        adjacencyOffsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertices.size(); v++) {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+                               adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<glm::vec3> centroids(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        centroids[t] = (vertices[indices[t * 3]].pos +
+                        vertices[indices[t * 3 + 1]].pos +
+                        vertices[indices[t * 3 + 2]].pos) /
+                       3.0f;
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    size_t remaining = triangleCount;
+    // no triangle before it is left to seed a meshlet
+    size_t nextSeed = 0;
+
+    // the meshlet being built, its vertices in the order of their local
+    // indices
+    std::vector<uint8_t> localIndex(vertices.size(), NO_LOCAL_INDEX);
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+    glm::vec3 centroidSum(0.0f);
+
+    auto countNewVertices = [&](uint32_t t) {
+        uint32_t count = 0;
+        for (size_t k = 0; k < 3; k++) {
+            if (localIndex[indices[t * 3 + k]] == NO_LOCAL_INDEX) {
+                count++;
+            }
+        }
+        return count;
+    };
+
+    auto addTriangle = [&](uint32_t t) {
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t vertex = indices[t * 3 + k];
+            if (localIndex[vertex] == NO_LOCAL_INDEX) {
+                localIndex[vertex] =
+                    static_cast<uint8_t>(meshletVertices.size());
+                meshletVertices.push_back(vertex);
+            }
+        }
+        meshletTriangles.push_back(t);
+        centroidSum += centroids[t];
+        emitted[t] = true;
+        remaining--;
+    };
+
+    auto finishMeshlet = [&]() {
+        if (meshletTriangles.empty()) {
+            return;
+        }
+
+        Meshlet meshlet{};
+        meshlet.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+        meshlet.triangleCount = static_cast<uint32_t>(meshletTriangles.size());
+        meshlet.firstVertex = static_cast<uint32_t>(mesh.vertices.size());
+        meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+        meshlet.firstTriangle = static_cast<uint32_t>(mesh.triangles.size());
+
+        for (uint32_t t : meshletTriangles) {
+            uint32_t packed = 0;
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t vertex = indices[t * 3 + k];
+                mesh.indices.push_back(vertex);
+                packed |= static_cast<uint32_t>(localIndex[vertex]) << (8 * k);
+            }
+            mesh.triangles.push_back(packed);
+        }
+        mesh.vertices.insert(mesh.vertices.end(), meshletVertices.begin(),
+                             meshletVertices.end());
+
+        computeBounds(vertices, mesh, meshlet);
+        mesh.meshlets.push_back(meshlet);
+
+        for (uint32_t vertex : meshletVertices) {
+            localIndex[vertex] = NO_LOCAL_INDEX;
+        }
+        meshletVertices.clear();
+        meshletTriangles.clear();
+        centroidSum = glm::vec3(0.0f);
+    };
+
+    while (remaining > 0) {
+        glm::vec3 centroid =
+            meshletTriangles.empty()
+                ? glm::vec3(0.0f)
+                : centroidSum / static_cast<float>(meshletTriangles.size());
+
+        // the neighbour adding the fewest vertices, then the closest one
+        uint32_t best = NO_TRIANGLE;
+        uint32_t bestNewVertices = 4;
+        float bestDistance = std::numeric_limits<float>::max();
+        for (uint32_t vertex : meshletVertices) {
+            for (uint32_t a = adjacencyOffsets[vertex];
+                 a < adjacencyOffsets[vertex + 1]; a++) {
+                uint32_t t = adjacency[a];
+                if (emitted[t]) {
+                    continue;
+                }
+
+                uint32_t newVertices = countNewVertices(t);
+                if (meshletVertices.size() + newVertices > maxVertices) {
+                    continue;
+                }
+
+                glm::vec3 offset = centroids[t] - centroid;
+                float distance = glm::dot(offset, offset);
+                if (newVertices < bestNewVertices ||
+                    (newVertices == bestNewVertices &&
+                     distance < bestDistance)) {
+                    best = t;
+                    bestNewVertices = newVertices;
+                    bestDistance = distance;
+                }
+            }
+        }
+
+        if (best == NO_TRIANGLE) {
+            // A disconnected part or a full meshlet. Small parts keep
+            // filling the meshlet rather than leaving many tiny ones.
+            bool halfFull = meshletTriangles.size() >= maxTriangles / 2;
+            if (!meshletTriangles.empty() &&
+                (halfFull || meshletVertices.size() + 3 > maxVertices)) {
+                finishMeshlet();
+                continue;
+            }
+
+            while (emitted[nextSeed]) {
+                nextSeed++;
+            }
+            best = static_cast<uint32_t>(nextSeed);
+        }
+
+        addTriangle(best);
+
+        if (meshletTriangles.size() >= maxTriangles) {
+            finishMeshlet();
+        }
+    }
+
+    finishMeshlet();
+
+    return mesh;
+}
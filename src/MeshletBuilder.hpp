@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint> // uint32_t
+#include <vector>  // std::vector
+
+#include "Vertex.hpp"
+
+// Cluster sizes that suit both paths of `ClusterCuller`, the triangle
+// limit keeps the packed triangles of a mesh shader workgroup in 4 KB
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// One cluster of a mesh, 64 bytes like its std430 counterpart in
+// cluster_cull.glsl. The offsets are relative to the `MeshletMesh` it was
+// built into until the caller moves them into shared buffers.
+struct Meshlet {
+    // model space center and radius around every vertex
+    glm::vec4 sphere;
+    // Axis of the cone around the triangle normals and the sine of its
+    // half angle, 1 if the normals spread too far to ever be back facing
+    glm::vec4 cone;
+    // the triangles as indices into the mesh's vertices
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    // the vertices of `MeshletMesh::vertices` the triangles use
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    // `MeshletMesh::triangles`, one per triangle
+    uint32_t firstTriangle;
+    uint32_t padding[3];
+};
+static_assert(sizeof(Meshlet) == 64, "std430 stride of Meshlet");
+
+struct MeshletMesh {
+    std::vector<Meshlet> meshlets;
+    // The triangles of the input, one meshlet after the other, so every
+    // meshlet is a range of an index buffer
+    std::vector<uint32_t> indices;
+    // the input vertices of every meshlet, for mesh shaders
+    std::vector<uint32_t> vertices;
+    // three 8 bit indices into the meshlet's vertices per triangle
+    std::vector<uint32_t> triangles;
+};
+
+// Splits a triangle list into meshlets of at most `maxVertices` vertices and
+// `maxTriangles` triangles. Each meshlet grows greedily from a seed triangle
+// by the neighbour that adds the fewest new vertices, ties going to the one
+// closest to the meshlet, which keeps the bounds tight. A meshlet without
+// neighbours left is closed once it is half full, otherwise the next
+// triangle in input order continues it.
+MeshletMesh buildMeshlets(const std::vector<Vertex>& vertices,
+                          const std::vector<uint32_t>& indices,
+                          uint32_t maxVertices = MESHLET_MAX_VERTICES,
+                          uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
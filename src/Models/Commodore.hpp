@@ -24,6 +24,7 @@ class Commodore : public Model {
               rp3d::PhysicsWorld* world = nullptr,
               rp3d::PhysicsCommon* physicsCommon = nullptr);
 
+    ColliderType getColliderType() { return ColliderType::ConvexHull; }
     int getModelCount() { return totalNbCommodores; }
     int getTextureId() {
         // std::cout << "bridge getTextureId: " << textureId << std::endl;
@@ -24,6 +24,7 @@ class Hatchet : public Model {
             rp3d::PhysicsWorld* world = nullptr,
             rp3d::PhysicsCommon* physicsCommon = nullptr);
 
+    ColliderType getColliderType() { return ColliderType::ConvexHull; }
     int getModelCount() { return totalNbHatchets; }
     int getTextureId() {
         // std::cout << "bridge getTextureId: " << textureId << std::endl;
@@ -24,6 +24,9 @@ class House : public Model {
           rp3d::PhysicsWorld* world = nullptr,
           rp3d::PhysicsCommon* physicsCommon = nullptr);
 
+    ColliderType getColliderType() {
+        return ColliderType::ConvexDecomposition;
+    }
     int getModelCount() { return totalNbHouses; }
     int getTextureId() {
         // std::cout << "bridge getTextureId: " << textureId << std::endl;
@@ -57,11 +57,8 @@ Model::Model(int modelId, glm::vec3 scale, bool matrixOffset,
         // [TODO] Set the mass
         // physicsBody->setMass(rp3d::decimal(0.01));
 
-        rp3d::Vector3 halfExtents(scale.x, scale.y, scale.z);
-        rp3d::BoxShape* boxShape = physicsCommon->createBoxShape(halfExtents);
-        rp3d::Collider* boxCollider =
-            physicsBody->addCollider(boxShape, rp3d::Transform::identity());
-        physicsBody->updateMassPropertiesFromColliders();
+        // The collider is attached by Render::addModel once the mesh of the
+        // model class has been loaded, see MeshCollider::attach
     }
 }
 
@@ -10,6 +10,7 @@
 
 #include <reactphysics3d/reactphysics3d.h>
 
+#include "../MeshCollider.hpp"
 #include "../Vertex.hpp"
 
 class Model {
@@ -50,6 +51,7 @@ class Model {
     void updateAngularVelocity(glm::vec3 angularVelocity);
 
     int getModelId() { return modelId; }
+    glm::vec3 getScale() { return scale; }
 
     void setScale(glm::vec3 scale) {
         this->scale = scale;
@@ -73,6 +75,11 @@ class Model {
   // Set a custom texture path for this model instance
   void setTexturePath(const std::string& path) { overrideTexturePath = path; }
 
+    // Collider generated from the mesh for instances of this class, see
+    // MeshCollider. Static bodies always get the exact triangle mesh unless
+    // the class asks for a plain box.
+    virtual ColliderType getColliderType() { return ColliderType::Box; }
+
     virtual int getModelCount() { return 0; }
     virtual int getTextureId() { return -1; }
     virtual void setTextureId(int id) {}
@@ -85,4 +92,23 @@ class Model {
 
     virtual int getIndicesCount() { return -1; }
     virtual void setIndicesCount(int count) {}
+
+    // Level of detail picked by `Render::selectLods` and the part of the
+    // shared index buffer it draws, the class's full mesh until then
+    uint32_t lodLevel = 0;
+    int lodIndexOffset = -1;
+    int lodIndicesCount = -1;
+
+    // Passed the last occlusion test it was part of, objects that did are
+    // drawn by the first phase of `OcclusionCuller`
+    bool occlusionVisible = true;
+    // its leaf in `Render`'s scene BVH, -1 if not in it
+    int bvhProxy = -1;
+
+    int getDrawIndexOffset() {
+        return lodIndexOffset >= 0 ? lodIndexOffset : getIndexOffset();
+    }
+    int getDrawIndicesCount() {
+        return lodIndicesCount >= 0 ? lodIndicesCount : getIndicesCount();
+    }
 };
@@ -24,6 +24,7 @@ class Skull : public Model {
           rp3d::PhysicsWorld* world = nullptr,
           rp3d::PhysicsCommon* physicsCommon = nullptr);
 
+    ColliderType getColliderType() { return ColliderType::ConvexHull; }
     int getModelCount() { return totalNbSkulls; }
     int getTextureId() { return textureId; }
     void setTextureId(int id) { textureId = id; }
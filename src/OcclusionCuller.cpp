@@ -0,0 +1,625 @@
+#include <algorithm> // std::max, std::min
+#include <cmath>     // std::abs
+#include <cstring>   // memcpy
+#include <iostream>  // std::cout, std::cerr
+#include <stdexcept> // std::runtime_error
+
+#include "OcclusionCuller.hpp"
+
+static_assert(sizeof(OcclusionCuller::Object) == 32,
+              "std430 stride of occlusion_cull.comp's Object");
+
+// local sizes of the compute shaders
+static const uint32_t PYRAMID_GROUP_SIZE = 8;
+static const uint32_t CULL_GROUP_SIZE = 64;
+
+void OcclusionCuller::create(VulkanSetup* vulkanSetup,
+                             VkPipelineCache pipelineCache) {
+    this->vulkanSetup = vulkanSetup;
+    this->pipelineCache = pipelineCache;
+    device = vulkanSetup->device;
+
+    supported = vulkanSetup->depthSampled &&
+                vulkanSetup->drawIndirectFirstInstanceSupported;
+    if (!supported) {
+        std::cout << "OcclusionCuller::create(), the depth attachment cannot "
+                     "be sampled or indirect draws need a first instance of "
+                     "0, occlusion culling is unavailable"
+                  << std::endl;
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vulkanSetup->physicalDevice, &properties);
+    maxDrawIndirectCount = properties.limits.maxDrawIndirectCount;
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid sampler!");
+    }
+
+    // the level below and the level being written
+    std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings{};
+    pyramidBindings[0].binding = 0;
+    pyramidBindings[0].descriptorType =
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pyramidBindings[1].binding = 1;
+    pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    // the pyramid, objects, commands and visibility
+    std::array<VkDescriptorSetLayoutBinding, 4> cullBindings{};
+    cullBindings[0].binding = 0;
+    cullBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    for (uint32_t binding = 1; binding < cullBindings.size(); binding++) {
+        cullBindings[binding].binding = binding;
+        cullBindings[binding].descriptorType =
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+
+    for (VkDescriptorSetLayoutBinding& binding : pyramidBindings) {
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    for (VkDescriptorSetLayoutBinding& binding : cullBindings) {
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+    layoutInfo.pBindings = pyramidBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
+                                    &pyramidSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to create depth pyramid descriptor set layout!");
+    }
+
+    layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+    layoutInfo.pBindings = cullBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
+                                    &cullSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to create occlusion culling descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PyramidConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &pyramidSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+                               &pyramidLayout) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to create depth pyramid pipeline layout!");
+    }
+
+    pushConstantRange.size = sizeof(CullConstants);
+    pipelineLayoutInfo.pSetLayouts = &cullSetLayout;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+                               &cullLayout) != VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to create occlusion culling pipeline layout!");
+    }
+
+    // one set per pyramid level and per frame in flight
+    descriptorAllocator.create(
+        device, 16,
+        {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f},
+         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f},
+         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3.0f}});
+
+    try {
+        pyramidPipeline = createComputePipeline("shaders/depth_pyramid.spv",
+                                                pyramidLayout);
+        cullPipeline = createComputePipeline("shaders/occlusion_cull.spv",
+                                             cullLayout);
+    } catch (const std::exception& exception) {
+        // like a missing shader variant, only this feature is lost
+        std::cerr << "OcclusionCuller::create(), occlusion culling is "
+                     "unavailable: "
+                  << exception.what() << std::endl;
+        supported = false;
+        return;
+    }
+
+    createPyramid();
+    writeSets();
+}
+
+void OcclusionCuller::destroy() {
+    destroyFrameBuffers();
+    destroyPyramid();
+    descriptorAllocator.destroy();
+
+    vkDestroyPipeline(device, pyramidPipeline, nullptr);
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, pyramidLayout, nullptr);
+    vkDestroyPipelineLayout(device, cullLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, pyramidSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+    vkDestroySampler(device, sampler, nullptr);
+
+    pyramidPipeline = VK_NULL_HANDLE;
+    cullPipeline = VK_NULL_HANDLE;
+    pyramidLayout = VK_NULL_HANDLE;
+    cullLayout = VK_NULL_HANDLE;
+    pyramidSetLayout = VK_NULL_HANDLE;
+    cullSetLayout = VK_NULL_HANDLE;
+    sampler = VK_NULL_HANDLE;
+    supported = false;
+}
+
+VkShaderModule OcclusionCuller::loadShaderModule(const std::string& filename) {
+    std::vector<char> code = Shader::readFile(filename);
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create shader module!");
+    }
+
+    return shaderModule;
+}
+
+VkPipeline OcclusionCuller::createComputePipeline(const std::string& filename,
+                                                  VkPipelineLayout layout) {
+    VkShaderModule shaderModule = loadShaderModule(filename);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = layout;
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(
+        device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+
+    // the pipeline keeps what it needs
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    return pipeline;
+}
+
+void OcclusionCuller::createPyramid() {
+    VkExtent2D extent = vulkanSetup->swapChainExtent;
+
+    // level 0 already halves the depth attachment, rounded up so the last
+    // texel covers the odd row and column
+    VkExtent2D size;
+    size.width = std::max(1u, (extent.width + 1) / 2);
+    size.height = std::max(1u, (extent.height + 1) / 2);
+
+    levelSizes.clear();
+    levelSizes.push_back(size);
+    while (size.width > 1 || size.height > 1) {
+        size.width = std::max(1u, (size.width + 1) / 2);
+        size.height = std::max(1u, (size.height + 1) / 2);
+        levelSizes.push_back(size);
+    }
+    uint32_t levelCount = static_cast<uint32_t>(levelSizes.size());
+
+    vulkanSetup->createImage(
+        levelSizes[0].width, levelSizes[0].height, VK_FORMAT_R32_SFLOAT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramid, pyramidMemory,
+        levelCount);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = pyramid;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = levelCount;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device, &viewInfo, nullptr, &pyramidView) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid view!");
+    }
+
+    levelViews.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+
+        if (vkCreateImageView(device, &viewInfo, nullptr,
+                              &levelViews[level]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth pyramid view!");
+        }
+    }
+
+    swapChainGeneration = vulkanSetup->swapChainGeneration;
+
+    std::cout << "OcclusionCuller::createPyramid(), " << levelSizes[0].width
+              << "x" << levelSizes[0].height << ", " << levelCount
+              << " levels" << std::endl;
+}
+
+void OcclusionCuller::destroyPyramid() {
+    for (VkImageView view : levelViews) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    levelViews.clear();
+
+    if (pyramid != VK_NULL_HANDLE) {
+        vkDestroyImageView(device, pyramidView, nullptr);
+        vkDestroyImage(device, pyramid, nullptr);
+        vkFreeMemory(device, pyramidMemory, nullptr);
+    }
+
+    pyramidView = VK_NULL_HANDLE;
+    pyramid = VK_NULL_HANDLE;
+    pyramidMemory = VK_NULL_HANDLE;
+}
+
+void OcclusionCuller::createFrameBuffers() {
+    const VkMemoryPropertyFlags hostFlags =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    for (FrameBuffers& frame : frames) {
+        vulkanSetup->createBuffer(capacity * sizeof(Object),
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  hostFlags, frame.objects,
+                                  frame.objectsMemory);
+        vulkanSetup->createBuffer(
+            capacity * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands,
+            frame.commandsMemory);
+        // a few bytes per object, read once per frame
+        vulkanSetup->createBuffer(capacity * sizeof(uint32_t),
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  hostFlags, frame.visibility,
+                                  frame.visibilityMemory);
+
+        void* data;
+        vkMapMemory(device, frame.objectsMemory, 0, VK_WHOLE_SIZE, 0, &data);
+        frame.mappedObjects = static_cast<Object*>(data);
+        vkMapMemory(device, frame.visibilityMemory, 0, VK_WHOLE_SIZE, 0,
+                    &data);
+        frame.mappedVisibility = static_cast<uint32_t*>(data);
+
+        frame.objectCount = 0;
+        frame.lateCount = 0;
+    }
+}
+
+void OcclusionCuller::destroyFrameBuffers() {
+    for (FrameBuffers& frame : frames) {
+        if (frame.objects == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        vkUnmapMemory(device, frame.objectsMemory);
+        vkUnmapMemory(device, frame.visibilityMemory);
+
+        vkDestroyBuffer(device, frame.objects, nullptr);
+        vkFreeMemory(device, frame.objectsMemory, nullptr);
+        vkDestroyBuffer(device, frame.commands, nullptr);
+        vkFreeMemory(device, frame.commandsMemory, nullptr);
+        vkDestroyBuffer(device, frame.visibility, nullptr);
+        vkFreeMemory(device, frame.visibilityMemory, nullptr);
+
+        frame = FrameBuffers();
+    }
+}
+
+void OcclusionCuller::writeSets() {
+    // nothing allocated from it is pending, see the callers
+    descriptorAllocator.reset();
+
+    levelSets.resize(levelViews.size());
+    for (size_t level = 0; level < levelViews.size(); level++) {
+        DescriptorBinding source;
+        source.binding = 0;
+        source.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        source.sampler = sampler;
+        if (level == 0) {
+            source.imageView = vulkanSetup->depthImageView;
+            source.imageLayout =
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        } else {
+            source.imageView = levelViews[level - 1];
+            source.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        DescriptorBinding destination;
+        destination.binding = 1;
+        destination.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        destination.imageView = levelViews[level];
+        destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        levelSets[level] = descriptorAllocator.allocate(pyramidSetLayout);
+        descriptorAllocator.write(levelSets[level], {source, destination});
+    }
+
+    // the buffers do not exist before the first `reserve`
+    if (capacity == 0) {
+        return;
+    }
+
+    for (FrameBuffers& frame : frames) {
+        DescriptorBinding pyramidBinding;
+        pyramidBinding.binding = 0;
+        pyramidBinding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pyramidBinding.imageView = pyramidView;
+        pyramidBinding.sampler = sampler;
+        pyramidBinding.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::vector<DescriptorBinding> bindings = {pyramidBinding};
+
+        VkBuffer buffers[] = {frame.objects, frame.commands, frame.visibility};
+        for (uint32_t i = 0; i < 3; i++) {
+            DescriptorBinding binding;
+            binding.binding = i + 1;
+            binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            binding.buffer = buffers[i];
+            binding.offset = 0;
+            binding.range = VK_WHOLE_SIZE;
+            bindings.push_back(binding);
+        }
+
+        frame.set = descriptorAllocator.allocate(cullSetLayout);
+        descriptorAllocator.write(frame.set, bindings);
+    }
+}
+
+void OcclusionCuller::reserve(size_t objectCount) {
+    if (objectCount <= capacity) {
+        return;
+    }
+
+    // the other frames may still read the buffers
+    vkDeviceWaitIdle(device);
+    destroyFrameBuffers();
+
+    capacity = std::max(objectCount, std::max<size_t>(capacity * 2, 1024));
+    createFrameBuffers();
+    writeSets();
+
+    std::cout << "OcclusionCuller::reserve(), " << capacity << " objects"
+              << std::endl;
+}
+
+void OcclusionCuller::cull(VkCommandBuffer commandBuffer, uint32_t frame,
+                           const std::vector<Object>& objects,
+                           uint32_t lateCount, const glm::mat4& view,
+                           const glm::mat4& projection) {
+    if (swapChainGeneration != vulkanSetup->swapChainGeneration) {
+        // the depth attachment was replaced, and maybe resized
+        vkDeviceWaitIdle(device);
+        destroyPyramid();
+        createPyramid();
+        writeSets();
+    }
+
+    reserve(objects.size());
+
+    FrameBuffers& buffers = frames[frame];
+    if (!objects.empty()) {
+        memcpy(buffers.mappedObjects, objects.data(),
+               objects.size() * sizeof(Object));
+    }
+    buffers.objectCount = static_cast<uint32_t>(objects.size());
+    buffers.lateCount = lateCount;
+
+    VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    VkFormat depthFormat = vulkanSetup->findDepthFormat();
+    if (depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+        depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+        depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    // The first phase's depth becomes readable, and the pyramid is written
+    // from scratch once the previous frame's test is done reading it
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].image = vulkanSetup->depthImage;
+    barriers[0].subresourceRange = {depthAspect, 0, 1, 0, 1};
+
+    barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].image = pyramid;
+    barriers[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                    VK_REMAINING_MIP_LEVELS, 0, 1};
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, static_cast<uint32_t>(barriers.size()),
+                         barriers.data());
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pyramidPipeline);
+
+    VkExtent2D depthExtent = vulkanSetup->swapChainExtent;
+
+    for (size_t level = 0; level < levelSizes.size(); level++) {
+        VkExtent2D source = level == 0 ? depthExtent : levelSizes[level - 1];
+        VkExtent2D destination = levelSizes[level];
+
+        PyramidConstants constants;
+        constants.sourceSize[0] = static_cast<int32_t>(source.width);
+        constants.sourceSize[1] = static_cast<int32_t>(source.height);
+        constants.destinationSize[0] = static_cast<int32_t>(destination.width);
+        constants.destinationSize[1] =
+            static_cast<int32_t>(destination.height);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                pyramidLayout, 0, 1, &levelSets[level], 0,
+                                nullptr);
+        vkCmdPushConstants(commandBuffer, pyramidLayout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                           &constants);
+        vkCmdDispatch(
+            commandBuffer,
+            (destination.width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+            (destination.height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+            1);
+
+        // the next level, or the test, reads this one
+        VkImageMemoryBarrier levelBarrier{};
+        levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        levelBarrier.image = pyramid;
+        levelBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT,
+                                         static_cast<uint32_t>(level), 1, 0,
+                                         1};
+
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &levelBarrier);
+    }
+
+    if (!objects.empty()) {
+        CullConstants constants;
+        constants.view = view;
+        // the y flip of `FPSCamera::setPerspective` is undone by the shader
+        constants.projection = glm::vec4(projection[0][0],
+                                         std::abs(projection[1][1]),
+                                         projection[2][2], projection[3][2]);
+        constants.depthSize = glm::vec2(depthExtent.width, depthExtent.height);
+        constants.objectCount = buffers.objectCount;
+        constants.lateCount = lateCount;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                cullLayout, 0, 1, &buffers.set, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullLayout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                           &constants);
+        vkCmdDispatch(commandBuffer,
+                      (buffers.objectCount + CULL_GROUP_SIZE - 1) /
+                          CULL_GROUP_SIZE,
+                      1, 1);
+    }
+
+    // The commands are read by the second phase's draws and the visibility
+    // by the CPU after the fence, and the depth attachment goes back for the
+    // second phase's render pass
+    std::array<VkBufferMemoryBarrier, 2> bufferBarriers{};
+    bufferBarriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    bufferBarriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    bufferBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarriers[0].buffer = buffers.commands;
+    bufferBarriers[0].offset = 0;
+    bufferBarriers[0].size = VK_WHOLE_SIZE;
+
+    bufferBarriers[1] = bufferBarriers[0];
+    bufferBarriers[1].dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarriers[1].buffer = buffers.visibility;
+
+    VkImageMemoryBarrier depthBarrier = barriers[0];
+    depthBarrier.srcAccessMask = 0;
+    depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_HOST_BIT |
+                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         0, 0, nullptr,
+                         static_cast<uint32_t>(bufferBarriers.size()),
+                         bufferBarriers.data(), 1, &depthBarrier);
+}
+
+void OcclusionCuller::drawLate(VkCommandBuffer commandBuffer, uint32_t frame) {
+    const FrameBuffers& buffers = frames[frame];
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    if (buffers.lateCount == 0) {
+        return;
+    }
+
+    if (vulkanSetup->multiDrawIndirectSupported) {
+        for (uint32_t first = 0; first < buffers.lateCount;
+             first += maxDrawIndirectCount) {
+            uint32_t count =
+                std::min(buffers.lateCount - first, maxDrawIndirectCount);
+            vkCmdDrawIndexedIndirect(commandBuffer, buffers.commands,
+                                     static_cast<VkDeviceSize>(first) * stride,
+                                     count, stride);
+        }
+        return;
+    }
+
+    // one command per call without multiDrawIndirect
+    for (uint32_t i = 0; i < buffers.lateCount; i++) {
+        vkCmdDrawIndexedIndirect(commandBuffer, buffers.commands,
+                                 static_cast<VkDeviceSize>(i) * stride, 1,
+                                 stride);
+    }
+}
+
+const uint32_t* OcclusionCuller::getVisibility(uint32_t frame,
+                                               size_t& count) const {
+    const FrameBuffers& buffers = frames[frame];
+
+    count = buffers.objectCount;
+    return count > 0 ? buffers.mappedVisibility : nullptr;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>  // std::array
+#include <string> // std::string
+#include <vector> // std::vector
+
+#include <vulkan/vulkan.h>
+
+#include "Shader.hpp"
+#include "VulkanSetup.hpp"
+
+// Two-phase hierarchical depth (Hi-Z) occlusion culling. The first phase
+// draws what was visible last time. Its depth is then reduced into a
+// pyramid of farthest depths, and the bounding sphere of every object is
+// tested against the pyramid level where it covers at most 2x2 texels. The
+// second phase draws the objects the first one left out that passed, with
+// indirect draws whose instance count the test writes, so nothing waits for
+// the GPU. Objects the first phase drew but the test hid are left out of
+// the next first phase.
+//
+// The results are read back once the frame's fence signalled, like
+// `GpuProfiler`'s queries, so "last time" is the previous use of the same
+// frame in flight. An object added in the meantime counts as visible.
+class OcclusionCuller {
+  public:
+    // One object of `cull`, 32 bytes like its std430 counterpart
+    struct Object {
+        // world space center and radius
+        glm::vec4 sphere;
+        // the draw of the second phase
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t firstInstance;
+    };
+
+    // Needs the depth attachment to be sampled and indirect draws with a
+    // first instance, see `isSupported`. Missing shaders only disable it.
+    // The pipelines are created through `pipelineCache`.
+    void create(VulkanSetup* vulkanSetup, VkPipelineCache pipelineCache);
+    void destroy();
+
+    bool isSupported() const { return supported; }
+
+    // Makes room for `objectCount` objects in every frame's buffers. If they
+    // have to be replaced the device is waited on, and the results of every
+    // frame are dropped.
+    void reserve(size_t objectCount);
+
+    // Records the depth pyramid build and the test of `objects`, outside of
+    // a render pass and after the first phase stored its depth, which is
+    // left ready for the second phase's render pass. `objects[0, lateCount)`
+    // were not drawn by the first phase, `drawLate` draws those that
+    // passed.
+    void cull(VkCommandBuffer commandBuffer, uint32_t frame,
+              const std::vector<Object>& objects, uint32_t lateCount,
+              const glm::mat4& view, const glm::mat4& projection);
+    // Records the second phase's draws of the last `cull` of `frame`, with
+    // the pipeline, the sets and the vertex and index buffers bound
+    void drawLate(VkCommandBuffer commandBuffer, uint32_t frame);
+
+    // One value per object of the last `cull` of `frame`, non-zero if it
+    // passed. Only valid once the frame's fence signalled, nullptr if there
+    // is nothing to read.
+    const uint32_t* getVisibility(uint32_t frame, size_t& count) const;
+
+  private:
+    // see the push constants of occlusion_cull.comp
+    struct CullConstants {
+        glm::mat4 view;
+        glm::vec4 projection;
+        glm::vec2 depthSize;
+        uint32_t objectCount;
+        uint32_t lateCount;
+    };
+
+    struct PyramidConstants {
+        int32_t sourceSize[2];
+        int32_t destinationSize[2];
+    };
+
+    // Written by the CPU, read back after the fence, the commands only
+    // live on the GPU
+    struct FrameBuffers {
+        VkBuffer objects = VK_NULL_HANDLE;
+        VkDeviceMemory objectsMemory = VK_NULL_HANDLE;
+        Object* mappedObjects = nullptr;
+
+        VkBuffer commands = VK_NULL_HANDLE;
+        VkDeviceMemory commandsMemory = VK_NULL_HANDLE;
+
+        VkBuffer visibility = VK_NULL_HANDLE;
+        VkDeviceMemory visibilityMemory = VK_NULL_HANDLE;
+        uint32_t* mappedVisibility = nullptr;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        // of the last `cull`
+        uint32_t objectCount = 0;
+        uint32_t lateCount = 0;
+    };
+
+    VulkanSetup* vulkanSetup = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    bool supported = false;
+
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout pyramidSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pyramidLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullLayout = VK_NULL_HANDLE;
+    VkPipeline pyramidPipeline = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    // every set is written again when the pyramid or the buffers change
+    DescriptorAllocator descriptorAllocator;
+
+    // R32 farthest depths, level 0 is half the depth attachment
+    VkImage pyramid = VK_NULL_HANDLE;
+    VkDeviceMemory pyramidMemory = VK_NULL_HANDLE;
+    // every level for the test, then one per level for its reduction
+    VkImageView pyramidView = VK_NULL_HANDLE;
+    std::vector<VkImageView> levelViews;
+    std::vector<VkExtent2D> levelSizes;
+    // reduction of level i reads level i - 1, the depth attachment for 0
+    std::vector<VkDescriptorSet> levelSets;
+    // the swap chain the pyramid matches
+    uint32_t swapChainGeneration = 0;
+
+    std::array<FrameBuffers, MAX_FRAMES_IN_FLIGHT> frames;
+    // objects that fit into every frame's buffers
+    size_t capacity = 0;
+    // commands per `vkCmdDrawIndexedIndirect` with multiDrawIndirect
+    uint32_t maxDrawIndirectCount = 1;
+
+    VkShaderModule loadShaderModule(const std::string& filename);
+    VkPipeline createComputePipeline(const std::string& filename,
+                                     VkPipelineLayout layout);
+    void createPyramid();
+    void destroyPyramid();
+    void createFrameBuffers();
+    void destroyFrameBuffers();
+    // after the pyramid or the buffers were replaced
+    void writeSets();
+};
@@ -0,0 +1,184 @@
+#include <cstdlib>   // exit
+#include <iostream>  // std::cout
+#include <stdexcept> // std::runtime_error
+
+#include "Options.hpp"
+
+static void printUsage(const char* program) {
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --bench-spawn       time scene construction for 10k/100k "
+                 "objects and exit\n"
+              << "  --bench-bvh         time the scene BVH against linear "
+                 "scans and exit\n"
+              << "  --record <file>     record camera and spawns for replay\n"
+              << "  --replay <file>     replay a recording deterministically "
+                 "and exit\n"
+              << "  --headless          render offscreen without a window, "
+                 "print frame timings and exit\n"
+              << "  --benchmark         run the benchmark scene suite "
+                 "headless and exit\n"
+              << "  --benchmark-filter <text>\n"
+              << "                      only run scenes containing <text>\n"
+              << "  --frames <n>        headless frames (per benchmark "
+                 "scene), 600\n"
+              << "  --results <file>    write headless frame timings as CSV, "
+                 "or the\n"
+              << "                      benchmark results as JSON\n"
+              << "  --screenshot <file> write the last headless frame as PNG\n"
+              << "  --trace <file>      write the CPU profiler zones as "
+                 "Chrome trace on exit\n"
+              << "  --recording-threads <n>\n"
+              << "                      threads recording draw calls, 0 "
+                 "records on the\n"
+              << "                      main thread, one per core by "
+                 "default\n"
+              << "  --no-static-cache   record the static objects every "
+                 "frame as well\n"
+              << "  --cpu-mvp           multiply the model-view-projections "
+                 "on the CPU\n"
+              << "  --no-lod            draw every object with its full mesh\n"
+              << "  --no-occlusion-culling\n"
+              << "                      draw objects hidden behind others "
+                 "as well\n"
+              << "  --depth-prepass     lay down depth before shading, for "
+                 "overdraw-heavy scenes\n"
+              << "  --no-cluster-culling\n"
+              << "                      draw every meshlet of big meshes, "
+                 "facing away or not\n"
+              << "  --no-mesh-shaders   cull meshlets with a compute shader "
+                 "and indirect draws\n"
+              << "  --frames-in-flight <n>\n"
+              << "                      frames the CPU may run ahead of the "
+                 "GPU, 1-4, 2\n"
+              << "  --low-latency       sample input after waiting for the "
+                 "GPU and sleep\n"
+              << "                      until the predicted present\n"
+              << "  --present-mode <mode>\n"
+              << "                      fifo, fifo_relaxed, mailbox or "
+                 "immediate, falls\n"
+              << "                      back to a supported mode, mailbox\n"
+              << "  --uncapped          use the fastest present mode, for "
+                 "windowed timing\n"
+              << "                      runs (headless is never capped)\n"
+              << "  --swapchain-images <n>\n"
+              << "                      swap chain images to ask for\n"
+              << "  --help              show this message" << std::endl;
+}
+
+// Returns the value following the option at `i` and skips over it
+static std::string optionValue(int argc, char** argv, int& i) {
+    if (i + 1 >= argc) {
+        throw std::runtime_error(std::string("missing value for ") + argv[i]);
+    }
+
+    return argv[++i];
+}
+
+launchOptions parseOptions(int argc, char** argv) {
+    launchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--bench-spawn") {
+            options.benchSpawn = true;
+        } else if (arg == "--bench-bvh") {
+            options.benchBvh = true;
+        } else if (arg == "--record") {
+            options.recordPath = optionValue(argc, argv, i);
+        } else if (arg == "--replay") {
+            options.replayPath = optionValue(argc, argv, i);
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--benchmark") {
+            options.benchmark = true;
+            options.headless = true;
+        } else if (arg == "--benchmark-filter") {
+            options.benchmarkFilter = optionValue(argc, argv, i);
+        } else if (arg == "--frames") {
+            std::string value = optionValue(argc, argv, i);
+            int frames = atoi(value.c_str());
+
+            if (frames <= 0) {
+                throw std::runtime_error("invalid frame count: " + value);
+            }
+            options.frames = frames;
+        } else if (arg == "--results") {
+            options.resultsPath = optionValue(argc, argv, i);
+        } else if (arg == "--screenshot") {
+            options.screenshotPath = optionValue(argc, argv, i);
+        } else if (arg == "--trace") {
+            options.tracePath = optionValue(argc, argv, i);
+        } else if (arg == "--recording-threads") {
+            std::string value = optionValue(argc, argv, i);
+            int threads = atoi(value.c_str());
+
+            if (threads < 0 || (threads == 0 && value != "0")) {
+                throw std::runtime_error("invalid thread count: " + value);
+            }
+            options.recordingThreads = threads;
+        } else if (arg == "--no-static-cache") {
+            options.staticGeometryCaching = false;
+        } else if (arg == "--cpu-mvp") {
+            options.cpuMvp = true;
+        } else if (arg == "--no-lod") {
+            options.lodEnabled = false;
+        } else if (arg == "--no-occlusion-culling") {
+            options.occlusionCulling = false;
+        } else if (arg == "--depth-prepass") {
+            options.depthPrepass = true;
+        } else if (arg == "--no-cluster-culling") {
+            options.clusterCulling = false;
+        } else if (arg == "--no-mesh-shaders") {
+            options.meshShaders = false;
+        } else if (arg == "--frames-in-flight") {
+            std::string value = optionValue(argc, argv, i);
+            int frames = atoi(value.c_str());
+
+            // the upper bound is checked by `Render::setFramesInFlight`
+            if (frames <= 0) {
+                throw std::runtime_error("invalid frames in flight: " + value);
+            }
+            options.framesInFlight = frames;
+        } else if (arg == "--low-latency") {
+            options.lowLatency = true;
+        } else if (arg == "--present-mode") {
+            options.presentMode = optionValue(argc, argv, i);
+
+            if (options.presentMode != "fifo" &&
+                options.presentMode != "fifo_relaxed" &&
+                options.presentMode != "mailbox" &&
+                options.presentMode != "immediate") {
+                throw std::runtime_error("unknown present mode: " +
+                                         options.presentMode);
+            }
+        } else if (arg == "--uncapped") {
+            options.presentMode = "immediate";
+        } else if (arg == "--swapchain-images") {
+            std::string value = optionValue(argc, argv, i);
+            int images = atoi(value.c_str());
+
+            if (images <= 0) {
+                throw std::runtime_error("invalid image count: " + value);
+            }
+            options.swapChainImages = images;
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            exit(EXIT_SUCCESS);
+        } else {
+            printUsage(argv[0]);
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (!options.recordPath.empty() && !options.replayPath.empty()) {
+        throw std::runtime_error("--record and --replay are exclusive");
+    }
+
+    if (options.headless && !options.recordPath.empty()) {
+        throw std::runtime_error("--record needs a window, use it without "
+                                 "--headless");
+    }
+
+    return options;
+}
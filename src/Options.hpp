@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint> // uint32_t
+#include <string>  // std::string
+
+// Command line options, see `parseOptions` for the accepted flags
+struct launchOptions {
+    // time scene construction with `addModel` vs `addModels` and exit
+    bool benchSpawn = false;
+    // time the scene BVH against linear scans and exit
+    bool benchBvh = false;
+    // write every physics step's camera pose and scene changes to this file
+    std::string recordPath;
+    // play back a recording made with `recordPath` instead of live input
+    std::string replayPath;
+
+    // render offscreen without a window, see `Application::headlessLoop`
+    bool headless = false;
+    uint32_t frames = 600;
+    // run the Benchmark scene suite headless, see `Application::run`
+    bool benchmark = false;
+    // only run benchmark scenes whose name contains this
+    std::string benchmarkFilter;
+    // per-frame timings as CSV, or the benchmark results as JSON
+    std::string resultsPath;
+    // PNG of the last headless frame
+    std::string screenshotPath;
+    // Chrome trace of the CPU profiler zones, written on exit
+    std::string tracePath;
+    // see `Render::recordingThreads`
+    int recordingThreads = -1;
+    // see `Render::staticGeometryCaching`
+    bool staticGeometryCaching = true;
+    // see `Render::cpuMvp`
+    bool cpuMvp = false;
+    // see `Render::lodEnabled`
+    bool lodEnabled = true;
+    // see `Render::occlusionCulling`
+    bool occlusionCulling = true;
+    // see `Render::depthPrepass`
+    bool depthPrepass = false;
+    // see `Render::clusterCulling`
+    bool clusterCulling = true;
+    // see `Render::meshShaders`
+    bool meshShaders = true;
+    // 1 to MAX_FRAMES_IN_FLIGHT, can also be changed in the pause menu
+    uint32_t framesInFlight = 2;
+    // see `FramePacer`
+    bool lowLatency = false;
+    // name from `VulkanSetup::getPresentModeName`, empty keeps the default
+    std::string presentMode;
+    // 0 lets `VulkanSetup::createSwapChain` pick
+    uint32_t swapChainImages = 0;
+};
+
+launchOptions parseOptions(int argc, char** argv);
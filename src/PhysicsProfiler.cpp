@@ -0,0 +1,121 @@
+#include <cfloat>    // FLT_MAX
+#include <cstdio>    // snprintf
+#include <fstream>   // std::ofstream
+#include <iostream>  // std::cout, std::cerr
+
+#include "imgui/imgui.h"
+
+#include "PhysicsProfiler.hpp"
+
+void PhysicsProfiler::beginFrame() { frameSubsteps = 0; }
+
+void PhysicsProfiler::beginStep() {
+    currentStep = StepStats{};
+    currentStep.step = stepCount;
+    currentStep.substep = ++frameSubsteps;
+
+    stepStart = std::chrono::steady_clock::now();
+}
+
+void PhysicsProfiler::endStep(rp3d::PhysicsWorld* world) {
+    std::chrono::duration<float, std::milli> elapsed =
+        std::chrono::steady_clock::now() - stepStart;
+    currentStep.stepTimeMs = elapsed.count();
+
+    for (rp3d::uint32 i = 0; i < world->getNbRigidBodies(); i++) {
+        if (!world->getRigidBody(i)->isSleeping()) {
+            currentStep.awakeBodies++;
+        }
+    }
+
+    lastStep = currentStep;
+    stepCount++;
+
+    stepTimeHistory[historyOffset] = lastStep.stepTimeMs;
+    awakeHistory[historyOffset] = static_cast<float>(lastStep.awakeBodies);
+    manifoldHistory[historyOffset] =
+        static_cast<float>(lastStep.contactManifolds);
+    historyOffset = (historyOffset + 1) % HISTORY_SIZE;
+
+    if (log.size() < LOG_SIZE) {
+        log.push_back(lastStep);
+    } else {
+        log[logOffset] = lastStep;
+        logOffset = (logOffset + 1) % LOG_SIZE;
+    }
+}
+
+void PhysicsProfiler::endFrame() {
+    lastFrameSubsteps = frameSubsteps;
+
+    substepHistory[substepHistoryOffset] = static_cast<float>(frameSubsteps);
+    substepHistoryOffset = (substepHistoryOffset + 1) % HISTORY_SIZE;
+}
+
+void PhysicsProfiler::onContact(
+    const rp3d::CollisionCallback::CallbackData& callbackData) {
+    // rp3d reports every narrow-phase pair whose contact state is known this
+    // step, including the pairs that just separated (ContactExit). Only the
+    // remaining pairs carry a contact manifold into the solver.
+    for (rp3d::uint32 i = 0; i < callbackData.getNbContactPairs(); i++) {
+        rp3d::CollisionCallback::ContactPair contactPair =
+            callbackData.getContactPair(i);
+
+        currentStep.contactPairs++;
+
+        if (contactPair.getEventType() !=
+            rp3d::CollisionCallback::ContactPair::EventType::ContactExit) {
+            currentStep.contactManifolds++;
+            currentStep.contactPoints += contactPair.getNbContactPoints();
+        }
+    }
+}
+
+void PhysicsProfiler::drawImgui() {
+    char overlay[64];
+
+    snprintf(overlay, sizeof(overlay), "step %.3f ms", lastStep.stepTimeMs);
+    ImGui::PlotLines("physics step", stepTimeHistory.data(), HISTORY_SIZE,
+                     historyOffset, overlay, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+    snprintf(overlay, sizeof(overlay), "substeps %d", lastFrameSubsteps);
+    ImGui::PlotHistogram("substeps", substepHistory.data(), HISTORY_SIZE,
+                         substepHistoryOffset, overlay, 0.0f, 8.0f,
+                         ImVec2(0, 40));
+
+    snprintf(overlay, sizeof(overlay), "awake %d", lastStep.awakeBodies);
+    ImGui::PlotLines("awake bodies", awakeHistory.data(), HISTORY_SIZE,
+                     historyOffset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+
+    snprintf(overlay, sizeof(overlay), "manifolds %d", lastStep.contactManifolds);
+    ImGui::PlotLines("contact manifolds", manifoldHistory.data(), HISTORY_SIZE,
+                     historyOffset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+
+    ImGui::Text("contact pairs = %d, contact points = %d",
+                lastStep.contactPairs, lastStep.contactPoints);
+}
+
+void PhysicsProfiler::dumpCsv(const std::string& filename) {
+    std::ofstream file(filename);
+
+    // called from the ImGui button, a missing dump is not worth a crash
+    if (!file.is_open()) {
+        std::cerr << "PhysicsProfiler::dumpCsv(), failed to open file: "
+                  << filename << "!" << std::endl;
+        return;
+    }
+
+    file << "step,step_time_ms,substep,awake_bodies,contact_pairs,"
+            "contact_manifolds,contact_points\n";
+
+    // `logOffset` points at the oldest entry once the ring buffer is full
+    for (size_t i = 0; i < log.size(); i++) {
+        const StepStats& stats = log[(logOffset + i) % log.size()];
+        file << stats.step << "," << stats.stepTimeMs << "," << stats.substep
+             << "," << stats.awakeBodies << "," << stats.contactPairs << ","
+             << stats.contactManifolds << "," << stats.contactPoints << "\n";
+    }
+
+    std::cout << "PhysicsProfiler::dumpCsv(), wrote " << log.size()
+              << " steps to " << filename << std::endl;
+}
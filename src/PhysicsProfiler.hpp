@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono> // std::chrono
+#include <string> // std::string
+#include <vector> // std::vector
+
+#include <reactphysics3d/reactphysics3d.h>
+
+// Collects per-step statistics for the physics world. It is registered as the
+// world's event listener so the contact data reported during
+// `PhysicsWorld::update` is attributed to the step that produced it.
+class PhysicsProfiler : public rp3d::EventListener {
+  public:
+    // number of samples shown in the rolling graphs
+    static const int HISTORY_SIZE = 240;
+    // number of steps kept for the CSV dump (one minute at 60Hz)
+    static const int LOG_SIZE = 3600;
+
+    struct StepStats {
+        uint64_t step = 0;
+        float stepTimeMs = 0.0f;
+        int substep = 0; // 1-based index of the step within its frame
+        int awakeBodies = 0;
+        int contactPairs = 0;
+        int contactManifolds = 0;
+        int contactPoints = 0;
+    };
+
+    void beginFrame();
+    void beginStep();
+    void endStep(rp3d::PhysicsWorld* world);
+    void endFrame();
+
+    void onContact(
+        const rp3d::CollisionCallback::CallbackData& callbackData) override;
+
+    const StepStats& getLastStep() const { return lastStep; }
+    int getLastFrameSubsteps() const { return lastFrameSubsteps; }
+
+    // Draws the rolling graphs into the current ImGui window
+    void drawImgui();
+    void dumpCsv(const std::string& filename);
+
+  private:
+    std::chrono::steady_clock::time_point stepStart;
+
+    StepStats currentStep;
+    StepStats lastStep;
+    uint64_t stepCount = 0;
+
+    int frameSubsteps = 0;
+    int lastFrameSubsteps = 0;
+
+    // ring buffers for the ImGui graphs, `historyOffset` is the oldest value
+    std::vector<float> stepTimeHistory = std::vector<float>(HISTORY_SIZE);
+    std::vector<float> substepHistory = std::vector<float>(HISTORY_SIZE);
+    std::vector<float> awakeHistory = std::vector<float>(HISTORY_SIZE);
+    std::vector<float> manifoldHistory = std::vector<float>(HISTORY_SIZE);
+    int historyOffset = 0;
+    int substepHistoryOffset = 0;
+
+    // ring buffer of the most recent steps for the CSV dump
+    std::vector<StepStats> log;
+    size_t logOffset = 0;
+};
@@ -0,0 +1,107 @@
+#include <cstdio>    // std::rename
+#include <cstring>   // memcmp, memcpy
+#include <fstream>   // std::ifstream, std::ofstream
+#include <iostream>  // std::cout
+#include <stdexcept> // std::runtime_error
+#include <vector>    // std::vector
+
+#include "PipelineCache.hpp"
+
+void PipelineCache::create(VkDevice device, VkPhysicalDevice physicalDevice,
+                           const std::string& filename) {
+    this->device = device;
+    this->filename = filename;
+
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    std::vector<char> data;
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+    if (file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), data.size());
+
+        if (!file || !isCompatible(data)) {
+            std::cout << "PipelineCache::create(), ignoring " << filename
+                      << ", it was written by another device or driver"
+                      << std::endl;
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline cache!");
+    }
+
+    std::cout << "PipelineCache::create(), loaded " << data.size()
+              << " bytes from " << filename << std::endl;
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data) {
+    // the header every implementation writes first, see
+    // VkPipelineCacheHeaderVersionOne
+    VkPipelineCacheHeaderVersionOne header;
+
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties.vendorID &&
+           header.deviceID == properties.deviceID &&
+           memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+                  VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save() {
+    if (cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    size_t size = 0;
+    vkGetPipelineCacheData(device, cache, &size, nullptr);
+
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, cache, &size, data.data()) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to get pipeline cache data!");
+    }
+
+    // write to a temporary file first so an interrupted save never leaves a
+    // truncated cache behind
+    std::string tempFilename = filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open file: " + tempFilename +
+                                     "!");
+        }
+
+        file.write(data.data(), size);
+    }
+
+    if (std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("failed to write file: " + filename + "!");
+    }
+
+    std::cout << "PipelineCache::save(), wrote " << size << " bytes to "
+              << filename << std::endl;
+}
+
+void PipelineCache::destroy() {
+    if (cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(device, cache, nullptr);
+        cache = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string> // std::string
+#include <vector> // std::vector
+
+#include <vulkan/vulkan.h>
+
+// A VkPipelineCache that survives restarts. The cache data is loaded from
+// disk when created, and only used if its header matches the current device
+// (vendor and device id plus `pipelineCacheUUID`, which changes with the
+// driver version). Otherwise the cache starts out empty. Every pipeline,
+// ImGui's included, should be created with `cache`.
+class PipelineCache {
+  public:
+    VkPipelineCache cache = VK_NULL_HANDLE;
+
+    void create(VkDevice device, VkPhysicalDevice physicalDevice,
+                const std::string& filename);
+    // Writes the current cache data back to `filename`
+    void save();
+    void destroy();
+
+  private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties;
+    std::string filename;
+
+    // Returns false if `data` was written for another device or driver
+    bool isCompatible(const std::vector<char>& data);
+};
@@ -0,0 +1,82 @@
+#include <iostream>  // std::cout, std::cerr
+#include <stdexcept> // std::exception
+
+#include "PipelineManager.hpp"
+
+void PipelineManager::create(VkDevice device, Shader* shader,
+                             const PipelineKey& defaultKey) {
+    this->device = device;
+    this->shader = shader;
+
+    // nothing can be drawn without it, so this one is compiled right away
+    defaultPipeline = shader->createPipeline(defaultKey);
+
+    Entry entry;
+    entry.pipeline = defaultPipeline;
+    entry.ready = true;
+    pipelines[defaultKey] = entry;
+
+    compiler = std::make_unique<ThreadPool>(COMPILE_THREADS);
+}
+
+void PipelineManager::destroy() {
+    // joins the threads once the queued compiles are done
+    compiler.reset();
+
+    for (auto& [key, entry] : pipelines) {
+        if (entry.pipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, entry.pipeline, nullptr);
+        }
+    }
+    pipelines.clear();
+}
+
+VkPipeline PipelineManager::get(const PipelineKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = pipelines.find(key);
+    if (it != pipelines.end()) {
+        const Entry& entry = it->second;
+        return entry.ready && !entry.failed ? entry.pipeline : defaultPipeline;
+    }
+
+    // first request, the entry marks it as compiling
+    pipelines[key] = Entry();
+    pendingCount++;
+
+    compiler->submit([this, key] {
+        Entry entry;
+        entry.ready = true;
+
+        try {
+            entry.pipeline = shader->createPipeline(key);
+        } catch (const std::exception& exception) {
+            std::cerr << "PipelineManager::get(), " << exception.what()
+                      << std::endl;
+            entry.failed = true;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pipelines[key] = entry;
+        pendingCount--;
+    });
+
+    return defaultPipeline;
+}
+
+bool PipelineManager::isReady(const PipelineKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = pipelines.find(key);
+    return it != pipelines.end() && it->second.ready && !it->second.failed;
+}
+
+size_t PipelineManager::getPipelineCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelines.size() - pendingCount;
+}
+
+size_t PipelineManager::getPendingCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pendingCount;
+}
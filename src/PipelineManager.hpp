@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>        // std::unique_ptr
+#include <mutex>         // std::mutex
+#include <unordered_map> // std::unordered_map
+
+#include <vulkan/vulkan.h>
+
+#include "Shader.hpp"
+#include "ThreadPool.hpp"
+
+// Owns every graphics pipeline variant, keyed by `PipelineKey`. The default
+// variant is compiled up front. Any other variant is compiled on a
+// background thread the first time it is asked for, and until it is ready
+// `get` returns the default pipeline, so switching modes never stalls a
+// frame. Each key is compiled at most once.
+class PipelineManager {
+  public:
+    // background compile threads, separate from the recording workers so a
+    // slow compile never delays `ThreadPool::wait` during recording
+    static constexpr uint32_t COMPILE_THREADS = 2;
+
+    void create(VkDevice device, Shader* shader,
+                const PipelineKey& defaultKey);
+    // Waits for running compiles, then destroys every pipeline
+    void destroy();
+
+    // Never blocks on a compile
+    VkPipeline get(const PipelineKey& key);
+    bool isReady(const PipelineKey& key);
+
+    size_t getPipelineCount();
+    size_t getPendingCount();
+
+  private:
+    struct Entry {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        bool ready = false;
+        // the default pipeline is used for failed variants
+        bool failed = false;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    Shader* shader = nullptr;
+    VkPipeline defaultPipeline = VK_NULL_HANDLE;
+
+    std::mutex mutex;
+    std::unordered_map<PipelineKey, Entry, PipelineKeyHash> pipelines;
+    size_t pendingCount = 0;
+
+    std::unique_ptr<ThreadPool> compiler;
+};
@@ -0,0 +1,122 @@
+#include <algorithm> // std::min
+#include <fstream>   // std::ofstream
+#include <stdexcept> // std::runtime_error
+
+#include "PngWriter.hpp"
+
+// largest block a stored (uncompressed) deflate block can hold
+static const uint32_t MAX_STORED_BLOCK = 65535;
+
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+
+    if (!tableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void appendU32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void writeChunk(std::ofstream& file, const char type[4],
+                       const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+
+    appendU32(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    // the CRC covers the type and the data, not the length
+    appendU32(chunk, crc32(chunk.data() + 4, chunk.size() - 4, 0));
+
+    file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+void writePng(const std::string& filename, uint32_t width, uint32_t height,
+              const std::vector<uint8_t>& rgba) {
+    if (rgba.size() != size_t(width) * height * 4) {
+        throw std::runtime_error("writePng: pixel data does not match size!");
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file: " + filename + "!");
+    }
+
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    // 8 bits per channel, color type 6 (RGBA), no interlacing
+    std::vector<uint8_t> header;
+    appendU32(header, width);
+    appendU32(header, height);
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    writeChunk(file, "IHDR", header);
+
+    // every row starts with filter type 0 (none)
+    size_t rowSize = size_t(width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * height);
+
+    for (uint32_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba.begin() + y * rowSize,
+                   rgba.begin() + (y + 1) * rowSize);
+    }
+
+    // zlib stream made of stored deflate blocks
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    size_t offset = 0;
+    do {
+        uint32_t blockSize = static_cast<uint32_t>(
+            std::min<size_t>(MAX_STORED_BLOCK, raw.size() - offset));
+        bool last = offset + blockSize == raw.size();
+
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(blockSize & 0xff);
+        zlib.push_back(blockSize >> 8);
+        zlib.push_back(~blockSize & 0xff);
+        zlib.push_back((~blockSize >> 8) & 0xff);
+        zlib.insert(zlib.end(), raw.begin() + offset,
+                    raw.begin() + offset + blockSize);
+
+        offset += blockSize;
+    } while (offset < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendU32(zlib, (b << 16) | a);
+
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+
+    if (!file) {
+        throw std::runtime_error("failed to write file: " + filename + "!");
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint> // uint8_t, uint32_t
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+// Writes 8-bit RGBA pixels (rows top to bottom) as a PNG file. The image data
+// is stored uncompressed, which keeps this dependency free; it is only used
+// for headless screenshots where file size does not matter.
+void writePng(const std::string& filename, uint32_t width, uint32_t height,
+              const std::vector<uint8_t>& rgba);
@@ -0,0 +1,311 @@
+#include <algorithm> // std::clamp, std::max, std::min
+#include <chrono>    // std::chrono
+#include <cstdio>    // snprintf
+#include <fstream>   // std::ofstream
+#include <iostream>  // std::cout, std::cerr
+
+#include "imgui/imgui.h"
+
+#include "Profiler.hpp"
+
+static const std::chrono::steady_clock::time_point profilerEpoch =
+    std::chrono::steady_clock::now();
+
+Profiler& Profiler::get() {
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - profilerEpoch)
+        .count();
+}
+
+Profiler::ThreadBuffer* Profiler::getThreadBuffer() {
+    thread_local ThreadBuffer* threadBuffer = nullptr;
+
+    if (threadBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+
+        threads.push_back(std::make_unique<ThreadBuffer>());
+        threadBuffer = threads.back().get();
+        threadBuffer->threadId = static_cast<uint32_t>(threads.size() - 1);
+        threadBuffer->name = "thread " + std::to_string(threadBuffer->threadId);
+    }
+
+    return threadBuffer;
+}
+
+void Profiler::setThreadName(const std::string& name) {
+    ThreadBuffer* buffer = getThreadBuffer();
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->name = name;
+}
+
+void Profiler::beginFrame() {
+    frameStarts[frameOffset] = now();
+    frameOffset = (frameOffset + 1) % FRAME_HISTORY;
+    frameCount++;
+}
+
+uint64_t Profiler::getFrameStart(int framesAgo) {
+    int index = (frameOffset - 1 - framesAgo + FRAME_HISTORY) % FRAME_HISTORY;
+    return frameStarts[index];
+}
+
+std::vector<Profiler::ZoneRecord>
+Profiler::copyZones(ThreadBuffer* buffer, uint64_t fromNs, uint64_t toNs) {
+    std::vector<ZoneRecord> zones;
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+
+    uint64_t count = std::min<uint64_t>(buffer->written, ZONES_PER_THREAD);
+
+    // newest first, zones are written in the order they end so the walk can
+    // stop at the first one that ended before the window
+    for (uint64_t i = 0; i < count; i++) {
+        const ZoneRecord& zone =
+            buffer->zones[(buffer->written - 1 - i) % ZONES_PER_THREAD];
+
+        if (zone.endNs < fromNs) {
+            break;
+        }
+
+        if (zone.startNs <= toNs) {
+            zones.push_back(zone);
+        }
+    }
+
+    return zones;
+}
+
+static ImU32 getZoneColor(const char* name) {
+    // zones with the same name share a color across frames
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+    }
+
+    return ImColor::HSV((hash % 360) / 360.0f, 0.55f, 0.75f);
+}
+
+void Profiler::drawImgui() {
+    bool capture = capturing.load(std::memory_order_relaxed);
+    if (ImGui::Checkbox("capture", &capture)) {
+        capturing.store(capture, std::memory_order_relaxed);
+    }
+    ImGui::SameLine();
+    ImGui::SliderInt("frames shown", &shownFrames, 1, 16);
+
+    // need one extra boundary to close the newest complete frame
+    if (frameCount < static_cast<uint64_t>(shownFrames) + 2) {
+        ImGui::Text("not enough frames recorded yet");
+        return;
+    }
+
+    // frame times of the history, oldest first
+    int frames = static_cast<int>(
+        std::min<uint64_t>(frameCount - 1, FRAME_HISTORY - 1));
+    std::vector<float> frameTimes(frames);
+    for (int i = 0; i < frames; i++) {
+        int framesAgo = frames - i;
+        frameTimes[i] =
+            (getFrameStart(framesAgo - 1) - getFrameStart(framesAgo)) / 1e6f;
+    }
+
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "frame %.3f ms", frameTimes.back());
+    ImGui::PlotHistogram("frame time", frameTimes.data(), frames, 0, overlay,
+                         0.0f, 50.0f, ImVec2(0, 80));
+
+    // The frame being recorded right now is incomplete, the timeline shows
+    // the `shownFrames` before it
+    uint64_t fromNs = getFrameStart(shownFrames);
+    uint64_t toNs = getFrameStart(0);
+
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (auto& buffer : threads) {
+            buffers.push_back(buffer.get());
+        }
+    }
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    float width = ImGui::GetContentRegionAvail().x;
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImVec2 mouse = ImGui::GetIO().MousePos;
+    float y = origin.y;
+
+    // differences are taken in integers, floats run out of precision for
+    // absolute nanosecond timestamps after a few milliseconds
+    auto toX = [&](uint64_t ns) {
+        double t = static_cast<double>(static_cast<int64_t>(ns - fromNs)) /
+                   static_cast<double>(toNs - fromNs);
+        return origin.x + static_cast<float>(std::clamp(t, 0.0, 1.0)) * width;
+    };
+
+    for (ThreadBuffer* buffer : buffers) {
+        std::vector<ZoneRecord> zones = copyZones(buffer, fromNs, toNs);
+
+        if (zones.empty()) {
+            continue;
+        }
+
+        std::string threadName;
+        {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            threadName = buffer->name;
+        }
+        drawList->AddText(ImVec2(origin.x, y), IM_COL32_WHITE,
+                          threadName.c_str());
+        y += rowHeight;
+
+        uint32_t maxDepth = 0;
+        for (const ZoneRecord& zone : zones) {
+            maxDepth = std::max(maxDepth, zone.depth);
+
+            float x0 = toX(zone.startNs);
+            float x1 = toX(zone.endNs);
+            float y0 = y + zone.depth * rowHeight;
+            float y1 = y0 + rowHeight - 1.0f;
+
+            // keep sub-pixel zones visible
+            x1 = std::max(x1, x0 + 1.0f);
+
+            drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1),
+                                    getZoneColor(zone.name));
+
+            if (ImGui::CalcTextSize(zone.name).x < x1 - x0 - 4.0f) {
+                drawList->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32_BLACK,
+                                  zone.name);
+            }
+
+            if (mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 &&
+                mouse.y < y1) {
+                ImGui::SetTooltip("%s: %.3f ms", zone.name,
+                                  (zone.endNs - zone.startNs) / 1e6f);
+            }
+        }
+
+        y += (maxDepth + 1) * rowHeight;
+    }
+
+    // frame boundaries
+    for (int i = 0; i <= shownFrames; i++) {
+        float x = toX(getFrameStart(i));
+        drawList->AddLine(ImVec2(x, origin.y), ImVec2(x, y),
+                          IM_COL32(255, 255, 255, 128));
+    }
+
+    ImGui::Dummy(ImVec2(width, y - origin.y));
+}
+
+std::string Profiler::escapeJson(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            // control characters, \u works for all of them
+            char code[7];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+void Profiler::exportChromeTrace(const std::string& filename) {
+    std::ofstream file(filename);
+
+    // called from the ImGui button, a missing trace is not worth a crash
+    if (!file.is_open()) {
+        std::cerr << "Profiler::exportChromeTrace(), failed to open file: "
+                  << filename << "!" << std::endl;
+        return;
+    }
+
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (auto& buffer : threads) {
+            buffers.push_back(buffer.get());
+        }
+    }
+
+    file << "{\"traceEvents\":[\n";
+
+    bool first = true;
+    size_t zoneCount = 0;
+    char event[256];
+
+    for (ThreadBuffer* buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+
+        snprintf(event, sizeof(event),
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                 "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                 first ? "" : ",\n", buffer->threadId,
+                 escapeJson(buffer->name).c_str());
+        file << event;
+        first = false;
+
+        uint64_t count =
+            std::min<uint64_t>(buffer->written, ZONES_PER_THREAD);
+        for (uint64_t i = buffer->written - count; i < buffer->written; i++) {
+            const ZoneRecord& zone = buffer->zones[i % ZONES_PER_THREAD];
+
+            // complete events, timestamps in microseconds
+            snprintf(event, sizeof(event),
+                     ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,"
+                     "\"ts\":%.3f,\"dur\":%.3f}",
+                     escapeJson(zone.name).c_str(), buffer->threadId,
+                     zone.startNs / 1000.0,
+                     (zone.endNs - zone.startNs) / 1000.0);
+            file << event;
+        }
+
+        zoneCount += count;
+    }
+
+    file << "\n]}\n";
+
+    std::cout << "Profiler::exportChromeTrace(), wrote " << zoneCount
+              << " zones to " << filename << std::endl;
+}
+
+ProfileZone::ProfileZone(const char* name) : name(name) {
+    Profiler& profiler = Profiler::get();
+
+    if (!profiler.capturing.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    buffer = profiler.getThreadBuffer();
+    depth = buffer->depth++;
+    startNs = Profiler::now();
+}
+
+ProfileZone::~ProfileZone() {
+    if (buffer == nullptr) {
+        return;
+    }
+
+    uint64_t endNs = Profiler::now();
+    buffer->depth--;
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->zones[buffer->written % Profiler::ZONES_PER_THREAD] =
+        Profiler::ZoneRecord{name, startNs, endNs, depth};
+    buffer->written++;
+}
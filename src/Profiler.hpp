@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>  // std::atomic
+#include <cstdint> // uint64_t
+#include <memory>  // std::unique_ptr
+#include <mutex>   // std::mutex
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Times the enclosing scope. `name` has to outlive the profiler, use string
+// literals.
+#define PROFILE_ZONE(name)                                                     \
+    ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+// CPU instrumentation. Zones are recorded into a ring buffer owned by the
+// thread that opened them, so threads only contend with the reader (ImGui or
+// the trace export), never with each other.
+class Profiler {
+  public:
+    // zones kept per thread before the oldest are overwritten
+    static constexpr size_t ZONES_PER_THREAD = 1 << 16;
+    // frame boundaries kept for the timeline and the frame time graph
+    static constexpr int FRAME_HISTORY = 240;
+
+    struct ZoneRecord {
+        const char* name;
+        uint64_t startNs;
+        uint64_t endNs;
+        uint32_t depth;
+    };
+
+    struct ThreadBuffer {
+        uint32_t threadId;
+        std::string name;
+
+        std::mutex mutex;
+        std::vector<ZoneRecord> zones =
+            std::vector<ZoneRecord>(ZONES_PER_THREAD);
+        // total zones ever written, the next one goes to written % size
+        uint64_t written = 0;
+        // nesting depth of the zones currently open on this thread
+        uint32_t depth = 0;
+    };
+
+    static Profiler& get();
+    // nanoseconds since the profiler was created
+    static uint64_t now();
+
+    // Stops recording new zones, e.g. to inspect the timeline. Read by every
+    // thread that opens a zone.
+    std::atomic<bool> capturing{true};
+
+    void setThreadName(const std::string& name);
+    // Marks the start of a frame on the main thread
+    void beginFrame();
+    ThreadBuffer* getThreadBuffer();
+
+    // Draws the frame time graph and the zone timeline of the last frames
+    // into the current ImGui window
+    void drawImgui();
+    // Writes every recorded zone in the Chrome trace event format, open it
+    // in chrome://tracing or https://ui.perfetto.dev
+    void exportChromeTrace(const std::string& filename);
+    // Escapes `text` for a JSON string, also used by `Benchmark::writeJson`
+    static std::string escapeJson(const std::string& text);
+
+  private:
+    Profiler() = default;
+
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+    // ring buffer of frame start times, `frameOffset` is the next slot
+    std::vector<uint64_t> frameStarts = std::vector<uint64_t>(FRAME_HISTORY);
+    int frameOffset = 0;
+    uint64_t frameCount = 0;
+
+    int shownFrames = 3;
+
+    uint64_t getFrameStart(int framesAgo);
+    std::vector<ZoneRecord> copyZones(ThreadBuffer* buffer, uint64_t fromNs,
+                                      uint64_t toNs);
+};
+
+class ProfileZone {
+    Profiler::ThreadBuffer* buffer = nullptr;
+    const char* name;
+    uint64_t startNs;
+    uint32_t depth;
+
+  public:
+    ProfileZone(const char* name);
+    ~ProfileZone();
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
@@ -1,4 +1,4 @@
-#include <iostream> // std::cout
+#include <iostream> // std::cout, std::cerr
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -9,18 +9,61 @@
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_vulkan.h"
 
-#include <chrono>  // std::chrono
-#include <cstring> // memcpy
+#include <algorithm> // std::copy, std::max, std::min, std::sort
+#include <chrono>    // std::chrono
+#include <cmath>     // std::tan, std::cbrt, std::cos, std::sin, std::abs
+#include <array>     // std::array
+#include <cstdio>    // snprintf
+#include <cstring>   // memcpy
+#include <limits>    // std::numeric_limits
+#include <random>    // std::mt19937
+#include <string>    // std::to_string
+#include <thread>    // std::thread::hardware_concurrency
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h> // _mm_mul_ps, _mm_add_ps
+#define RENDER_SSE
+#endif
 
 #include "FPSCamera.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshletBuilder.hpp"
 #include "Models/Box.hpp"
 #include "Models/Bridge.hpp"
 #include "Models/Commodore.hpp"
 #include "Models/Hatchet.hpp"
 #include "Models/House.hpp"
 #include "Models/Skull.hpp"
+#include "Profiler.hpp"
 #include "Render.hpp"
 
+// relative to the working directory, like the shaders
+static const char* PIPELINE_CACHE_FILENAME = "pipeline_cache.bin";
+
+// `a * b` for the model-view-projection of every instance with
+// `MvpVariant`. Every column of the result is a sum of the columns of `a`
+// scaled by one column of `b`, four floats at a time with SSE.
+static glm::mat4 multiplyMatrices(const glm::mat4& a, const glm::mat4& b) {
+#ifdef RENDER_SSE
+    const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+
+    glm::mat4 result;
+    for (int column = 0; column < 4; column++) {
+        __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+        _mm_storeu_ps(&result[column][0], sum);
+    }
+    return result;
+#else
+    return a * b;
+#endif
+}
+
 void Render::createScene() {
     // floor
     addModel<Box>(glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(20.0f, 0.5f, 20.0f),
@@ -38,15 +81,20 @@ void Render::createScene() {
     float wallXEnd = 10.0f;
     float structureZ = -10.0f; // further away
 
+    // Each wall is collected first and spawned with a single `addModels` call
+    std::vector<glm::vec3> bricks;
+
     // Front wall (X direction)
     bool step = true;
     for (float y = 0; y < wallHeight; y += wallStep) {
         for (float x = wallXStart; x < wallXEnd; x++) {
             float xOffset = step ? 0.5f : 0.0f;
-            addModel<Box>(glm::vec3(x + xOffset, y, structureZ + 10.0f), brickSize);
+            bricks.push_back(glm::vec3(x + xOffset, y, structureZ + 10.0f));
         }
         step = !step;
     }
+    addModels<Box>(bricks, brickSize);
+    bricks.clear();
 
     // Side wall 1 (Z direction, left)
     glm::vec3 brickSize2 = glm::vec3(0.5f, 0.25f, 0.5f);
@@ -54,30 +102,35 @@ void Render::createScene() {
     for (float y = 0; y < wallHeight; y += wallStep) {
         for (float z = wallZStart; z < wallZEnd; z++) {
             float zOffset = step ? 0.5f : 0.0f;
-            addModel<Box>(glm::vec3(wallXStart - 0.25f, y, z + zOffset + 0.25f + structureZ + 10.0f), brickSize2);
+            bricks.push_back(glm::vec3(wallXStart - 0.25f, y, z + zOffset + 0.25f + structureZ + 10.0f));
         }
         step = !step;
     }
+    addModels<Box>(bricks, brickSize2);
+    bricks.clear();
 
     // Side wall 2 (Z direction, right)
     step = true;
     for (float y = 0; y < wallHeight; y += wallStep) {
         for (float z = wallZStart; z < wallZEnd; z++) {
             float zOffset = step ? 0.5f : 0.0f;
-            addModel<Box>(glm::vec3(wallXEnd - 0.25f, y, z + zOffset + 0.25f + structureZ + 10.0f), brickSize2);
+            bricks.push_back(glm::vec3(wallXEnd - 0.25f, y, z + zOffset + 0.25f + structureZ + 10.0f));
         }
         step = !step;
     }
+    addModels<Box>(bricks, brickSize2);
+    bricks.clear();
 
     // Back wall (X direction, at far z)
     step = false;
     for (float y = 0; y < wallHeight; y += wallStep) {
         for (float x = wallXStart; x < wallXEnd; x++) {
             float xOffset = step ? 0.5f : 0.0f;
-            addModel<Box>(glm::vec3(x + xOffset, y, wallZStart + structureZ + 10.0f), brickSize);
+            bricks.push_back(glm::vec3(x + xOffset, y, wallZStart + structureZ + 10.0f));
         }
         step = !step;
     }
+    addModels<Box>(bricks, brickSize);
 
     // addModel<Bridge>(glm::vec3(-5.0f, -0.40f, 0.0f), glm::vec3(1, 1, 1),
     //                  rp3d::BodyType::STATIC);
@@ -105,6 +158,8 @@ void Render::createScene() {
     //     }
     // }
 
+    sceneObjectCount = objects.size();
+
     std::cout << "Number of models: " << objects.size() << std::endl;
 }
 
@@ -115,22 +170,609 @@ T Render::addModel(glm::vec3 position, glm::vec3 scale,
     T* model =
         new T(scale, true, position, true, bodyType, world, &physicsCommon);
 
+    MeshCollider* meshCollider = loadModelClass(model);
+
+    if (model->physicsBody != nullptr) {
+        meshCollider->attach(model->physicsBody, model->getScale());
+    }
+
+    objects.push_back(std::shared_ptr<T>(model));
+    drawListsChanged = true;
+
+    return *model;
+}
+
+template <typename T>
+std::vector<std::shared_ptr<T>>
+Render::addModels(const std::vector<glm::vec3>& positions, glm::vec3 scale,
+                  rp3d::BodyType bodyType) {
+    std::vector<std::shared_ptr<T>> models;
+
+    if (positions.empty()) {
+        return models;
+    }
+
+    models.reserve(positions.size());
+    objects.reserve(objects.size() + positions.size());
+
+    // The model class only needs to be looked up (and loaded) once for the
+    // whole batch, every instance then shares its collider shape.
+    MeshCollider* meshCollider = nullptr;
+
+    for (const glm::vec3& position : positions) {
+        std::shared_ptr<T> model = std::make_shared<T>(
+            scale, true, position, true, bodyType, world, &physicsCommon);
+
+        if (meshCollider == nullptr) {
+            meshCollider = loadModelClass(model.get());
+        }
+
+        if (model->physicsBody != nullptr) {
+            meshCollider->attach(model->physicsBody, scale);
+        }
+
+        objects.push_back(model);
+        models.push_back(std::move(model));
+    }
+    drawListsChanged = true;
+
+    return models;
+}
+
+MeshCollider* Render::loadModelClass(Model* model) {
     // Get the name of the model class
     std::string modelClassName = typeid(*model).name();
 
     // Check if the model class has been loaded before
     if (loadedModelClasses.find(modelClassName) == loadedModelClasses.end()) {
         model->loadModelPath(&modelVertices, &modelIndices);
+        buildMeshClusters(model);
+        generateLods(model);
+
+        // Center of the bounding box and the farthest vertex from it, not
+        // the smallest sphere but close for these meshes
+        glm::vec3 low(std::numeric_limits<float>::max());
+        glm::vec3 high(-std::numeric_limits<float>::max());
+        for (const Vertex& vertex : model->vertices) {
+            low = glm::min(low, vertex.pos);
+            high = glm::max(high, vertex.pos);
+        }
+        glm::vec3 center = (low + high) * 0.5f;
+        float radius = 0.0f;
+        for (const Vertex& vertex : model->vertices) {
+            radius = std::max(radius, glm::length(vertex.pos - center));
+        }
+        meshBounds[model->getIndexOffset()] = glm::vec4(center, radius);
+
         model->setTextureId(
             vulkanSetup.createTexture(model->getTexturePath(), &commandPool));
 
+        // Generate the physics geometry of the model class from its mesh
+        meshColliders[modelClassName] =
+            std::make_unique<MeshCollider>(&physicsCommon, &shapeCache);
+        meshColliders[modelClassName]->build(model->MODEL_PATH,
+                                             model->getColliderType(),
+                                             model->vertices, model->indices);
+
         // Add the model class to the set of loaded model classes
         loadedModelClasses.insert(modelClassName);
     }
 
-    objects.push_back(std::shared_ptr<T>(model));
+    return meshColliders[modelClassName].get();
+}
 
-    return *model;
+void Render::buildMeshClusters(Model* model) {
+    auto start = std::chrono::steady_clock::now();
+
+    MeshletMesh mesh = buildMeshlets(model->vertices, model->indices);
+
+    // a few meshlets are hardly ever culled, one draw is cheaper
+    if (mesh.meshlets.size() < MIN_CLUSTER_MESHLETS) {
+        return;
+    }
+
+    // The full mesh in meshlet order, the same triangles so the colliders
+    // and the levels of detail built from it do not change
+    int indexOffset = model->getIndexOffset();
+    std::copy(mesh.indices.begin(), mesh.indices.end(),
+              modelIndices.begin() + indexOffset);
+    model->indices = mesh.indices;
+
+    MeshCluster cluster;
+    cluster.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+    cluster.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+
+    // into the shared index buffer and the arrays of every class
+    for (Meshlet meshlet : mesh.meshlets) {
+        meshlet.firstIndex += static_cast<uint32_t>(indexOffset);
+        meshlet.firstVertex += static_cast<uint32_t>(meshletVertices.size());
+        meshlet.firstTriangle +=
+            static_cast<uint32_t>(meshletTriangles.size());
+        meshlets.push_back(meshlet);
+    }
+    meshletVertices.insert(meshletVertices.end(), mesh.vertices.begin(),
+                           mesh.vertices.end());
+    meshletTriangles.insert(meshletTriangles.end(), mesh.triangles.begin(),
+                            mesh.triangles.end());
+    meshClusters[indexOffset] = cluster;
+
+    std::chrono::duration<float, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << "Render::buildMeshClusters(), " << model->MODEL_PATH << ": "
+              << mesh.meshlets.size() << " meshlets, " << elapsed.count()
+              << " ms" << std::endl;
+}
+
+void Render::generateLods(Model* model) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<LodLevel>& levels = meshLods[model->getIndexOffset()];
+    levels.clear();
+    LodLevel full;
+    full.indexOffset = static_cast<uint32_t>(model->getIndexOffset());
+    full.indicesCount = static_cast<uint32_t>(model->getIndicesCount());
+    full.error = 0.0f;
+    levels.push_back(full);
+
+    // Half the triangles of the level before. Every level is simplified
+    // from the full mesh, so its error is measured against the original.
+    size_t target = model->indices.size();
+    for (uint32_t level = 1; level < MAX_LOD_LEVELS; level++) {
+        target /= 2;
+        SimplifiedMesh mesh =
+            simplifyMesh(model->vertices, model->indices, target);
+
+        // seams and open edges can stop the simplification early, a level
+        // that saves too little is not worth its indices
+        if (mesh.indices.empty() ||
+            mesh.indices.size() > levels.back().indicesCount * 0.8) {
+            break;
+        }
+
+        LodLevel lod;
+        lod.indexOffset = static_cast<uint32_t>(modelIndices.size());
+        lod.indicesCount = static_cast<uint32_t>(mesh.indices.size());
+        // a coarser level is never chosen closer than a finer one
+        lod.error = std::max(mesh.error, levels.back().error);
+        levels.push_back(lod);
+
+        modelIndices.insert(modelIndices.end(), mesh.indices.begin(),
+                            mesh.indices.end());
+    }
+
+    std::chrono::duration<float, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::cout << "Render::generateLods(), " << model->MODEL_PATH << ":";
+    for (const LodLevel& lod : levels) {
+        std::cout << " " << lod.indicesCount / 3 << " (" << lod.error << ")";
+    }
+    std::cout << " triangles, " << elapsed.count() << " ms" << std::endl;
+}
+
+bool Render::selectLods(const std::vector<Model*>& models) {
+    PROFILE_ZONE("select lods");
+
+    bool changed = false;
+
+    // pixels per world unit at distance 1
+    float projection =
+        vulkanSetup.swapChainExtent.height /
+        (2.0f * std::tan(glm::radians(window.camera.fov) * 0.5f));
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(cameraView)[3]);
+
+    float finer = lodPixelError;
+    float coarser = lodPixelError * (1.0f - lodHysteresis);
+
+    // consecutive objects are usually of the same class
+    int lastClass = -1;
+    const std::vector<LodLevel>* levels = nullptr;
+
+    for (Model* object : models) {
+        uint32_t level = 0;
+
+        if (lodEnabled) {
+            if (object->getIndexOffset() != lastClass) {
+                lastClass = object->getIndexOffset();
+                auto it = meshLods.find(lastClass);
+                levels = it != meshLods.end() ? &it->second : nullptr;
+            }
+
+            if (levels != nullptr && levels->size() > 1) {
+                glm::vec3 scale = object->getScale();
+                float distance = std::max(
+                    glm::length(object->position - cameraPosition), 1e-3f);
+                float pixelsPerUnit =
+                    std::max(scale.x, std::max(scale.y, scale.z)) *
+                    projection / distance;
+
+                // the coarsest level that is precise enough, going coarser
+                // than the current one needs the margin
+                for (uint32_t l = levels->size() - 1; l > 0; l--) {
+                    float threshold = l > object->lodLevel ? coarser : finer;
+                    if ((*levels)[l].error * pixelsPerUnit <= threshold) {
+                        level = l;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (level != object->lodLevel) {
+            object->lodLevel = level;
+            if (level > 0) {
+                object->lodIndexOffset = (*levels)[level].indexOffset;
+                object->lodIndicesCount = (*levels)[level].indicesCount;
+            } else {
+                object->lodIndexOffset = -1;
+                object->lodIndicesCount = -1;
+            }
+            changed = true;
+        }
+
+        lodCounts[level]++;
+    }
+
+    return changed;
+}
+
+void Render::loadAllModelClasses() {
+    // Instances without a rigid body, they are only needed to load the mesh
+    // and texture of their class
+    Box box(glm::vec3(1.0f), false, glm::vec3(0.0f), false);
+    Skull skull(glm::vec3(1.0f), false, glm::vec3(0.0f), false);
+    Hatchet hatchet(glm::vec3(1.0f), false, glm::vec3(0.0f), false);
+    Commodore commodore(glm::vec3(1.0f), false, glm::vec3(0.0f), false);
+    House house(glm::vec3(1.0f), false, glm::vec3(0.0f), false);
+    Bridge bridge(glm::vec3(1.0f), false, glm::vec3(0.0f), false);
+
+    for (Model* model : std::initializer_list<Model*>{
+             &box, &skull, &hatchet, &commodore, &house, &bridge}) {
+        loadModelClass(model);
+    }
+
+    std::cout << "Render::loadAllModelClasses(), "
+              << loadedModelClasses.size() << " classes, "
+              << vulkanSetup.textures.size() << " textures" << std::endl;
+}
+
+void Render::benchmarkSceneConstruction(const std::vector<int>& counts) {
+    // Build each scene in a throwaway world so the real scene is untouched.
+    // The model classes are already loaded by `createScene`, so this only
+    // measures model, body and collider creation.
+    rp3d::PhysicsWorld* sceneWorld = world;
+    size_t sceneObjects = objects.size();
+    glm::vec3 scale = glm::vec3(0.25f, 0.25f, 0.25f);
+
+    for (int count : counts) {
+        // 100 x 100 layers of boxes
+        std::vector<glm::vec3> positions(count);
+        for (int i = 0; i < count; i++) {
+            positions[i] = glm::vec3(i % 100, i / 10000, (i / 100) % 100) *
+                           0.6f;
+        }
+
+        for (bool batched : {false, true}) {
+            createPhysicsWorld();
+
+            auto start = std::chrono::steady_clock::now();
+
+            if (batched) {
+                addModels<Box>(positions, scale, rp3d::BodyType::STATIC);
+            } else {
+                for (const glm::vec3& position : positions) {
+                    addModel<Box>(position, scale, rp3d::BodyType::STATIC);
+                }
+            }
+
+            std::chrono::duration<float, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+
+            std::cout << "scene construction, " << count << " objects, "
+                      << (batched ? "addModels: " : "addModel: ")
+                      << elapsed.count() << " ms" << std::endl;
+
+            removeModelsFrom(sceneObjects);
+            physicsCommon.destroyPhysicsWorld(world);
+        }
+    }
+
+    world = sceneWorld;
+}
+
+void Render::benchmarkSceneBvh(const std::vector<int>& counts) {
+    // boxes of the size of the scene's objects, at the same density for
+    // every count so the queries find about as many
+    const float boxesPerUnit = 0.05f;
+    const int queryCount = 1000;
+
+    auto milliseconds = [](std::chrono::steady_clock::time_point start) {
+        std::chrono::duration<float, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    };
+
+    for (int count : counts) {
+        float side = std::cbrt(count / boxesPerUnit);
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> position(0.0f, side);
+        std::uniform_real_distribution<float> size(0.1f, 1.0f);
+        std::uniform_real_distribution<float> step(-0.2f, 0.2f);
+        std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f);
+
+        std::vector<Aabb> bounds(count);
+        for (Aabb& box : bounds) {
+            glm::vec3 center(position(random), position(random),
+                             position(random));
+            glm::vec3 extent(size(random), size(random), size(random));
+            box = {center - extent, center + extent};
+        }
+
+        SceneBvh incremental;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            incremental.insert(bounds[i], static_cast<uint32_t>(i));
+        }
+        float insertTime = milliseconds(start);
+
+        SceneBvh bvh;
+        std::vector<int> proxies;
+        start = std::chrono::steady_clock::now();
+        bvh.build(bounds, proxies);
+        float buildTime = milliseconds(start);
+
+        std::cout << "scene bvh, " << count << " objects, build: "
+                  << buildTime << " ms (cost " << bvh.getCost()
+                  << ", height " << bvh.getHeight()
+                  << "), insert: " << insertTime << " ms (cost "
+                  << incremental.getCost() << ", height "
+                  << incremental.getHeight() << ")" << std::endl;
+
+        // every box moves a little, like a physics step
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            glm::vec3 offset(step(random), step(random), step(random));
+            bounds[i] = {bounds[i].min + offset, bounds[i].max + offset};
+            bvh.update(proxies[i], bounds[i]);
+        }
+        bvh.rebuildIfDegraded();
+        std::cout << "scene bvh, " << count << " objects, refit: "
+                  << milliseconds(start) << " ms (cost " << bvh.getCost()
+                  << ", " << bvh.getRebuildCount() << " rebuilds)"
+                  << std::endl;
+
+        // The same queries through the tree and as linear scans, whose
+        // results have to match
+        std::vector<uint32_t> found;
+        std::vector<uint32_t> expected;
+        size_t mismatches = 0;
+        size_t results = 0;
+        auto compare = [&]() {
+            std::sort(found.begin(), found.end());
+            if (found != expected) {
+                mismatches++;
+            }
+            results += found.size();
+            found.clear();
+            expected.clear();
+        };
+
+        glm::vec3 middle(side * 0.5f);
+        glm::mat4 projection = glm::perspective(
+            glm::radians(60.0f), 16.0f / 9.0f, 0.1f, side * 0.5f);
+        std::vector<std::array<glm::vec4, 6>> frustums(queryCount);
+        for (int q = 0; q < queryCount; q++) {
+            float yaw = 6.28318f * q / queryCount;
+            glm::vec3 front(std::cos(yaw), 0.0f, std::sin(yaw));
+            frustums[q] = getFrustumPlanes(
+                projection * glm::lookAt(middle, middle + front,
+                                         glm::vec3(0.0f, 1.0f, 0.0f)));
+        }
+
+        float linearTime = 0.0f;
+        float bvhTime = 0.0f;
+        for (const std::array<glm::vec4, 6>& planes : frustums) {
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i++) {
+                if (bounds[i].classifyFrustum(planes) >= 0) {
+                    expected.push_back(static_cast<uint32_t>(i));
+                }
+            }
+            linearTime += milliseconds(start);
+
+            start = std::chrono::steady_clock::now();
+            bvh.queryFrustum(planes, found);
+            bvhTime += milliseconds(start);
+            compare();
+        }
+        std::cout << "scene bvh, " << count << " objects, " << queryCount
+                  << " frustums: linear " << linearTime << " ms, bvh "
+                  << bvhTime << " ms (" << results / queryCount
+                  << " objects each)" << std::endl;
+
+        linearTime = 0.0f;
+        bvhTime = 0.0f;
+        results = 0;
+        size_t hits = 0;
+        for (int q = 0; q < queryCount; q++) {
+            glm::vec3 origin(position(random), position(random),
+                             position(random));
+            float yaw = angle(random);
+            float pitch = angle(random) * 0.5f;
+            glm::vec3 direction(std::cos(pitch) * std::cos(yaw),
+                                std::sin(pitch),
+                                std::cos(pitch) * std::sin(yaw));
+            glm::vec3 inverseDirection = 1.0f / direction;
+
+            start = std::chrono::steady_clock::now();
+            float nearest = side;
+            int nearestItem = -1;
+            for (int i = 0; i < count; i++) {
+                float distance;
+                if (bounds[i].intersectRay(origin, inverseDirection, nearest,
+                                           distance) &&
+                    distance < nearest) {
+                    nearest = distance;
+                    nearestItem = i;
+                }
+            }
+            linearTime += milliseconds(start);
+
+            start = std::chrono::steady_clock::now();
+            uint32_t item;
+            float distance;
+            bool hit = bvh.raycast(origin, direction, side, item, distance);
+            bvhTime += milliseconds(start);
+
+            // ties at the same distance may pick another box
+            if (hit != (nearestItem >= 0) ||
+                (hit && std::abs(distance - nearest) > 1e-4f)) {
+                mismatches++;
+            }
+            hits += hit ? 1 : 0;
+        }
+        std::cout << "scene bvh, " << count << " objects, " << queryCount
+                  << " rays: linear " << linearTime << " ms, bvh "
+                  << bvhTime << " ms (" << hits << " hits)" << std::endl;
+
+        linearTime = 0.0f;
+        bvhTime = 0.0f;
+        for (int q = 0; q < queryCount; q++) {
+            glm::vec3 center(position(random), position(random),
+                             position(random));
+            float radius = 5.0f;
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i++) {
+                if (bounds[i].overlapsSphere(center, radius)) {
+                    expected.push_back(static_cast<uint32_t>(i));
+                }
+            }
+            linearTime += milliseconds(start);
+
+            start = std::chrono::steady_clock::now();
+            bvh.querySphere(center, radius, found);
+            bvhTime += milliseconds(start);
+            compare();
+        }
+        std::cout << "scene bvh, " << count << " objects, " << queryCount
+                  << " ranges: linear " << linearTime << " ms, bvh "
+                  << bvhTime << " ms (" << results / queryCount
+                  << " objects each)" << std::endl;
+
+        if (mismatches > 0) {
+            std::cout << "scene bvh, " << count << " objects, " << mismatches
+                      << " queries differ from the linear scan" << std::endl;
+        }
+    }
+}
+
+void Render::removeModelsFrom(size_t first) {
+    for (size_t i = first; i < objects.size(); i++) {
+        if (objects[i]->bvhProxy >= 0) {
+            sceneBvh.remove(objects[i]->bvhProxy);
+            objects[i]->bvhProxy = -1;
+        }
+
+        rp3d::RigidBody* body = objects[i]->physicsBody;
+
+        if (body != nullptr) {
+            // a new model could reuse the address, which `updateDrawLists`
+            // alone would not notice
+            if (body->getType() == rp3d::BodyType::STATIC) {
+                staticGeneration++;
+            }
+
+            // give the shared shapes back before the body goes
+            MeshCollider::detach(body, &shapeCache);
+            world->destroyRigidBody(body);
+            objects[i]->physicsBody = nullptr;
+        }
+    }
+
+    if (first < objects.size()) {
+        objects.erase(objects.begin() + first, objects.end());
+        drawListsChanged = true;
+        modelGeneration++;
+    }
+    bvhObjectCount = std::min(bvhObjectCount, first);
+}
+
+Aabb Render::getWorldBounds(Model* model) {
+    glm::mat4 matrix = model->getModelMatrix();
+
+    // the box of the bounding sphere, see `recordOcclusionPasses`
+    glm::vec4 bounds = meshBounds[model->getIndexOffset()];
+    float scale = std::max(glm::length(glm::vec3(matrix[0])),
+                           std::max(glm::length(glm::vec3(matrix[1])),
+                                    glm::length(glm::vec3(matrix[2]))));
+    glm::vec3 center =
+        glm::vec3(matrix * glm::vec4(glm::vec3(bounds), 1.0f));
+    glm::vec3 extent(bounds.w * scale);
+
+    return {center - extent, center + extent};
+}
+
+void Render::updateSceneBvh() {
+    if (bvhObjectCount == objects.size()) {
+        return;
+    }
+
+    // a build is both faster and better than inserting more objects than
+    // the tree already has
+    if (objects.size() - bvhObjectCount > bvhObjectCount) {
+        std::vector<Aabb> bounds(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            bounds[i] = getWorldBounds(objects[i].get());
+        }
+
+        std::vector<int> proxies;
+        sceneBvh.build(bounds, proxies);
+        for (size_t i = 0; i < objects.size(); i++) {
+            objects[i]->bvhProxy = proxies[i];
+        }
+    } else {
+        for (size_t i = bvhObjectCount; i < objects.size(); i++) {
+            objects[i]->bvhProxy = sceneBvh.insert(
+                getWorldBounds(objects[i].get()), static_cast<uint32_t>(i));
+        }
+    }
+
+    bvhObjectCount = objects.size();
+}
+
+void Render::queryFrustum(const glm::mat4& viewProj,
+                          std::vector<Model*>& models) {
+    updateSceneBvh();
+
+    std::vector<uint32_t> items;
+    sceneBvh.queryFrustum(getFrustumPlanes(viewProj), items);
+    for (uint32_t item : items) {
+        models.push_back(objects[item].get());
+    }
+}
+
+void Render::queryRange(const glm::vec3& center, float radius,
+                        std::vector<Model*>& models) {
+    updateSceneBvh();
+
+    std::vector<uint32_t> items;
+    sceneBvh.querySphere(center, radius, items);
+    for (uint32_t item : items) {
+        models.push_back(objects[item].get());
+    }
+}
+
+Model* Render::raycast(const glm::vec3& origin, const glm::vec3& direction,
+                       float maxDistance, float& distance) {
+    updateSceneBvh();
+
+    uint32_t item;
+    if (!sceneBvh.raycast(origin, direction, maxDistance, item, distance)) {
+        return nullptr;
+    }
+    return objects[item].get();
 }
 
 void Render::createPhysicsWorld() {
@@ -143,6 +785,71 @@ void Render::createPhysicsWorld() {
 
     // Create the physics world with your settings
     world = physicsCommon.createPhysicsWorld(settings);
+
+    // collect contact statistics for the ImGui physics panel
+    world->setEventListener(&physicsProfiler);
+}
+
+void Render::updatePhysics(float timeStep) {
+    PROFILE_ZONE("physics step");
+
+    // Update the Dynamics world with a constant time step
+    {
+        PROFILE_ZONE("world update");
+        physicsProfiler.beginStep();
+        world->update(timeStep);
+        physicsProfiler.endStep(world);
+    }
+
+    PROFILE_ZONE("transform sync");
+
+    updateSceneBvh();
+
+    // For each body in the world
+    // Get the updated position of the body
+    for (int i = 0; i < objects.size(); i++) {
+        // [TODO] move all this to a function in the Model class
+        glm::mat4 currentModelMatrix = objects[i]->getModelMatrix();
+        rp3d::RigidBody* body = objects[i]->physicsBody;
+
+        const rp3d::Transform& transform = body->getTransform();
+        const rp3d::Vector3& position = transform.getPosition();
+
+        // Update position
+        currentModelMatrix[3] =
+            glm::vec4(glm::vec3(position.x, position.y, position.z), 1.0f);
+
+        // Get the orientation quaternion.
+        const rp3d::Quaternion r = transform.getOrientation();
+
+        // Convert the quaternion to a glm::quat
+        const glm::quat glm_quat(r.w, r.x, r.y, r.z);
+
+        // Convert the glm::quat to a rotation matrix
+        const glm::mat4 rotationMatrix = glm::mat4_cast(glm_quat);
+
+        // get current object scale from the current model matrix
+        glm::vec3 scale = glm::vec3(glm::length(currentModelMatrix[0]),
+                                    glm::length(currentModelMatrix[1]),
+                                    glm::length(currentModelMatrix[2]));
+
+        // Replace the rotation part of the model matrix with the new
+        // rotation matrix and re-apply the scale
+        currentModelMatrix = glm::scale(
+            glm::mat4(rotationMatrix[0], rotationMatrix[1],
+                      rotationMatrix[2], currentModelMatrix[3]),
+            scale);
+
+        objects[i]->setModelMatrix(currentModelMatrix);
+
+        // static bodies never move, their leaves stay as they are
+        if (body->getType() != rp3d::BodyType::STATIC) {
+            sceneBvh.update(objects[i]->bvhProxy,
+                            getWorldBounds(objects[i].get()));
+        }
+    }
+
+    sceneBvh.rebuildIfDegraded();
 }
 
 void Render::initVulkan() {
@@ -152,32 +859,56 @@ void Render::initVulkan() {
     vulkanSetup.createSurface();
     vulkanSetup.pickPhysicalDevice();
     vulkanSetup.createLogicalDevice();
-    vulkanSetup.createSwapChain();
+    pipelineCache.create(vulkanSetup.device, vulkanSetup.physicalDevice,
+                         PIPELINE_CACHE_FILENAME);
+    if (vulkanSetup.headless) {
+        vulkanSetup.createOffscreenImages();
+    } else {
+        vulkanSetup.createSwapChain();
+    }
     vulkanSetup.createImageViews();
     createRenderPass();
     shader.loadShaders();
     shader.createDescriptorSetLayout();
-    shader.createGraphicsPipeline();
+    shader.createPipelineLayout();
+    pipelineManager.create(vulkanSetup.device, &shader, PipelineKey());
     createCommandPool();
     vulkanSetup.createDepthResources(&commandPool);
     vulkanSetup.createFramebuffers();
 
     createPhysicsWorld();
 
-    createScene();
+    if (preloadModelClasses) {
+        loadAllModelClasses();
+    } else {
+        createScene();
+    }
 
     vulkanSetup.createVertexBuffer(&commandPool, modelVertices);
+    vulkanSetup.createPositionBuffer(&commandPool, modelVertices);
     vulkanSetup.createIndexBuffer(&commandPool, modelIndices,
                                   sizeof(modelIndices[0]) *
                                       modelIndices.size());
-    vulkanSetup.createUniformBuffers();
     vulkanSetup.createDescriptorPool();
     vulkanSetup.createDescriptorSets(&shader.descriptorSetLayout);
+    createFrameData();
+    occlusionCuller.create(&vulkanSetup, pipelineCache.cache);
+    clusterCuller.create(&vulkanSetup, &commandPool, meshlets,
+                         meshletVertices, meshletTriangles,
+                         shader.descriptorSetLayout, renderPass,
+                         pipelineCache.cache);
 
     // endof scene creation ~here or 6 lines above?
 
     createCommandBuffers();
+    createRecordingCommandBuffers();
     createSyncObjects();
+
+    gpuProfiler.create(
+        vulkanSetup.device, vulkanSetup.physicalDevice,
+        vulkanSetup.findQueueFamilies(vulkanSetup.physicalDevice)
+            .graphicsFamily.value(),
+        MAX_FRAMES_IN_FLIGHT, vulkanSetup.pipelineStatisticsSupported);
 }
 
 void Render::initImgui() {
@@ -189,14 +920,32 @@ void Render::initImgui() {
 
     ImGui::StyleColorsDark();
 
+    // The font texture is ImGui's only set, the headroom covers backends
+    // that allocate a few more
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = 8;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    poolInfo.maxSets = poolSize.descriptorCount;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+
+    if (vkCreateDescriptorPool(vulkanSetup.device, &poolInfo, nullptr,
+                               &imguiDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
     ImGui_ImplGlfw_InitForVulkan(window.window, true);
     ImGui_ImplVulkan_InitInfo init_info = {};
     init_info.Instance = vulkanSetup.instance;
     init_info.PhysicalDevice = vulkanSetup.physicalDevice;
     init_info.Device = vulkanSetup.device;
     init_info.Queue = vulkanSetup.graphicsQueue;
-    init_info.PipelineCache = VK_NULL_HANDLE;
-    init_info.DescriptorPool = vulkanSetup.descriptorPool;
+    init_info.PipelineCache = pipelineCache.cache;
+    init_info.DescriptorPool = imguiDescriptorPool;
     init_info.Subpass = 0;
     init_info.MinImageCount = 2;
     init_info.ImageCount = 2;
@@ -214,19 +963,33 @@ void Render::updateCharacterModelMatrix(glm::mat4 viewMatrix) {
 }
 
 void Render::drawFrame(FPSCamera::Matrices& matrices) {
+    PROFILE_ZONE("drawFrame");
+
+    if (vulkanSetup.headless) {
+        drawOffscreenFrame(matrices);
+        return;
+    }
+
     // https://vulkan-tutorial.com/en/Drawing_a_triangle/Drawing/Rendering_and_presentation#page_Outline-of-a-frame
     // At a high level, rendering a frame in Vulkan consists of a common set of
     // steps:
 
     //     Wait for the previous frame to finish
-    vkWaitForFences(vulkanSetup.device, 1, &inFlightFences[currentFrame],
-                    VK_TRUE, UINT64_MAX);
+    if (!frameWaited) {
+        waitForFrame();
+    }
+    frameWaited = false;
 
     //     Acquire an image from the swap chain
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(
-        vulkanSetup.device, vulkanSetup.swapChain, UINT64_MAX,
-        imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult result;
+    {
+        PROFILE_ZONE("acquire");
+        result = vkAcquireNextImageKHR(
+            vulkanSetup.device, vulkanSetup.swapChain, UINT64_MAX,
+            imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE,
+            &imageIndex);
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         vulkanSetup.recreateSwapChain(&commandPool);
@@ -241,8 +1004,11 @@ void Render::drawFrame(FPSCamera::Matrices& matrices) {
     vkResetFences(vulkanSetup.device, 1, &inFlightFences[currentFrame]);
 
     //     Record a command buffer which draws the scene onto that image
-    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-    recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    {
+        PROFILE_ZONE("record");
+        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    }
 
     //     Submit the recorded command buffer
     VkSubmitInfo submitInfo{};
@@ -260,9 +1026,12 @@ void Render::drawFrame(FPSCamera::Matrices& matrices) {
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(vulkanSetup.graphicsQueue, 1, &submitInfo,
-                      inFlightFences[currentFrame]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    {
+        PROFILE_ZONE("submit");
+        if (vkQueueSubmit(vulkanSetup.graphicsQueue, 1, &submitInfo,
+                          inFlightFences[currentFrame]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
     }
 
     //     Present the swap chain image
@@ -277,32 +1046,127 @@ void Render::drawFrame(FPSCamera::Matrices& matrices) {
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr; // Optional
 
-    result = vkQueuePresentKHR(vulkanSetup.presentQueue, &presentInfo);
+    {
+        PROFILE_ZONE("present");
+        result = vkQueuePresentKHR(vulkanSetup.presentQueue, &presentInfo);
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
-        window.framebufferResized) {
+        window.framebufferResized || vulkanSetup.swapChainSettingsChanged) {
         window.framebufferResized = false;
         vulkanSetup.recreateSwapChain(&commandPool);
     } else if (result != VK_SUCCESS) {
         throw std::runtime_error("failed to present swap chain image!");
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    framePacer.frameSubmitted(currentFrame);
+    currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void Render::waitForFrame() {
+    if (requestedFramesInFlight != framesInFlight) {
+        // nothing may be in flight while the ring changes size
+        vkDeviceWaitIdle(vulkanSetup.device);
+        framesInFlight = requestedFramesInFlight;
+        currentFrame = 0;
+
+        std::cout << "Render::waitForFrame(), " << framesInFlight
+                  << " frames in flight" << std::endl;
+    }
+
+    {
+        PROFILE_ZONE("fence wait");
+        vkWaitForFences(vulkanSetup.device, 1, &inFlightFences[currentFrame],
+                        VK_TRUE, UINT64_MAX);
+    }
+
+    framePacer.frameCompleted(currentFrame);
+
+    // nothing of this frame is pending anymore
+    frameData.reset(currentFrame);
+    readOcclusionResults(currentFrame);
+    if (clusterCulled[currentFrame]) {
+        clusterStats.visible =
+            clusterCuller.getVisibleCount(currentFrame, clusterStats.tested);
+        clusterCulled[currentFrame] = false;
+    }
+
+    if (framePacer.lowLatency && framePacer.sleepUntilPresent) {
+        PROFILE_ZONE("pacing sleep");
+        framePacer.sleepUntilPredictedStart(gpuProfiler.getTotalMs());
+    }
+
+    frameWaited = true;
+}
+
+void Render::setFramesInFlight(uint32_t count) {
+    if (count < 1 || count > MAX_FRAMES_IN_FLIGHT) {
+        throw std::runtime_error("frames in flight must be between 1 and " +
+                                 std::to_string(MAX_FRAMES_IN_FLIGHT));
+    }
+
+    // applied by the next `waitForFrame`, which is never inside a recording
+    requestedFramesInFlight = count;
+}
+
+void Render::drawOffscreenFrame(FPSCamera::Matrices& matrices) {
+    // Same as `drawFrame` minus the swap chain: every frame in flight owns
+    // one offscreen image, so there is nothing to acquire or present and the
+    // fence alone orders reuse of the image and command buffer.
+    if (!frameWaited) {
+        waitForFrame();
+    }
+    frameWaited = false;
+
+    uint32_t imageIndex = currentFrame;
+
+    updateUniformBuffer(currentFrame, matrices);
+
+    vkResetFences(vulkanSetup.device, 1, &inFlightFences[currentFrame]);
+
+    {
+        PROFILE_ZONE("record");
+        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+    PROFILE_ZONE("submit");
+    if (vkQueueSubmit(vulkanSetup.graphicsQueue, 1, &submitInfo,
+                      inFlightFences[currentFrame]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer!");
+    }
+
+    lastImageIndex = imageIndex;
+    framePacer.frameSubmitted(currentFrame);
+    currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void Render::saveLastFrame(const std::string& filename) {
+    vkDeviceWaitIdle(vulkanSetup.device);
+    vulkanSetup.saveOffscreenImage(lastImageIndex, filename, &commandPool);
 }
 
 void Render::updateUniformBuffer(uint32_t currentImage,
                                  FPSCamera::Matrices& matrices) {
+    // every object drawn this frame has to fit into its region
+    reserveFrameData(objects.size());
+
     UniformBufferObject ubo{};
 
-    ubo.model = glm::mat4(1.0f);
-    ubo.view = matrices.view;
-    ubo.proj = matrices.projection;
+    ubo.viewProj = matrices.projection * matrices.view;
+    // for the front to back order of the draws and the occlusion test
+    cameraView = matrices.view;
+    cameraProjection = matrices.projection;
+    cameraViewProj = ubo.viewProj;
 
-    // Using a UBO this way is not the most efficient way to pass frequently
-    // changing values to the shader. A more efficient way to pass a small
-    // buffer of data to shaders are push constants.
-    // https://vulkan-tutorial.com/Uniform_buffers/Descriptor_layout_and_buffer
-    memcpy(vulkanSetup.uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    // The camera has a fixed place at the start of the frame's region, so
+    // the cached static draws can bind it with the same dynamic offset
+    memcpy(frameData.getHeader(currentImage).data, &ubo, sizeof(ubo));
 }
 
 void Render::createSyncObjects() {
@@ -347,6 +1211,183 @@ void Render::createCommandBuffers() {
     }
 }
 
+void Render::createFrameData() {
+    // room for the scene as created, both grow when more objects spawn
+    VkDeviceSize instanceBytes =
+        std::max<size_t>(objects.size(), 1024) * sizeof(InstanceData);
+
+    frameData.create(vulkanSetup.device, vulkanSetup.physicalDevice,
+                     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     MAX_FRAMES_IN_FLIGHT,
+                     sizeof(UniformBufferObject) + instanceBytes,
+                     sizeof(UniformBufferObject));
+    staticInstanceData.create(
+        vulkanSetup.device, vulkanSetup.physicalDevice,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MAX_FRAMES_IN_FLIGHT,
+        instanceBytes);
+
+    frameSet =
+        vulkanSetup.descriptorAllocator.allocate(shader.frameSetLayout);
+    staticFrameSet =
+        vulkanSetup.descriptorAllocator.allocate(shader.frameSetLayout);
+    writeFrameSets();
+
+    std::cout << "Render::createFrameData(), " << frameData.getRegionSize()
+              << " bytes per frame, "
+              << (frameData.isDeviceLocal() ? "device local" : "host")
+              << " memory" << std::endl;
+}
+
+void Render::reserveFrameData(size_t instanceCount) {
+    // every recording task aligns its instances, which wastes less than
+    // one instance each, and so do the second phase's of occlusion culling
+    // and the cluster culled objects
+    size_t taskCount = recordingBuffers[currentFrame].size() + 2;
+    VkDeviceSize needed = sizeof(UniformBufferObject) +
+                          (instanceCount + taskCount) * sizeof(InstanceData);
+
+    if (needed <= frameData.getRegionSize()) {
+        return;
+    }
+
+    // the pending frames still read the old buffer
+    vkDeviceWaitIdle(vulkanSetup.device);
+    frameData.resize(std::max(needed, frameData.getRegionSize() * 2));
+    writeFrameSets();
+}
+
+void Render::writeFrameSets() {
+    DescriptorBinding cameraBinding;
+    cameraBinding.binding = 0;
+    cameraBinding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    cameraBinding.buffer = frameData.getBuffer();
+    cameraBinding.offset = 0;
+    cameraBinding.range = sizeof(UniformBufferObject);
+
+    // the whole region, the draws index it from the region start with
+    // their first instance
+    DescriptorBinding instanceBinding;
+    instanceBinding.binding = 1;
+    instanceBinding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    instanceBinding.buffer = frameData.getBuffer();
+    instanceBinding.offset = 0;
+    instanceBinding.range = frameData.getRegionSize();
+
+    vulkanSetup.descriptorAllocator.write(frameSet,
+                                          {cameraBinding, instanceBinding});
+
+    instanceBinding.buffer = staticInstanceData.getBuffer();
+    instanceBinding.range = staticInstanceData.getRegionSize();
+
+    vulkanSetup.descriptorAllocator.write(staticFrameSet,
+                                          {cameraBinding, instanceBinding});
+
+    // the static recordings were bound with the previous buffers
+    staticGeneration++;
+}
+
+void Render::createRecordingCommandBuffers() {
+    uint32_t threadCount = recordingThreads;
+    if (recordingThreads < 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Without workers the pools are still used, the draws are recorded into
+    // a secondary on the main thread when the static draws are cached
+    if (threadCount > 0) {
+        threadPool = std::make_unique<ThreadPool>(threadCount);
+    }
+    uint32_t taskCount = std::max(1u, threadCount);
+
+    QueueFamilyIndices queueFamilyIndices =
+        vulkanSetup.findQueueFamilies(vulkanSetup.physicalDevice);
+
+    // No RESET_COMMAND_BUFFER_BIT, the pools are reset as a whole every frame
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+    recordingPools.resize(MAX_FRAMES_IN_FLIGHT);
+    recordingBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    recordingDepthBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        recordingPools[frame].resize(taskCount);
+        recordingBuffers[frame].resize(taskCount);
+        recordingDepthBuffers[frame].resize(taskCount);
+
+        for (uint32_t task = 0; task < taskCount; task++) {
+            if (vkCreateCommandPool(vulkanSetup.device, &poolInfo, nullptr,
+                                    &recordingPools[frame][task]) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("failed to create command pool!");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = recordingPools[frame][task];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(vulkanSetup.device, &allocInfo,
+                                         &recordingBuffers[frame][task]) !=
+                    VK_SUCCESS ||
+                vkAllocateCommandBuffers(vulkanSetup.device, &allocInfo,
+                                         &recordingDepthBuffers[frame][task]) !=
+                    VK_SUCCESS) {
+                throw std::runtime_error(
+                    "failed to allocate command buffers!");
+            }
+        }
+    }
+
+    imguiCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = (uint32_t)imguiCommandBuffers.size();
+
+    if (vkAllocateCommandBuffers(vulkanSetup.device, &allocInfo,
+                                 imguiCommandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    // from the main pool as well, they are reset one by one and only when
+    // the static draws have to be recorded again
+    std::vector<VkCommandBuffer> staticBuffers(MAX_FRAMES_IN_FLIGHT);
+    std::vector<VkCommandBuffer> staticDepthBuffers(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateCommandBuffers(vulkanSetup.device, &allocInfo,
+                                 staticBuffers.data()) != VK_SUCCESS ||
+        vkAllocateCommandBuffers(vulkanSetup.device, &allocInfo,
+                                 staticDepthBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    clusterCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    clusterDepthCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateCommandBuffers(vulkanSetup.device, &allocInfo,
+                                 clusterCommandBuffers.data()) !=
+            VK_SUCCESS ||
+        vkAllocateCommandBuffers(vulkanSetup.device, &allocInfo,
+                                 clusterDepthCommandBuffers.data()) !=
+            VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    staticRecordings.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        staticRecordings[frame].commandBuffer = staticBuffers[frame];
+        staticRecordings[frame].depthCommandBuffer = staticDepthBuffers[frame];
+    }
+
+    std::cout << "Render::createRecordingCommandBuffers(), " << threadCount
+              << " recording threads" << std::endl;
+}
+
 void Render::recordCommandBuffer(VkCommandBuffer commandBuffer,
                                  uint32_t imageIndex) {
     VkCommandBufferBeginInfo beginInfo{};
@@ -360,6 +1401,10 @@ void Render::recordCommandBuffer(VkCommandBuffer commandBuffer,
 
     std::array<VkClearValue, 2> clearValues{};
     clearValues[0].color = {{0.0f, 0.4f, 0.5f, 1.0f}};
+    if (showOverdraw) {
+        // the added up fragments start from black
+        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    }
     clearValues[1].depthStencil = {1.0f, 0};
 
     VkRenderPassBeginInfo renderPassInfo{};
@@ -372,11 +1417,866 @@ void Render::recordCommandBuffer(VkCommandBuffer commandBuffer,
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
+    // query resets are not allowed inside the render pass
+    gpuProfiler.beginFrame(commandBuffer, currentFrame);
+
+    // The instances have to match the vertex shader of the pipeline that is
+    // bound, so until a variant has compiled the default one is used with
+    // its instance data instead of standing in for it
+    PipelineKey key = getPipelineKey();
+    if (key.shaderVariant != ViewProjectionVariant &&
+        !pipelineManager.isReady(key)) {
+        // starts the compile
+        pipelineManager.get(key);
+        key.shaderVariant = ViewProjectionVariant;
+    }
+
+    // The colors after a depth pre-pass only pass the depth test with it,
+    // so until both pipelines have compiled the frame is drawn without
+    frameDepthPipeline = VK_NULL_HANDLE;
+    if (key.depthCompareOp == VK_COMPARE_OP_EQUAL) {
+        PipelineKey depthKey = getDepthPipelineKey(key);
+        if (pipelineManager.isReady(key) &&
+            pipelineManager.isReady(depthKey)) {
+            frameDepthPipeline = pipelineManager.get(depthKey);
+        } else {
+            // starts the compiles
+            pipelineManager.get(key);
+            pipelineManager.get(depthKey);
+            key.depthCompareOp = VK_COMPARE_OP_LESS;
+            key.depthWrite = true;
+        }
+    }
+
+    // looked up once here, the workers only read them
+    framePipeline = pipelineManager.get(key);
+    frameShaderVariant = key.shaderVariant;
+
+    // the cluster culled objects leave the other lists while it is on
+    bool clusters = clusterCulling && clusterCuller.isSupported();
+    if (clusters != clusterListsEnabled) {
+        clusterListsEnabled = clusters;
+        drawListsChanged = true;
+    }
+    updateDrawLists();
+
+    // the model-view-projections change with the camera, the static
+    // instances would have to be written every frame
+    bool cacheStatic = staticGeometryCaching && !staticObjects.empty() &&
+                       frameShaderVariant != MvpVariant;
+    // the depth pre-pass has to be complete before the first color draw,
+    // the secondaries keep the two apart
+    bool secondaries = (parallelRecording && threadPool) || cacheStatic ||
+                       frameDepthPipeline != VK_NULL_HANDLE;
+
+    // The cached static draws keep the levels they were recorded with, so
+    // they are recorded again when one changes
+    lodCounts.fill(0);
+    if (cacheStatic && selectLods(staticObjects)) {
+        staticGeneration++;
+    }
+    const std::vector<Model*>& listed =
+        cacheStatic ? dynamicObjects : drawObjects;
+    selectLods(listed);
+
+    // Only the full meshes are in meshlet order, the cluster culled objects
+    // at a coarser level are drawn like any other
+    std::vector<Model*> lodDraws;
+    clusterDraws.clear();
+    selectLods(clusterObjects);
+    for (Model* object : clusterObjects) {
+        if (object->lodLevel == 0) {
+            clusterDraws.push_back(object);
+        } else {
+            lodDraws.push_back(object);
+        }
+    }
+    if (!lodDraws.empty()) {
+        lodDraws.insert(lodDraws.begin(), listed.begin(), listed.end());
+    }
+    const std::vector<Model*>& models = lodDraws.empty() ? listed : lodDraws;
+
+    bool occlusion = occlusionCulling && occlusionCuller.isSupported();
+    if (occlusion) {
+        // what the last test saw is drawn first, the rest is tested
+        std::vector<Model*> earlyDraws;
+        earlyDraws.reserve(models.size());
+        lateDraws.clear();
+        for (Model* object : models) {
+            if (object->occlusionVisible) {
+                earlyDraws.push_back(object);
+            } else {
+                lateDraws.push_back(object);
+            }
+        }
+        sortDrawList(earlyDraws, true, frameDraws);
+    } else {
+        sortDrawList(models, true, frameDraws);
+    }
+
+    recordClusterCull(commandBuffer, key);
+
+    if (occlusion) {
+        recordOcclusionPasses(commandBuffer, renderPassInfo, imageIndex,
+                              secondaries, cacheStatic);
+    } else if (secondaries) {
+        // Only secondary command buffers may record into a render pass begun
+        // with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, so the geometry
+        // pass is timed around the whole render pass, ImGui included
+        gpuProfiler.beginPass(commandBuffer, GpuProfiler::GeometryPass,
+                              vulkanSetup.inheritedQueriesSupported);
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        recordSecondaries(commandBuffer, imageIndex, cacheStatic);
+    } else {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_INLINE);
+
+        gpuProfiler.beginPass(commandBuffer, GpuProfiler::GeometryPass);
+        drawStats = recordDraws(commandBuffer, frameDraws, 0,
+                                frameDraws.size(), frameData, frameSet);
+        drawStats += recordClusterDraws(commandBuffer);
+        gpuProfiler.endPass(commandBuffer, GpuProfiler::GeometryPass);
+
+        if (state.paused) {
+            recordImgui(commandBuffer);
+        }
+    }
+
+    if (!occlusion) {
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    if (secondaries || occlusion) {
+        gpuProfiler.endPass(commandBuffer, GpuProfiler::GeometryPass);
+    }
+
+    if (clusterCulled[currentFrame] && frameMeshShaders) {
+        clusterCuller.finishMeshTasks(commandBuffer, currentFrame);
+    }
+
+    drawCallCount = drawStats.draws;
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+
+void Render::recordOcclusionPasses(VkCommandBuffer commandBuffer,
+                                   VkRenderPassBeginInfo renderPassInfo,
+                                   uint32_t imageIndex, bool secondaries,
+                                   bool cacheStatic) {
+    renderPassInfo.renderPass = earlyRenderPass;
+
+    // The culling runs between the two render passes, so the geometry pass
+    // is timed around both of them
+    gpuProfiler.beginPass(commandBuffer, GpuProfiler::GeometryPass,
+                          !secondaries ||
+                              vulkanSetup.inheritedQueriesSupported);
+
+    // the first phase, the secondaries use the compatible `renderPass`
+    if (secondaries) {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        recordSecondaries(commandBuffer, imageIndex, cacheStatic, false);
+    } else {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                             VK_SUBPASS_CONTENTS_INLINE);
+        drawStats = recordDraws(commandBuffer, frameDraws, 0,
+                                frameDraws.size(), frameData, frameSet);
+        drawStats += recordClusterDraws(commandBuffer);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    // Every object of the second phase gets an instance of its own, which
+    // its indirect draw points to
+    InstanceData* instances = nullptr;
+    uint32_t firstInstance = 0;
+    if (!lateDraws.empty()) {
+        FrameRingBuffer::Allocation allocation = frameData.allocate(
+            currentFrame, lateDraws.size() * sizeof(InstanceData),
+            sizeof(InstanceData));
+        instances = static_cast<InstanceData*>(allocation.data);
+        firstInstance =
+            static_cast<uint32_t>(allocation.offset / sizeof(InstanceData));
+    }
+
+    // The objects of the second phase come first since they get draws,
+    // those of the first are only tested for the next frame
+    std::vector<Model*>& tested = occlusionTested[currentFrame];
+    tested.clear();
+    tested.insert(tested.end(), lateDraws.begin(), lateDraws.end());
+    tested.insert(tested.end(), frameDraws.begin(), frameDraws.end());
+    occlusionGenerations[currentFrame] = modelGeneration;
+
+    cullObjects.resize(tested.size());
+    for (size_t i = 0; i < tested.size(); i++) {
+        Model* object = tested[i];
+        glm::mat4 model = object->getModelMatrix();
+
+        // the largest scale of the model matrix scales the radius
+        glm::vec4 bounds = meshBounds[object->getIndexOffset()];
+        float scale = std::max(glm::length(glm::vec3(model[0])),
+                               std::max(glm::length(glm::vec3(model[1])),
+                                        glm::length(glm::vec3(model[2]))));
+
+        OcclusionCuller::Object& cullObject = cullObjects[i];
+        cullObject.sphere = glm::vec4(
+            glm::vec3(model * glm::vec4(glm::vec3(bounds), 1.0f)),
+            bounds.w * scale);
+        cullObject.indexCount = object->getDrawIndicesCount();
+        cullObject.firstIndex = object->getDrawIndexOffset();
+        cullObject.vertexOffset = object->getVertexOffset();
+        cullObject.firstInstance = firstInstance + static_cast<uint32_t>(i);
+
+        if (i < lateDraws.size()) {
+            instances[i] = getInstanceData(object);
+        }
+    }
+
+    {
+        PROFILE_ZONE("occlusion cull");
+        occlusionCuller.cull(commandBuffer, currentFrame, cullObjects,
+                             static_cast<uint32_t>(lateDraws.size()),
+                             cameraView, cameraProjection);
+    }
+
+    // the second phase, drawn inline on top of the first
+    renderPassInfo.renderPass = lateRenderPass;
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
                          VK_SUBPASS_CONTENTS_INLINE);
 
+    // one indirect command per object, hidden ones draw no instance
+    if (frameDepthPipeline != VK_NULL_HANDLE) {
+        bindDrawState(commandBuffer, frameData, frameSet, true);
+        occlusionCuller.drawLate(commandBuffer, currentFrame);
+        drawStats.draws += static_cast<uint32_t>(lateDraws.size());
+    }
+    bindDrawState(commandBuffer, frameData, frameSet);
+    occlusionCuller.drawLate(commandBuffer, currentFrame);
+    drawStats.draws += static_cast<uint32_t>(lateDraws.size());
+
+    if (state.paused) {
+        recordImgui(commandBuffer);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    occlusionStats.early = static_cast<uint32_t>(frameDraws.size());
+    occlusionStats.late = static_cast<uint32_t>(lateDraws.size());
+}
+
+void Render::recordClusterCull(VkCommandBuffer commandBuffer,
+                               const PipelineKey& key) {
+    clusterCulled[currentFrame] = false;
+    if (clusterDraws.empty()) {
+        return;
+    }
+
+    PROFILE_ZONE("cluster cull");
+
+    // the mesh shader pipeline has the default rasterization and depth
+    // test, and no depth pre-pass
+    frameMeshShaders = meshShaders && clusterCuller.isMeshShaderSupported() &&
+                       key.polygonMode == VK_POLYGON_MODE_FILL &&
+                       frameDepthPipeline == VK_NULL_HANDLE && !key.overdraw;
+
+    // Without mesh shaders every object gets an instance of its own, which
+    // the indirect draws of its meshlets point to
+    InstanceData* instances = nullptr;
+    uint32_t firstInstance = 0;
+    if (!frameMeshShaders) {
+        FrameRingBuffer::Allocation allocation = frameData.allocate(
+            currentFrame, clusterDraws.size() * sizeof(InstanceData),
+            sizeof(InstanceData));
+        instances = static_cast<InstanceData*>(allocation.data);
+        firstInstance =
+            static_cast<uint32_t>(allocation.offset / sizeof(InstanceData));
+    }
+
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(cameraView)[3]);
+
+    clusterCullObjects.resize(clusterDraws.size());
+    uint32_t commandCount = 0;
+    for (size_t i = 0; i < clusterDraws.size(); i++) {
+        Model* object = clusterDraws[i];
+        const MeshCluster& cluster = meshClusters[object->getIndexOffset()];
+        glm::mat4 model = object->getModelMatrix();
+
+        // the largest scale of the model matrix scales the radii
+        float scale = std::max(glm::length(glm::vec3(model[0])),
+                               std::max(glm::length(glm::vec3(model[1])),
+                                        glm::length(glm::vec3(model[2]))));
+
+        ClusterCuller::Object& cullObject = clusterCullObjects[i];
+        cullObject.model = model;
+        cullObject.modelViewProj = multiplyMatrices(cameraViewProj, model);
+        // the normal cones stay in model space
+        cullObject.camera = glm::vec4(
+            glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f)),
+            scale);
+        cullObject.firstMeshlet = cluster.firstMeshlet;
+        cullObject.meshletCount = cluster.meshletCount;
+        cullObject.firstCommand = commandCount;
+        cullObject.firstInstance = firstInstance + static_cast<uint32_t>(i);
+        cullObject.vertexOffset = object->getVertexOffset();
+        cullObject.textureIndex = object->getTextureId();
+        commandCount += cluster.meshletCount;
+
+        if (instances != nullptr) {
+            instances[i] = getInstanceData(object);
+        }
+    }
+
+    // the wireframe shows the back faces
+    clusterCuller.cull(commandBuffer, currentFrame, clusterCullObjects,
+                       commandCount, cameraViewProj,
+                       key.cullMode != VK_CULL_MODE_NONE, frameMeshShaders);
+    clusterCulled[currentFrame] = true;
+    clusterStats.meshShaders = frameMeshShaders;
+}
+
+DrawStats Render::recordClusterDraws(VkCommandBuffer commandBuffer,
+                                     VkCommandBuffer depthCommandBuffer) {
+    DrawStats stats;
+    if (!clusterCulled[currentFrame]) {
+        return stats;
+    }
+
+    stats.instances = static_cast<uint32_t>(clusterDraws.size());
+
+    // a single draw launches the task shaders of every object
+    if (frameMeshShaders) {
+        clusterCuller.drawMeshTasks(commandBuffer, currentFrame,
+                                    vulkanSetup.textureDescriptorSet,
+                                    vulkanSetup.swapChainExtent);
+        stats.pipelineBinds++;
+        stats.draws++;
+        return stats;
+    }
+
+    // an indirect command per meshlet, culled ones draw no instance
+    const ClusterCuller::Object& last = clusterCullObjects.back();
+    uint32_t commandCount = last.firstCommand + last.meshletCount;
+
+    if (depthCommandBuffer != VK_NULL_HANDLE) {
+        bindDrawState(depthCommandBuffer, frameData, frameSet, true);
+        clusterCuller.draw(depthCommandBuffer, currentFrame);
+        stats.pipelineBinds++;
+        stats.draws += commandCount;
+    }
+    bindDrawState(commandBuffer, frameData, frameSet);
+    clusterCuller.draw(commandBuffer, currentFrame);
+    stats.pipelineBinds++;
+    stats.draws += commandCount;
+
+    return stats;
+}
+
+void Render::readOcclusionResults(uint32_t frame) {
+    std::vector<Model*>& tested = occlusionTested[frame];
+    if (tested.empty()) {
+        return;
+    }
+
+    // removed objects leave dangling pointers, and growing the buffers
+    // drops the results
+    size_t count = 0;
+    const uint32_t* visibility = occlusionCuller.getVisibility(frame, count);
+    if (occlusionGenerations[frame] == modelGeneration &&
+        visibility != nullptr && count == tested.size()) {
+        uint32_t occluded = 0;
+        for (size_t i = 0; i < count; i++) {
+            tested[i]->occlusionVisible = visibility[i] != 0;
+            if (visibility[i] == 0) {
+                occluded++;
+            }
+        }
+
+        occlusionStats.tested = static_cast<uint32_t>(count);
+        occlusionStats.occluded = occluded;
+    }
+
+    tested.clear();
+}
+
+PipelineKey Render::getPipelineKey() {
+    PipelineKey key;
+
+    if (state.wireframe && vulkanSetup.fillModeNonSolidSupported) {
+        key.polygonMode = VK_POLYGON_MODE_LINE;
+        // the back faces are part of the wireframe
+        key.cullMode = VK_CULL_MODE_NONE;
+    }
+
+    if (cpuMvp) {
+        key.shaderVariant = MvpVariant;
+    }
+
+    // lines would not match the depth of the filled triangles
+    if (depthPrepass && key.polygonMode == VK_POLYGON_MODE_FILL) {
+        key.depthCompareOp = VK_COMPARE_OP_EQUAL;
+        key.depthWrite = false;
+    }
+
+    if (showOverdraw) {
+        key.overdraw = true;
+    }
+
+    return key;
+}
+
+PipelineKey Render::getDepthPipelineKey(const PipelineKey& key) {
+    // same rasterization and vertex shader variant, so the depths match
+    PipelineKey depthKey = key;
+    depthKey.vertexLayout = PositionVertexLayout;
+    depthKey.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthKey.depthWrite = true;
+    depthKey.blend = false;
+    depthKey.overdraw = false;
+    return depthKey;
+}
+
+void Render::updateDrawLists() {
+    if (!drawListsChanged) {
+        return;
+    }
+    drawListsChanged = false;
+
+    std::vector<Model*> previousStatic;
+    previousStatic.swap(staticObjects);
+
+    drawObjects.clear();
+    dynamicObjects.clear();
+    clusterObjects.clear();
+
+    for (const std::shared_ptr<Model>& object : objects) {
+        // up to as many as one dispatch can test
+        if (clusterListsEnabled &&
+            meshClusters.count(object->getIndexOffset()) > 0 &&
+            clusterObjects.size() < ClusterCuller::MAX_OBJECTS) {
+            clusterObjects.push_back(object.get());
+            continue;
+        }
+
+        drawObjects.push_back(object.get());
+
+        // static bodies never move, so their model matrix is fixed
+        rp3d::RigidBody* body = object->physicsBody;
+        if (body != nullptr && body->getType() == rp3d::BodyType::STATIC) {
+            staticObjects.push_back(object.get());
+        } else {
+            dynamicObjects.push_back(object.get());
+        }
+    }
+
+    // spawning or clearing dynamic objects keeps the static recordings
+    if (staticObjects != previousStatic) {
+        staticGeneration++;
+    }
+}
+
+const Render::StaticRecording& Render::getStaticCommandBuffer() {
+    StaticRecording& recording = staticRecordings[currentFrame];
+    VkQueryPipelineStatisticFlags statistics =
+        gpuProfiler.getActiveStatistics();
+
+    if (recording.recorded &&
+        recording.staticGeneration == staticGeneration &&
+        recording.swapChainGeneration == vulkanSetup.swapChainGeneration &&
+        recording.pipeline == framePipeline &&
+        recording.depthPipeline == frameDepthPipeline &&
+        recording.statistics == statistics) {
+        return recording;
+    }
+
+    PROFILE_ZONE("record static draws");
+
+    VkDeviceSize instanceBytes = staticObjects.size() * sizeof(InstanceData);
+    if (instanceBytes > staticInstanceData.getRegionSize()) {
+        // the other frames' recordings read the old buffer, and are
+        // recorded again since `writeFrameSets` bumps the generation
+        vkDeviceWaitIdle(vulkanSetup.device);
+        staticInstanceData.resize(
+            std::max(instanceBytes, staticInstanceData.getRegionSize() * 2));
+        writeFrameSets();
+    }
+
+    // The framebuffer is left out so the same recording works for every
+    // swap chain image. No ONE_TIME_SUBMIT_BIT since it is submitted again
+    // every time this frame in flight comes around, and only one primary
+    // ever uses it at a time, so SIMULTANEOUS_USE_BIT is not needed either.
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+    inheritanceInfo.pipelineStatistics = statistics;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    bool prepass = frameDepthPipeline != VK_NULL_HANDLE;
+    VkCommandBuffer depthBuffer =
+        prepass ? recording.depthCommandBuffer : VK_NULL_HANDLE;
+
+    // the frame's fence was waited on, so it is no longer pending
+    vkResetCommandBuffer(recording.commandBuffer, 0);
+    if (vkBeginCommandBuffer(recording.commandBuffer, &beginInfo) !=
+        VK_SUCCESS) {
+        throw std::runtime_error(
+            "failed to begin recording secondary command buffer!");
+    }
+    if (prepass) {
+        vkResetCommandBuffer(depthBuffer, 0);
+        if (vkBeginCommandBuffer(depthBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "failed to begin recording secondary command buffer!");
+        }
+    }
+
+    // sorted by state only, their depth order changes with the camera
+    std::vector<Model*> sortedStatic;
+    sortDrawList(staticObjects, false, sortedStatic);
+    staticInstanceData.reset(currentFrame);
+    recording.stats = recordDraws(recording.commandBuffer, sortedStatic, 0,
+                                  sortedStatic.size(), staticInstanceData,
+                                  staticFrameSet, depthBuffer);
+
+    if (vkEndCommandBuffer(recording.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record secondary command buffer!");
+    }
+    if (prepass && vkEndCommandBuffer(depthBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record secondary command buffer!");
+    }
+
+    recording.recorded = true;
+    recording.staticGeneration = staticGeneration;
+    recording.swapChainGeneration = vulkanSetup.swapChainGeneration;
+    recording.pipeline = framePipeline;
+    recording.depthPipeline = frameDepthPipeline;
+    recording.statistics = statistics;
+    staticRecordCount++;
+
+    return recording;
+}
+
+void Render::recordSecondaries(VkCommandBuffer commandBuffer,
+                               uint32_t imageIndex, bool cacheStatic,
+                               bool imgui) {
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = vulkanSetup.swapChainFramebuffers[imageIndex];
+    inheritanceInfo.pipelineStatistics = gpuProfiler.getActiveStatistics();
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    std::vector<VkCommandPool>& pools = recordingPools[currentFrame];
+    std::vector<VkCommandBuffer>& buffers = recordingBuffers[currentFrame];
+    std::vector<VkCommandBuffer>& depthBuffers =
+        recordingDepthBuffers[currentFrame];
+    bool prepass = frameDepthPipeline != VK_NULL_HANDLE;
+
+    // the depth pre-pass goes in front of everything else
+    std::vector<VkCommandBuffer> depthSecondaries;
+    std::vector<VkCommandBuffer> secondaryBuffers;
+    drawStats = DrawStats();
+
+    if (cacheStatic) {
+        const StaticRecording& recording = getStaticCommandBuffer();
+        if (prepass) {
+            depthSecondaries.push_back(recording.depthCommandBuffer);
+        }
+        secondaryBuffers.push_back(recording.commandBuffer);
+        drawStats += recording.stats;
+    }
+
+    const std::vector<Model*>& models = frameDraws;
+    bool parallel = parallelRecording && threadPool;
+
+    // Contiguous ranges of objects, one per task. Small scenes use fewer
+    // tasks since waking a worker costs more than recording a few draws.
+    size_t taskCount = (models.size() + MIN_OBJECTS_PER_TASK - 1) /
+                       MIN_OBJECTS_PER_TASK;
+    // no task at all without objects
+    taskCount = std::min(taskCount, parallel ? buffers.size() : 1);
+    size_t objectsPerTask =
+        taskCount > 0 ? (models.size() + taskCount - 1) / taskCount : 0;
+
+    std::vector<DrawStats> taskStats(taskCount);
+
+    auto recordTask = [&](size_t task) {
+        PROFILE_ZONE("record draws");
+
+        // Every task owns its pool, so no two threads ever touch the same
+        // one, and the frame's fence was waited on before recording
+        vkResetCommandPool(vulkanSetup.device, pools[task], 0);
+
+        if (vkBeginCommandBuffer(buffers[task], &beginInfo) != VK_SUCCESS ||
+            (prepass && vkBeginCommandBuffer(depthBuffers[task],
+                                             &beginInfo) != VK_SUCCESS)) {
+            throw std::runtime_error(
+                "failed to begin recording secondary command buffer!");
+        }
+
+        size_t first = std::min(task * objectsPerTask, models.size());
+        size_t last = std::min(first + objectsPerTask, models.size());
+        taskStats[task] =
+            recordDraws(buffers[task], models, first, last, frameData,
+                        frameSet, prepass ? depthBuffers[task]
+                                          : VK_NULL_HANDLE);
+
+        if (vkEndCommandBuffer(buffers[task]) != VK_SUCCESS ||
+            (prepass && vkEndCommandBuffer(depthBuffers[task]) !=
+                            VK_SUCCESS)) {
+            throw std::runtime_error(
+                "failed to record secondary command buffer!");
+        }
+    };
+
+    // The workers write into `taskStats` and read the locals above, so an
+    // exception of this thread only unwinds them once the workers are done
+    try {
+        for (size_t task = 0; task < taskCount; task++) {
+            if (parallel) {
+                threadPool->submit([&, task] { recordTask(task); });
+            } else {
+                recordTask(task);
+            }
+        }
+
+        secondaryBuffers.insert(secondaryBuffers.end(), buffers.begin(),
+                                buffers.begin() + taskCount);
+        if (prepass) {
+            depthSecondaries.insert(depthSecondaries.end(),
+                                    depthBuffers.begin(),
+                                    depthBuffers.begin() + taskCount);
+        }
+
+        // so are the cluster draws, which are a few indirect draws at most
+        if (clusterCulled[currentFrame]) {
+            VkCommandBuffer clusterBuffer = clusterCommandBuffers[currentFrame];
+            VkCommandBuffer clusterDepthBuffer =
+                prepass ? clusterDepthCommandBuffers[currentFrame]
+                        : VK_NULL_HANDLE;
+
+            vkResetCommandBuffer(clusterBuffer, 0);
+            if (prepass) {
+                vkResetCommandBuffer(clusterDepthBuffer, 0);
+            }
+            if (vkBeginCommandBuffer(clusterBuffer, &beginInfo) != VK_SUCCESS ||
+                (prepass && vkBeginCommandBuffer(clusterDepthBuffer,
+                                                 &beginInfo) != VK_SUCCESS)) {
+                throw std::runtime_error(
+                    "failed to begin recording secondary command buffer!");
+            }
+
+            drawStats += recordClusterDraws(clusterBuffer, clusterDepthBuffer);
+
+            if (vkEndCommandBuffer(clusterBuffer) != VK_SUCCESS ||
+                (prepass && vkEndCommandBuffer(clusterDepthBuffer) !=
+                                VK_SUCCESS)) {
+                throw std::runtime_error(
+                    "failed to record secondary command buffer!");
+            }
+
+            secondaryBuffers.push_back(clusterBuffer);
+            if (prepass) {
+                depthSecondaries.push_back(clusterDepthBuffer);
+            }
+        }
+
+        // ImGui is recorded on this thread while the workers record the draws
+        if (imgui && state.paused) {
+            VkCommandBuffer imguiBuffer = imguiCommandBuffers[currentFrame];
+
+            vkResetCommandBuffer(imguiBuffer, 0);
+            if (vkBeginCommandBuffer(imguiBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error(
+                    "failed to begin recording secondary command buffer!");
+            }
+
+            recordImgui(imguiBuffer);
+
+            if (vkEndCommandBuffer(imguiBuffer) != VK_SUCCESS) {
+                throw std::runtime_error(
+                    "failed to record secondary command buffer!");
+            }
+
+            secondaryBuffers.push_back(imguiBuffer);
+        }
+    } catch (...) {
+        if (parallel) {
+            // this thread's exception is the one reported
+            try {
+                threadPool->wait();
+            } catch (...) {
+            }
+        }
+        throw;
+    }
+
+    if (parallel) {
+        PROFILE_ZONE("wait for workers");
+        threadPool->wait();
+    }
+
+    secondaryBuffers.insert(secondaryBuffers.begin(),
+                            depthSecondaries.begin(), depthSecondaries.end());
+
+    if (!secondaryBuffers.empty()) {
+        vkCmdExecuteCommands(commandBuffer,
+                             static_cast<uint32_t>(secondaryBuffers.size()),
+                             secondaryBuffers.data());
+    }
+
+    for (const DrawStats& stats : taskStats) {
+        drawStats += stats;
+    }
+}
+
+void Render::sortDrawList(const std::vector<Model*>& models, bool byDepth,
+                          std::vector<Model*>& sorted) {
+    sorted.resize(models.size());
+
+    if (!drawSorting) {
+        std::copy(models.begin(), models.end(), sorted.begin());
+        return;
+    }
+
+    PROFILE_ZONE("sort draws");
+
+    // one pipeline per frame so far, see `getPipelineKey`
+    const uint32_t pipeline = 0;
+
+    renderQueue.clear();
+    for (size_t i = 0; i < models.size(); i++) {
+        Model* object = models[i];
+
+        float depth = 0.0f;
+        if (byDepth) {
+            // distance along the view direction, negative behind the camera
+            depth = -(cameraView * glm::vec4(object->position, 1.0f)).z;
+        }
+
+        uint64_t key = RenderQueue::makeKey(
+            pipeline, object->getTextureId(),
+            renderQueue.getMeshId(object->getDrawIndexOffset()), depth);
+        renderQueue.push(key, static_cast<uint32_t>(i));
+    }
+
+    renderQueue.sort();
+
+    const std::vector<RenderQueue::Item>& items = renderQueue.getItems();
+    for (size_t i = 0; i < items.size(); i++) {
+        sorted[i] = models[items[i].index];
+    }
+}
+
+DrawStats Render::recordDraws(VkCommandBuffer commandBuffer,
+                              const std::vector<Model*>& models, size_t first,
+                              size_t last, FrameRingBuffer& instanceBuffer,
+                              VkDescriptorSet set,
+                              VkCommandBuffer depthCommandBuffer) {
+    DrawStats stats;
+
+    bindDrawState(commandBuffer, instanceBuffer, set);
+    stats.pipelineBinds++;
+    if (depthCommandBuffer != VK_NULL_HANDLE) {
+        bindDrawState(depthCommandBuffer, instanceBuffer, set, true);
+        stats.pipelineBinds++;
+    }
+
+    if (first == last) {
+        return stats;
+    }
+
+    // One allocation for the whole range, aligned to the instance size so
+    // its offset is an instance index. No per-draw allocation or push.
+    FrameRingBuffer::Allocation allocation = instanceBuffer.allocate(
+        currentFrame, (last - first) * sizeof(InstanceData),
+        sizeof(InstanceData));
+    InstanceData* instances = static_cast<InstanceData*>(allocation.data);
+    uint32_t firstInstance =
+        static_cast<uint32_t>(allocation.offset / sizeof(InstanceData));
+
+    // [todo] have a `drawNode` func?
+    // https://github.com/SaschaWillems/Vulkan/blob/master/examples/gltfscenerendering/gltfscenerendering.cpp#L239
+
+    int lastTexture = -1;
+    int lastMesh = -1;
+    // first object of the instanced draw being gathered
+    size_t drawStart = first;
+
+    for (size_t i = first; i < last; i++) {
+        Model* object = models[i];
+
+        int texture = object->getTextureId();
+        if (texture != lastTexture) {
+            lastTexture = texture;
+            stats.textureChanges++;
+        }
+
+        // every mesh is in the same buffers, nothing to bind
+        if (object->getDrawIndexOffset() != lastMesh) {
+            lastMesh = object->getDrawIndexOffset();
+            stats.meshChanges++;
+        }
+
+        // Whole instances in order, the memory may be write-combined and
+        // is never read back
+        instances[i - first] = getInstanceData(object);
+
+        // Objects sharing mesh and texture become one instanced draw, which
+        // the sorted order makes the common case. The texture has to match
+        // as well to keep its index the same for the whole draw.
+        Model* next = i + 1 < last ? models[i + 1] : nullptr;
+        if (next != nullptr && next->getDrawIndexOffset() == lastMesh &&
+            next->getDrawIndicesCount() == object->getDrawIndicesCount() &&
+            next->getVertexOffset() == object->getVertexOffset() &&
+            next->getTextureId() == texture) {
+            continue;
+        }
+
+        uint32_t instanceCount = static_cast<uint32_t>(i + 1 - drawStart);
+        uint32_t drawInstance =
+            firstInstance + static_cast<uint32_t>(drawStart - first);
+        vkCmdDrawIndexed(commandBuffer, object->getDrawIndicesCount(),
+                         instanceCount, object->getDrawIndexOffset(),
+                         object->getVertexOffset(), drawInstance);
+        stats.draws++;
+        stats.instances += instanceCount;
+
+        // the pre-pass reads the same instances
+        if (depthCommandBuffer != VK_NULL_HANDLE) {
+            vkCmdDrawIndexed(depthCommandBuffer, object->getDrawIndicesCount(),
+                             instanceCount, object->getDrawIndexOffset(),
+                             object->getVertexOffset(), drawInstance);
+            stats.draws++;
+        }
+
+        drawStart = i + 1;
+    }
+
+    return stats;
+}
+
+void Render::bindDrawState(VkCommandBuffer commandBuffer,
+                           FrameRingBuffer& instanceBuffer,
+                           VkDescriptorSet set, bool depth) {
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      shader.graphicsPipeline);
+                      depth ? frameDepthPipeline : framePipeline);
 
     VkViewport viewport{};
     viewport.x = 0.0f;
@@ -392,98 +2292,261 @@ void Render::recordCommandBuffer(VkCommandBuffer commandBuffer,
     scissor.extent = vulkanSetup.swapChainExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    VkBuffer vertexBuffers[] = {vulkanSetup.vertexBuffer};
+    // the pre-pass only reads the positions, packed on their own
+    VkBuffer vertexBuffers[] = {depth ? vulkanSetup.positionBuffer
+                                      : vulkanSetup.vertexBuffer};
     VkDeviceSize offsets[] = {0};
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
     vkCmdBindIndexBuffer(commandBuffer, vulkanSetup.indexBuffer, 0,
                          VK_INDEX_TYPE_UINT32);
 
-    // [todo] have a `drawNode` func?
-    // https://github.com/SaschaWillems/Vulkan/blob/master/examples/gltfscenerendering/gltfscenerendering.cpp#L239
-
-    uint32_t indexCount;
-    for (std::shared_ptr<Model>& object : objects) {
-        int descriptorSetOffset = 0;
-        if (currentFrame == 1) {
-            descriptorSetOffset = vulkanSetup.textures.size();
-        }
-        vkCmdBindDescriptorSets(
-            commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-            shader.pipelineLayout, 0, 1,
-            &vulkanSetup
-                 .descriptorSets[descriptorSetOffset + object->getTextureId()],
-            0, nullptr);
-
-        const glm::mat4 modelMatrix = object->getModelMatrix();
+    // Every texture is in set 0, set 1 holds the camera and the instances.
+    // Both are bound once per command buffer.
+    std::array<VkDescriptorSet, 2> descriptorSets = {
+        vulkanSetup.textureDescriptorSet, set};
+    std::array<uint32_t, 2> dynamicOffsets = {
+        static_cast<uint32_t>(frameData.getRegionOffset(currentFrame)),
+        static_cast<uint32_t>(instanceBuffer.getRegionOffset(currentFrame))};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            shader.pipelineLayout, 0,
+                            static_cast<uint32_t>(descriptorSets.size()),
+                            descriptorSets.data(),
+                            static_cast<uint32_t>(dynamicOffsets.size()),
+                            dynamicOffsets.data());
+}
 
-        vkCmdPushConstants(commandBuffer, shader.pipelineLayout,
-                           VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4),
-                           &modelMatrix);
+InstanceData Render::getInstanceData(Model* object) {
+    InstanceData instance{};
+    instance.transform =
+        frameShaderVariant == MvpVariant
+            ? multiplyMatrices(cameraViewProj, object->getModelMatrix())
+            : object->getModelMatrix();
+    instance.textureIndex = object->getTextureId();
+    return instance;
+}
 
-        vkCmdDrawIndexed(commandBuffer, object->getIndicesCount(), 1,
-                         object->getIndexOffset(), object->getVertexOffset(),
-                         0);
-    }
+void Render::recordImgui(VkCommandBuffer commandBuffer) {
+    gpuProfiler.beginPass(commandBuffer, GpuProfiler::ImguiPass);
 
-    if (state.paused) {
-        ImGui_ImplVulkan_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+    ImGui_ImplVulkan_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
 
-        bool show_demo_window = true;
-        bool show_another_window = false;
-        ImVec4 clear_color = ImVec4(0.0f, 0.4f, 0.5f, 1.0f);
+    bool show_demo_window = true;
+    bool show_another_window = false;
+    ImVec4 clear_color = ImVec4(0.0f, 0.4f, 0.5f, 1.0f);
 
-        static int counter = 0;
+    static int counter = 0;
 
-        // Set ImGui window to span the width of the Vulkan window with a slim margin
-        float margin = 8.0f; // slim margin
-        ImGui::SetNextWindowPos(ImVec2(margin, margin));
-        ImGui::SetNextWindowSize(ImVec2(
-            vulkanSetup.swapChainExtent.width - 2 * margin,
-            0 // auto height
-        ));
-        ImGui::Begin("state");
+    // Set ImGui window to span the width of the Vulkan window with a slim margin
+    float margin = 8.0f; // slim margin
+    ImGui::SetNextWindowPos(ImVec2(margin, margin));
+    ImGui::SetNextWindowSize(ImVec2(
+        vulkanSetup.swapChainExtent.width - 2 * margin,
+        0 // auto height
+    ));
+    ImGui::Begin("state");
 
     ImGui::SliderFloat("spawn velocity", &state.newObjectVelocity, 0.0f, 75.0f, "%.1f");
     ImGui::SliderFloat("spawn mass", &state.newObjectMass, 0.0f, 40.0f, "%.1f");
     ImGui::SliderFloat("spawn scale", &state.newObjectScale, 0.0f, 2.0f, "%.1f");
     ImGui::SliderFloat("camera speed", &state.movementSpeed, 0.1f, 20.0f, "%.2f");
-        // ImGui::ColorEdit3("clear color", (float*)&clear_color); // Edit 3 floats representing a color
+    // ImGui::ColorEdit3("clear color", (float*)&clear_color); // Edit 3 floats representing a color
 
-        ImGui::Text("Boxes = %d", state.noBoxes);
+    ImGui::Text("Boxes = %d", state.noBoxes);
+    ImGui::SameLine();
+    if (ImGui::Button("Clear boxes")) {
+        state.clearSpawnedObjects = true;
+    }
+    ImGui::Text("Collision shapes = %zu (%zu colliders)",
+                shapeCache.getShapeCount(),
+                shapeCache.getReferenceCount());
 
-        if (ImGui::Button("Reset FOV")) {
-            window.camera.fov = 60.0f;
-            window.camera.updateFOV(0);
-        }
+    if (ImGui::Button("Reset FOV")) {
+        window.camera.fov = 60.0f;
+        window.camera.updateFOV(0);
+    }
+    ImGui::SameLine();
+    if (ImGui::SliderFloat("Camera FOV (60.0)", &window.camera.fov, 10.0f, 145.0f, "%.1f")) {
+        window.camera.updateFOV(0);
+    }
+
+    ImGui::Checkbox("wireframe", &state.wireframe);
+    if (!pipelineManager.isReady(getPipelineKey())) {
         ImGui::SameLine();
-        if (ImGui::SliderFloat("Camera FOV (60.0)", &window.camera.fov, 10.0f, 145.0f, "%.1f")) {
-            window.camera.updateFOV(0);
+        ImGui::Text("(compiling)");
+    }
+    ImGui::Text("Pipelines = %zu (%zu compiling)",
+                pipelineManager.getPipelineCount(),
+                pipelineManager.getPendingCount());
+    ImGui::Text("Descriptor pools = %zu",
+                vulkanSetup.descriptorAllocator.getPoolCount());
+
+    if (ImGui::CollapsingHeader("cpu profiler")) {
+        Profiler::get().drawImgui();
+
+        if (ImGui::Button("Export Chrome trace")) {
+            Profiler::get().exportChromeTrace("profile_trace.json");
         }
 
-        // ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
-        ImGui::End();
+        if (threadPool) {
+            char label[64];
+            snprintf(label, sizeof(label), "parallel recording (%u threads)",
+                     threadPool->getThreadCount());
+            ImGui::Checkbox(label, &parallelRecording);
+        }
 
-        // ImGui::ShowDemoWindow();
+        ImGui::Checkbox("cache static draws", &staticGeometryCaching);
+        ImGui::Text("Static objects = %zu (recorded %u times)",
+                    staticObjects.size(), staticRecordCount);
 
-        // ImGui::End();
+        // the cached static draws keep the order they were recorded in
+        if (ImGui::Checkbox("sort draws", &drawSorting)) {
+            staticGeneration++;
+        }
+        ImGui::Checkbox("cpu model-view-projection", &cpuMvp);
+        if (cpuMvp && frameShaderVariant != MvpVariant) {
+            ImGui::SameLine();
+            ImGui::Text("(unavailable)");
+        }
+        ImGui::Text("State changes = %u pipeline, %u texture, %u mesh for "
+                    "%u draws (%u instances)",
+                    drawStats.pipelineBinds, drawStats.textureChanges,
+                    drawStats.meshChanges, drawStats.draws,
+                    drawStats.instances);
+        ImGui::Checkbox("level of detail", &lodEnabled);
+        ImGui::SliderFloat("lod pixel error", &lodPixelError, 0.1f, 16.0f,
+                           "%.1f");
+        ImGui::SliderFloat("lod hysteresis", &lodHysteresis, 0.0f, 0.9f,
+                           "%.2f");
+        ImGui::Text("Lod instances = %u / %u / %u / %u", lodCounts[0],
+                    lodCounts[1], lodCounts[2], lodCounts[3]);
+        ImGui::Checkbox("occlusion culling", &occlusionCulling);
+        if (!occlusionCuller.isSupported()) {
+            ImGui::SameLine();
+            ImGui::Text("(unavailable)");
+        }
+        ImGui::Text("Occluded = %u of %u tested (%u first phase, %u second)",
+                    occlusionStats.occluded, occlusionStats.tested,
+                    occlusionStats.early, occlusionStats.late);
+        ImGui::Checkbox("cluster culling", &clusterCulling);
+        if (!clusterCuller.isSupported()) {
+            ImGui::SameLine();
+            ImGui::Text("(unavailable)");
+        }
+        ImGui::Checkbox("mesh shaders", &meshShaders);
+        if (!clusterCuller.isMeshShaderSupported()) {
+            ImGui::SameLine();
+            ImGui::Text("(unavailable)");
+        }
+        ImGui::Text("Clusters = %u visible of %u tested (%s)",
+                    clusterStats.visible, clusterStats.tested,
+                    clusterStats.meshShaders ? "mesh shaders"
+                                             : "indirect draws");
+        ImGui::Checkbox("depth pre-pass", &depthPrepass);
+        if (depthPrepass && frameDepthPipeline == VK_NULL_HANDLE) {
+            ImGui::SameLine();
+            // compiling, or a shader is missing
+            ImGui::Text(state.wireframe ? "(off in wireframe)" : "(not ready)");
+        }
+        ImGui::Checkbox("show overdraw", &showOverdraw);
+        ImGui::Text("Frame data = %.0f KB per frame (%s)",
+                    frameData.getRegionSize() / 1024.0,
+                    frameData.isDeviceLocal() ? "device local" : "host");
+
+        std::vector<Model*> inFrustum;
+        queryFrustum(cameraViewProj, inFrustum);
+        ImGui::Text("Scene bvh = %zu objects, height %d, cost %.1f, %u "
+                    "rebuilds",
+                    sceneBvh.size(), sceneBvh.getHeight(),
+                    sceneBvh.getCost(), sceneBvh.getRebuildCount());
+        ImGui::Text("In the frustum = %zu objects", inFrustum.size());
+
+        // the object in the middle of the view
+        glm::mat4 inverseView = glm::inverse(cameraView);
+        float distance;
+        Model* picked = raycast(glm::vec3(inverseView[3]),
+                                -glm::normalize(glm::vec3(inverseView[2])),
+                                1000.0f, distance);
+        if (picked != nullptr) {
+            ImGui::Text("Looking at = %s, %.1f away",
+                        picked->MODEL_PATH.c_str(), distance);
+        } else {
+            ImGui::Text("Looking at = nothing");
+        }
+    }
 
-        // Rendering
-        ImGui::Render();
-        ImDrawData* draw_data = ImGui::GetDrawData();
+    if (ImGui::CollapsingHeader("frame pacing")) {
+        int frames = requestedFramesInFlight;
+        if (ImGui::SliderInt("frames in flight", &frames, 1,
+                             MAX_FRAMES_IN_FLIGHT)) {
+            setFramesInFlight(frames);
+        }
+        ImGui::Checkbox("low latency", &framePacer.lowLatency);
+        if (framePacer.lowLatency) {
+            ImGui::SameLine();
+            ImGui::Checkbox("sleep until present",
+                            &framePacer.sleepUntilPresent);
+        }
+        framePacer.drawImgui();
+    }
 
-        // Record dear imgui primitives into command buffer
-        ImGui_ImplVulkan_RenderDrawData(draw_data, commandBuffer);
+    if (ImGui::CollapsingHeader("swap chain")) {
+        // only modes the surface supports are offered
+        const char* current =
+            VulkanSetup::getPresentModeName(vulkanSetup.presentMode);
+        if (ImGui::BeginCombo("present mode", current)) {
+            for (VkPresentModeKHR mode : vulkanSetup.availablePresentModes) {
+                bool selected = mode == vulkanSetup.presentMode;
+                if (ImGui::Selectable(VulkanSetup::getPresentModeName(mode),
+                                      selected)) {
+                    vulkanSetup.preferredPresentMode = mode;
+                    vulkanSetup.swapChainSettingsChanged = true;
+                }
+            }
+            ImGui::EndCombo();
+        }
+
+        // without a surface limit offer a few more than the minimum
+        int imageCount = vulkanSetup.swapChainImageCount;
+        int maxImageCount = vulkanSetup.maxImageCount > 0
+                                ? vulkanSetup.maxImageCount
+                                : vulkanSetup.minImageCount + 3;
+        if (ImGui::SliderInt("swap chain images", &imageCount,
+                             vulkanSetup.minImageCount, maxImageCount)) {
+            vulkanSetup.preferredImageCount = imageCount;
+            vulkanSetup.swapChainSettingsChanged = true;
+        }
     }
 
+    if (ImGui::CollapsingHeader("gpu profiler")) {
+        gpuProfiler.drawImgui(ImGui::GetIO().DeltaTime * 1000.0f);
+    }
 
-    vkCmdEndRenderPass(commandBuffer);
+    if (ImGui::CollapsingHeader("physics")) {
+        physicsProfiler.drawImgui();
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+        if (ImGui::Button("Dump physics CSV")) {
+            physicsProfiler.dumpCsv("physics_profile.csv");
+        }
     }
+
+    // ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+    ImGui::End();
+
+    // ImGui::ShowDemoWindow();
+
+    // ImGui::End();
+
+    // Rendering
+    ImGui::Render();
+    ImDrawData* draw_data = ImGui::GetDrawData();
+
+    // Record dear imgui primitives into command buffer
+    ImGui_ImplVulkan_RenderDrawData(draw_data, commandBuffer);
+
+    gpuProfiler.endPass(commandBuffer, GpuProfiler::ImguiPass);
 }
 
 void Render::createCommandPool() {
@@ -503,18 +2566,35 @@ void Render::createCommandPool() {
 }
 
 void Render::createRenderPass() {
+    renderPass = createRenderPass(false, false);
+    earlyRenderPass = createRenderPass(false, true);
+    lateRenderPass = createRenderPass(true, false);
+}
+
+VkRenderPass Render::createRenderPass(bool load, bool store) {
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = vulkanSetup.swapChainImageFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.loadOp =
+        load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.initialLayout =
+        load ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+             : VK_IMAGE_LAYOUT_UNDEFINED;
+    // offscreen images are only ever copied out after rendering, a pass
+    // that is continued leaves it ready for the next one
+    if (store) {
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    } else {
+        colorAttachment.finalLayout =
+            vulkanSetup.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                 : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
 
     VkAttachmentReference colorAttachmentRef{};
     // index of the attachment description array
@@ -525,11 +2605,16 @@ void Render::createRenderPass() {
     VkAttachmentDescription depthAttachment{};
     depthAttachment.format = vulkanSetup.findDepthFormat();
     depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.loadOp =
+        load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // `OcclusionCuller` reads the depth of the first phase
+    depthAttachment.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE
+                                    : VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.initialLayout =
+        load ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+             : VK_IMAGE_LAYOUT_UNDEFINED;
     depthAttachment.finalLayout =
         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
@@ -557,6 +2642,16 @@ void Render::createRenderPass() {
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
                                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+    if (load) {
+        // the first phase's writes, its depth went through a barrier of
+        // `OcclusionCuller::cull` already
+        dependency.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+    }
+
     std::array<VkAttachmentDescription, 2> attachments = {colorAttachment,
                                                           depthAttachment};
     VkRenderPassCreateInfo renderPassInfo{};
@@ -568,21 +2663,53 @@ void Render::createRenderPass() {
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
+    VkRenderPass pass;
     if (vkCreateRenderPass(vulkanSetup.device, &renderPassInfo, nullptr,
-                           &renderPass) != VK_SUCCESS) {
+                           &pass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create render pass!");
     }
+
+    return pass;
 }
 
 void Render::cleanup() {
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    // ImGui's backends are never initialised without a window
+    if (!vulkanSetup.headless) {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+    }
+    // the context goes on both paths, should one have been created
+    if (ImGui::GetCurrentContext() != nullptr) {
+        ImGui::DestroyContext();
+    }
 
-    shader.destroyGraphicsPipeline();
+    pipelineManager.destroy();
     shader.destroyPipelineLayout();
 
+    if (imguiDescriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(vulkanSetup.device, imguiDescriptorPool,
+                                nullptr);
+    }
+    frameData.destroy();
+    staticInstanceData.destroy();
+
+    // ImGui's pipeline was created with the cache by `initImgui` as well.
+    // A failed save only costs the next start its warm cache, the rest
+    // still has to be destroyed.
+    try {
+        pipelineCache.save();
+    } catch (const std::exception& exception) {
+        std::cerr << "Render::cleanup(), pipeline cache not saved: "
+                  << exception.what() << std::endl;
+    }
+    pipelineCache.destroy();
+
+    occlusionCuller.destroy();
+    clusterCuller.destroy();
+
     vkDestroyRenderPass(vulkanSetup.device, renderPass, nullptr);
+    vkDestroyRenderPass(vulkanSetup.device, earlyRenderPass, nullptr);
+    vkDestroyRenderPass(vulkanSetup.device, lateRenderPass, nullptr);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(vulkanSetup.device, imageAvailableSemaphores[i],
@@ -592,8 +2719,32 @@ void Render::cleanup() {
         vkDestroyFence(vulkanSetup.device, inFlightFences[i], nullptr);
     }
 
+    // joins the workers before their pools go away
+    threadPool.reset();
+    for (std::vector<VkCommandPool>& pools : recordingPools) {
+        for (VkCommandPool pool : pools) {
+            vkDestroyCommandPool(vulkanSetup.device, pool, nullptr);
+        }
+    }
+
     vkDestroyCommandPool(vulkanSetup.device, commandPool, nullptr);
 
+    gpuProfiler.destroy();
+
     shader.cleanup();
     vulkanSetup.cleanup();
 }
+
+// The templates are defined in this file, so every model class spawned from
+// elsewhere (Application, Benchmark) is instantiated here
+#define INSTANTIATE_ADD_MODEL(T)                                               \
+    template T Render::addModel<T>(glm::vec3, glm::vec3, rp3d::BodyType);      \
+    template std::vector<std::shared_ptr<T>> Render::addModels<T>(             \
+        const std::vector<glm::vec3>&, glm::vec3, rp3d::BodyType);
+
+INSTANTIATE_ADD_MODEL(Box)
+INSTANTIATE_ADD_MODEL(Bridge)
+INSTANTIATE_ADD_MODEL(Commodore)
+INSTANTIATE_ADD_MODEL(Hatchet)
+INSTANTIATE_ADD_MODEL(House)
+INSTANTIATE_ADD_MODEL(Skull)
@@ -1,17 +1,33 @@
 #pragma once
 
-#include <memory>        // std::shared_ptr
+#include <array>         // std::array
+#include <memory>        // std::shared_ptr, std::unique_ptr
+#include <unordered_map> // std::unordered_map
 #include <unordered_set> // std::unordered_set
 #include <vector>        // std::vector
 
 #include <reactphysics3d/reactphysics3d.h>
 #include <vulkan/vulkan.h>
 
+#include "ClusterCuller.hpp"
+#include "DescriptorAllocator.hpp"
 #include "FPSCamera.hpp"
+#include "FramePacer.hpp"
+#include "FrameRingBuffer.hpp"
+#include "GpuProfiler.hpp"
+#include "MeshCollider.hpp"
 #include "Models/Model.hpp"
 #include "Models/Rover.hpp"
+#include "OcclusionCuller.hpp"
+#include "PhysicsProfiler.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineManager.hpp"
+#include "RenderQueue.hpp"
+#include "SceneBvh.hpp"
+#include "ShapeCache.hpp"
 #include "Shader.hpp"
 #include "State.hpp"
+#include "ThreadPool.hpp"
 #include "VulkanSetup.hpp"
 
 class Render {
@@ -20,7 +36,9 @@ class Render {
   public:
     VkRenderPass renderPass;
     VulkanSetup vulkanSetup;
+    PipelineCache pipelineCache;
     Shader shader;
+    PipelineManager pipelineManager;
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
@@ -28,22 +46,112 @@ class Render {
     std::vector<uint32_t> modelIndices;
 
     std::vector<std::shared_ptr<Model>> objects;
+    // objects created by `createScene`, everything after was spawned at runtime
+    size_t sceneObjectCount = 0;
 
     rp3d::PhysicsCommon physicsCommon;
     rp3d::PhysicsWorld* world;
+    PhysicsProfiler physicsProfiler;
+    GpuProfiler gpuProfiler;
+    FramePacer framePacer;
+    ShapeCache shapeCache = ShapeCache(&physicsCommon);
+
+    // One simplified mesh is generated at load time for each further level
+    // of detail, its indices are appended to `modelIndices` and use the
+    // class's vertices
+    static constexpr uint32_t MAX_LOD_LEVELS = 4;
 
     std::unordered_set<std::string> loadedModelClasses;
+    std::unordered_map<std::string, std::unique_ptr<MeshCollider>>
+        meshColliders;
 
     gameState& state;
 
+    // Load every model class instead of building the default scene, so any
+    // scene can be spawned later without touching the vertex buffer. Has to
+    // be set before `initVulkan`, used by Benchmark.
+    bool preloadModelClasses = false;
+    // draw calls recorded for the last frame
+    uint32_t drawCallCount = 0;
+    // state changes of the last frame, the cached static draws included
+    DrawStats drawStats;
+    // Order the draws by `RenderQueue` key instead of by `objects`
+    bool drawSorting = true;
+    // Multiply every instance's model-view-projection on the CPU and use
+    // `MvpVariant`, which leaves one matrix-vector product per vertex for
+    // vertex bound scenes. Turns off `staticGeometryCaching`.
+    bool cpuMvp = false;
+    // Draw every instance with the coarsest level of detail whose error
+    // projects to at most `lodPixelError` pixels. A finer level is only left
+    // again once its error is below `lodPixelError * (1 - lodHysteresis)`,
+    // so objects at the threshold distance do not pop back and forth.
+    bool lodEnabled = true;
+    float lodPixelError = 1.0f;
+    float lodHysteresis = 0.25f;
+    // instances drawn with each level of detail in the last frame
+    std::array<uint32_t, MAX_LOD_LEVELS> lodCounts{};
+    // Draw the depth of every object first, from the positions alone and
+    // without a fragment shader, then the colors with EQUAL and no depth
+    // writes, so every pixel is shaded once however much the objects
+    // overlap. Costs a second vertex pass and is off in wireframe.
+    bool depthPrepass = false;
+    // Draw every shaded fragment in the same color, added up, instead of
+    // its texture. See `PipelineKey::overdraw`.
+    bool showOverdraw = false;
+    // Skip objects hidden behind others with `OcclusionCuller`, the objects
+    // drawn every frame are tested and the cached static draws occlude
+    // them. Needs a depth format that can be sampled.
+    bool occlusionCulling = true;
+    struct OcclusionStats {
+        // objects of the last test read back, and those it hid
+        uint32_t tested = 0;
+        uint32_t occluded = 0;
+        // objects of the last frame drawn by the first phase, and tested
+        // for the second one
+        uint32_t early = 0;
+        uint32_t late = 0;
+    };
+    OcclusionStats occlusionStats;
+    // Split the meshes of big model classes into meshlets at load time and
+    // skip those facing away from the camera or outside of the frustum with
+    // `ClusterCuller`. Only objects drawn with their full mesh are culled
+    // by meshlet, coarser levels of detail are drawn whole.
+    bool clusterCulling = true;
+    // Test and draw the meshlets with task and mesh shaders where
+    // VK_EXT_mesh_shader is supported. Only with the default rasterization,
+    // without a depth pre-pass and without the overdraw view.
+    bool meshShaders = true;
+    struct ClusterStats {
+        // meshlets of the last test read back, and those drawn
+        uint32_t tested = 0;
+        uint32_t visible = 0;
+        // the last frame drew them with mesh shaders
+        bool meshShaders = false;
+    };
+    ClusterStats clusterStats;
+
+    // Worker threads recording the draws into secondary command buffers, 0
+    // records everything on the main thread and negative uses one per core.
+    // Has to be set before `initVulkan`.
+    int recordingThreads = -1;
+    // can be switched off at runtime if there are workers
+    bool parallelRecording = true;
+    // Record the draws of static bodies once into a secondary command buffer
+    // per frame in flight and replay them until the static set, the swap
+    // chain or the pipeline changes, so only dynamic objects are recorded
+    // every frame.
+    bool staticGeometryCaching = true;
+
     Render(Window& window, gameState& state)
         : window(window), vulkanSetup(window, &renderPass),
-          shader(&vulkanSetup.device, &renderPass), state(state) {}
+          shader(&vulkanSetup.device, &renderPass, &pipelineCache.cache),
+          state(state) {}
 
     void initVulkan();
     void initImgui();
 
     void createCommandPool();
+    // `renderPass` and the two phases of occlusion culling, all compatible
     void createRenderPass();
     void createSyncObjects();
     void createCommandBuffers();
@@ -52,22 +160,278 @@ class Render {
   T addModel(glm::vec3 position,
          glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f),
          rp3d::BodyType bodyType = rp3d::BodyType::DYNAMIC);
+    // Spawns one model per position, all sharing `scale` and `bodyType`.
+    // Prefer this over repeated `addModel` calls for large numbers of models.
+    template <typename T>
+    std::vector<std::shared_ptr<T>>
+    addModels(const std::vector<glm::vec3>& positions,
+              glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f),
+              rp3d::BodyType bodyType = rp3d::BodyType::DYNAMIC);
+    void benchmarkSceneConstruction(const std::vector<int>& counts);
+    // Times the scene BVH against linear scans on synthetic boxes
+    void benchmarkSceneBvh(const std::vector<int>& counts);
+    void removeModelsFrom(size_t first);
+
+    // Queries of the world bounds of the objects, through `sceneBvh`
+    void queryFrustum(const glm::mat4& viewProj, std::vector<Model*>& models);
+    void queryRange(const glm::vec3& center, float radius,
+                    std::vector<Model*>& models);
+    // The object whose bounds the ray enters first, null if none within
+    // `maxDistance`
+    Model* raycast(const glm::vec3& origin, const glm::vec3& direction,
+                   float maxDistance, float& distance);
     void drawFrame(FPSCamera::Matrices& matrices);
+    // Blocks until the current frame in flight can be recorded again.
+    // `drawFrame` calls it unless it already happened this frame, the low
+    // latency mode calls it before input is sampled.
+    void waitForFrame();
+    // 1 to MAX_FRAMES_IN_FLIGHT, takes effect with the next frame
+    void setFramesInFlight(uint32_t count);
+    uint32_t getFramesInFlight() const { return framesInFlight; }
+    // Headless mode only, writes the most recently rendered frame as PNG
+    void saveLastFrame(const std::string& filename);
     void updateUniformBuffer(uint32_t currentImage,
                              FPSCamera::Matrices& matrices);
     void createPhysicsWorld();
+    // Advances the world by one fixed step and copies the body transforms
+    // into the model matrices
+    void updatePhysics(float timeStep);
     void createScene();
+    void loadAllModelClasses();
     void cleanup();
 
     void updateCharacterModelMatrix(glm::mat4 viewMatrix);
 
+    // 0 if the draws are recorded on the main thread
+    uint32_t getRecordingThreadCount() const {
+        return threadPool && parallelRecording ? threadPool->getThreadCount()
+                                               : 0;
+    }
+    size_t getStaticObjectCount() const { return staticObjects.size(); }
+
   private:
     std::vector<VkFence> inFlightFences;
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
 
     uint32_t currentFrame = 0;
+    uint32_t lastImageIndex = 0;
+
+    uint32_t framesInFlight = 2;
+    uint32_t requestedFramesInFlight = 2;
+    // set by `waitForFrame`, cleared when the frame is drawn
+    bool frameWaited = false;
+
+    // variant for the frame being recorded, see `getPipelineKey`
+    VkPipeline framePipeline = VK_NULL_HANDLE;
+    // the `ShaderVariant` of `framePipeline`
+    uint32_t frameShaderVariant = ViewProjectionVariant;
+    // depth pre-pass of the frame being recorded, null without one
+    VkPipeline frameDepthPipeline = VK_NULL_HANDLE;
+    // view and view-projection of the frame being recorded
+    glm::mat4 cameraView = glm::mat4(1.0f);
+    glm::mat4 cameraViewProj = glm::mat4(1.0f);
+
+    // A part of the shared index buffer and the largest distance, in model
+    // space, of its surface from the full mesh
+    struct LodLevel {
+        uint32_t indexOffset;
+        uint32_t indicesCount;
+        float error;
+    };
+    // The levels of every model class by the index offset of its full mesh,
+    // level 0 is the full mesh and the errors only grow
+    std::unordered_map<int, std::vector<LodLevel>> meshLods;
+    void generateLods(Model* model);
+    // Picks the level of every model for the current camera, true if any
+    // changed
+    bool selectLods(const std::vector<Model*>& models);
+
+    // The first phase of occlusion culling clears and keeps both
+    // attachments for the second, which draws on top
+    VkRenderPass earlyRenderPass = VK_NULL_HANDLE;
+    VkRenderPass lateRenderPass = VK_NULL_HANDLE;
+    VkRenderPass createRenderPass(bool load, bool store);
+
+    OcclusionCuller occlusionCuller;
+    // Bounding sphere of every model class by the index offset of its full
+    // mesh, in model space
+    std::unordered_map<int, glm::vec4> meshBounds;
+    // The objects of each frame's test in the order of its results, and the
+    // `modelGeneration` they were taken at
+    std::array<std::vector<Model*>, MAX_FRAMES_IN_FLIGHT> occlusionTested;
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> occlusionGenerations{};
+    // bumped when objects are removed, the tested pointers may dangle
+    uint64_t modelGeneration = 0;
+    // objects left to the second phase and what is tested this frame
+    std::vector<Model*> lateDraws;
+    std::vector<OcclusionCuller::Object> cullObjects;
+    // projection of the frame being recorded
+    glm::mat4 cameraProjection = glm::mat4(1.0f);
+
+    // Over the world bounds of `objects`, whose indices are its items.
+    // Objects are only appended or removed from the end, so the indices
+    // stay valid.
+    SceneBvh sceneBvh;
+    // the objects in `sceneBvh` are the first ones
+    size_t bvhObjectCount = 0;
+    // adds the objects appended since the last call
+    void updateSceneBvh();
+    Aabb getWorldBounds(Model* model);
+
+    // fewest meshlets of a model class worth culling one by one
+    static constexpr size_t MIN_CLUSTER_MESHLETS = 8;
+    struct MeshCluster {
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+    };
+    ClusterCuller clusterCuller;
+    // The meshlets of every cluster class by the index offset of its full
+    // mesh, whose indices are in meshlet order
+    std::unordered_map<int, MeshCluster> meshClusters;
+    // of every cluster class, uploaded by `initVulkan`
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+    void buildMeshClusters(Model* model);
+    // The objects of cluster classes, left out of the other draw lists
+    // while `clusterListsEnabled`
+    std::vector<Model*> clusterObjects;
+    bool clusterListsEnabled = false;
+    // those of the frame at their full mesh, and what they are tested with
+    std::vector<Model*> clusterDraws;
+    std::vector<ClusterCuller::Object> clusterCullObjects;
+    // the frame being recorded goes through the mesh shaders
+    bool frameMeshShaders = false;
+    // a test of the frame is pending, read back by `waitForFrame`
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> clusterCulled{};
+    // secondaries for the cluster draws and their depth twins
+    std::vector<VkCommandBuffer> clusterCommandBuffers;
+    std::vector<VkCommandBuffer> clusterDepthCommandBuffers;
+    // Tests the meshlets of `clusterDraws` for the frame drawn with `key`,
+    // outside of a render pass
+    void recordClusterCull(VkCommandBuffer commandBuffer,
+                           const PipelineKey& key);
+    // Records the draws of the last `recordClusterCull`, unless it is null
+    // the same draws go into `depthCommandBuffer` with `frameDepthPipeline`
+    DrawStats
+    recordClusterDraws(VkCommandBuffer commandBuffer,
+                       VkCommandBuffer depthCommandBuffer = VK_NULL_HANDLE);
+    // Applies the results of `frame`'s test once its fence signalled
+    void readOcclusionResults(uint32_t frame);
+    // Records both phases of occlusion culling with the framebuffer and
+    // clear values of `renderPassInfo`, `frameDraws` is the first phase
+    void recordOcclusionPasses(VkCommandBuffer commandBuffer,
+                               VkRenderPassBeginInfo renderPassInfo,
+                               uint32_t imageIndex, bool secondaries,
+                               bool cacheStatic);
+
+    RenderQueue renderQueue;
+    // the objects recorded this frame in draw order, the static ones are
+    // left out while they are cached
+    std::vector<Model*> frameDraws;
+
+    // fewest objects a recording task is started for
+    static constexpr size_t MIN_OBJECTS_PER_TASK = 512;
+
+    std::unique_ptr<ThreadPool> threadPool;
+    // [frame][task], every task records into its own pool and buffer
+    std::vector<std::vector<VkCommandPool>> recordingPools;
+    std::vector<std::vector<VkCommandBuffer>> recordingBuffers;
+    // the same draws for the depth pre-pass, from the same pools
+    std::vector<std::vector<VkCommandBuffer>> recordingDepthBuffers;
+    // ImGui has to be a secondary as well when the draws are
+    std::vector<VkCommandBuffer> imguiCommandBuffers;
+    // ImGui frees its sets one by one, which the shared allocator's pools
+    // do not allow
+    VkDescriptorPool imguiDescriptorPool = VK_NULL_HANDLE;
+
+    // The camera (header) and the instances of every frame, a region is
+    // reset by `waitForFrame` once the frame's fence signalled
+    FrameRingBuffer frameData;
+    // Instances of the cached static draws, a region is only written when
+    // the static draws of its frame are recorded again
+    FrameRingBuffer staticInstanceData;
+    // Set 1 of the draws recorded every frame, and of the static draws with
+    // their instances from `staticInstanceData`. The dynamic offsets select
+    // the region of the frame.
+    VkDescriptorSet frameSet = VK_NULL_HANDLE;
+    VkDescriptorSet staticFrameSet = VK_NULL_HANDLE;
+    void createFrameData();
+    // Grows `frameData` if `instanceCount` instances might not fit, before
+    // anything of the frame is written into it
+    void reserveFrameData(size_t instanceCount);
+    // Points the frame sets at the current ring buffers
+    void writeFrameSets();
+
+    // `objects` split by body type, rebuilt by `updateDrawLists` only after
+    // objects were added or removed
+    std::vector<Model*> drawObjects;
+    std::vector<Model*> staticObjects;
+    std::vector<Model*> dynamicObjects;
+    bool drawListsChanged = true;
+    // bumped whenever `staticObjects` or the buffers its draws read change
+    uint64_t staticGeneration = 0;
+
+    // The static draws of one frame in flight and the state they were
+    // recorded with, recorded again as soon as any of it differs
+    struct StaticRecording {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // only recorded with a depth pre-pass
+        VkCommandBuffer depthCommandBuffer = VK_NULL_HANDLE;
+        bool recorded = false;
+        uint64_t staticGeneration = 0;
+        uint32_t swapChainGeneration = 0;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkPipeline depthPipeline = VK_NULL_HANDLE;
+        VkQueryPipelineStatisticFlags statistics = 0;
+        DrawStats stats;
+    };
+    std::vector<StaticRecording> staticRecordings;
+    // times the static draws were recorded, shown in the pause menu
+    uint32_t staticRecordCount = 0;
+
+    void drawOffscreenFrame(FPSCamera::Matrices& matrices);
 
+    void createRecordingCommandBuffers();
+    // pipeline variant for the current render state
+    PipelineKey getPipelineKey();
+    // the depth pre-pass in front of the color pipeline `key`
+    static PipelineKey getDepthPipelineKey(const PipelineKey& key);
     void recordCommandBuffer(VkCommandBuffer commandBuffer,
                              uint32_t imageIndex);
+    void updateDrawLists();
+    // Splits `frameDraws` across the thread pool (if any), executes the
+    // secondary command buffers and records ImGui meanwhile unless `imgui`
+    // is false. With `cacheStatic` the static objects come from
+    // `getStaticCommandBuffer`. With a depth pre-pass every recording has
+    // a depth twin, and all of those are executed before the colors.
+    void recordSecondaries(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                           bool cacheStatic, bool imgui = true);
+    // Records the static draws of the current frame in flight again if
+    // anything they depend on changed
+    const StaticRecording& getStaticCommandBuffer();
+    // `models` ordered by `RenderQueue` key into `sorted`, `byDepth` adds
+    // the front to back order within the same state
+    void sortDrawList(const std::vector<Model*>& models, bool byDepth,
+                      std::vector<Model*>& sorted);
+    // Records the draws of `models[first, last)`, their instances are
+    // written into the current frame's region of `instanceBuffer`, which
+    // `set` points to. Unless it is null the same draws go into
+    // `depthCommandBuffer` with `frameDepthPipeline`.
+    DrawStats recordDraws(VkCommandBuffer commandBuffer,
+                          const std::vector<Model*>& models, size_t first,
+                          size_t last, FrameRingBuffer& instanceBuffer,
+                          VkDescriptorSet set,
+                          VkCommandBuffer depthCommandBuffer = VK_NULL_HANDLE);
+    // Binds the frame's pipeline, or its depth pre-pass, and the viewport,
+    // buffers and sets for draws reading their instances from
+    // `instanceBuffer`
+    void bindDrawState(VkCommandBuffer commandBuffer,
+                       FrameRingBuffer& instanceBuffer, VkDescriptorSet set,
+                       bool depth = false);
+    // what the vertex shader of the frame's variant reads for `object`
+    InstanceData getInstanceData(Model* object);
+    void recordImgui(VkCommandBuffer commandBuffer);
+    MeshCollider* loadModelClass(Model* model);
 };
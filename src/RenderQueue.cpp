@@ -0,0 +1,70 @@
+#include <algorithm> // std::max, std::min
+#include <array>     // std::array
+#include <cstring>   // memcpy
+
+#include "RenderQueue.hpp"
+
+static constexpr int KEY_BYTES = sizeof(uint64_t);
+static constexpr int BUCKETS = 256;
+
+uint64_t RenderQueue::makeKey(uint32_t pipeline, uint32_t texture,
+                              uint32_t mesh, float depth) {
+    uint32_t depthBits;
+    depth = std::max(0.0f, depth);
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    return static_cast<uint64_t>(std::min(pipeline, 0xfu)) << 60 |
+           static_cast<uint64_t>(std::min(texture, 0xfffu)) << 48 |
+           static_cast<uint64_t>(std::min(mesh, 0xffffu)) << 32 | depthBits;
+}
+
+uint32_t RenderQueue::getMeshId(int indexOffset) {
+    auto it = meshIds.find(indexOffset);
+    if (it != meshIds.end()) {
+        return it->second;
+    }
+
+    uint32_t meshId = static_cast<uint32_t>(meshIds.size());
+    meshIds[indexOffset] = meshId;
+    return meshId;
+}
+
+void RenderQueue::sort() {
+    if (items.size() < 2) {
+        return;
+    }
+
+    // one pass over the keys builds the histograms of every byte
+    std::array<std::array<uint32_t, BUCKETS>, KEY_BYTES> histograms{};
+    for (const Item& item : items) {
+        for (int byte = 0; byte < KEY_BYTES; byte++) {
+            histograms[byte][(item.key >> (byte * 8)) & 0xff]++;
+        }
+    }
+
+    scratch.resize(items.size());
+
+    for (int byte = 0; byte < KEY_BYTES; byte++) {
+        std::array<uint32_t, BUCKETS>& histogram = histograms[byte];
+
+        // all keys share this byte, e.g. the pipeline while there is only
+        // one, so the pass would not change the order
+        uint32_t firstKeyBucket = (items[0].key >> (byte * 8)) & 0xff;
+        if (histogram[firstKeyBucket] == items.size()) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t& count : histogram) {
+            uint32_t bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+
+        for (const Item& item : items) {
+            scratch[histogram[(item.key >> (byte * 8)) & 0xff]++] = item;
+        }
+
+        items.swap(scratch);
+    }
+}
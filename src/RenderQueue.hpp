@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>       // uint64_t
+#include <unordered_map> // std::unordered_map
+#include <vector>        // std::vector
+
+// State changes between consecutive draws, what sorting the draws by their
+// `RenderQueue` key keeps low
+struct DrawStats {
+    uint32_t draws = 0;
+    // objects drawn, consecutive ones sharing mesh and texture are one
+    // instanced draw
+    uint32_t instances = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t textureChanges = 0;
+    uint32_t meshChanges = 0;
+
+    DrawStats& operator+=(const DrawStats& other) {
+        draws += other.draws;
+        instances += other.instances;
+        pipelineBinds += other.pipelineBinds;
+        textureChanges += other.textureChanges;
+        meshChanges += other.meshChanges;
+        return *this;
+    }
+};
+
+// Draws of one frame ordered by a 64-bit key, most significant first:
+//
+//   63..60 pipeline  59..48 texture  47..32 mesh  31..0 depth
+//
+// so draws sharing state end up next to each other, and within the same
+// state they go front to back to make the most of the depth test. Every draw
+// is opaque so far, transparent ones would need back to front instead.
+class RenderQueue {
+  public:
+    struct Item {
+        uint64_t key;
+        // into the caller's draw list
+        uint32_t index;
+    };
+
+    // Non-negative `depth` (view space distance), which keeps the order of
+    // its float bits the same as the order of the values
+    static uint64_t makeKey(uint32_t pipeline, uint32_t texture, uint32_t mesh,
+                            float depth);
+
+    // Small ids for the mesh field, handed out the first time a mesh (by its
+    // index buffer offset) is seen
+    uint32_t getMeshId(int indexOffset);
+
+    void clear() { items.clear(); }
+    void push(uint64_t key, uint32_t index) { items.push_back({key, index}); }
+    // LSD radix sort over bytes, skipping bytes every key shares. Stable, so
+    // equal keys keep their push order.
+    void sort();
+
+    const std::vector<Item>& getItems() const { return items; }
+
+  private:
+    std::vector<Item> items;
+    // ping-pong buffer of `sort`
+    std::vector<Item> scratch;
+
+    std::unordered_map<int, uint32_t> meshIds;
+};
@@ -0,0 +1,204 @@
+#include <iostream>  // std::cout
+#include <stdexcept> // std::runtime_error
+
+#include "Replay.hpp"
+
+static const char REPLAY_MAGIC[4] = {'V', 'K', 'R', 'P'};
+static const uint32_t REPLAY_VERSION = 1;
+// byte offset of `totalSteps` in the header
+static const std::streamoff TOTAL_STEPS_OFFSET = 16;
+
+static const uint8_t RECORD_CAMERA = 1 << 0;
+static const uint8_t RECORD_COMMANDS = 1 << 1;
+
+template <typename T>
+static void writeValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> static void readValue(std::ifstream& file, T& value) {
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+static void writeVec3(std::ofstream& file, const glm::vec3& value) {
+    writeValue(file, value.x);
+    writeValue(file, value.y);
+    writeValue(file, value.z);
+}
+
+static void readVec3(std::ifstream& file, glm::vec3& value) {
+    readValue(file, value.x);
+    readValue(file, value.y);
+    readValue(file, value.z);
+}
+
+void ReplayRecorder::open(const std::string& filename, float timeStep,
+                          uint32_t sceneObjectCount) {
+    file.open(filename, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file: " + filename + "!");
+    }
+
+    file.write(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    writeValue(file, REPLAY_VERSION);
+    writeValue(file, timeStep);
+    writeValue(file, sceneObjectCount);
+    // patched by `close`
+    writeValue(file, uint32_t(0));
+
+    std::cout << "ReplayRecorder::open(), recording to " << filename
+              << std::endl;
+}
+
+void ReplayRecorder::recordStep(const ReplayStep& replayStep) {
+    totalSteps = replayStep.step + 1;
+
+    uint8_t flags = 0;
+
+    if (!hasCamera || replayStep.cameraPos != lastCameraPos ||
+        replayStep.cameraFront != lastCameraFront) {
+        flags |= RECORD_CAMERA;
+    }
+
+    if (!replayStep.commands.empty()) {
+        flags |= RECORD_COMMANDS;
+    }
+
+    if (flags == 0) {
+        return;
+    }
+
+    writeValue(file, replayStep.step);
+    writeValue(file, flags);
+
+    if (flags & RECORD_CAMERA) {
+        writeVec3(file, replayStep.cameraPos);
+        writeVec3(file, replayStep.cameraFront);
+
+        hasCamera = true;
+        lastCameraPos = replayStep.cameraPos;
+        lastCameraFront = replayStep.cameraFront;
+    }
+
+    if (flags & RECORD_COMMANDS) {
+        writeValue(file, static_cast<uint16_t>(replayStep.commands.size()));
+
+        for (const SceneCommand& command : replayStep.commands) {
+            writeValue(file, static_cast<uint8_t>(command.type));
+
+            if (command.type == SceneCommand::Spawn) {
+                writeVec3(file, command.position);
+                writeVec3(file, command.velocity);
+                writeValue(file, command.scale);
+                writeValue(file, command.mass);
+            }
+        }
+    }
+}
+
+void ReplayRecorder::close() {
+    if (!file.is_open()) {
+        return;
+    }
+
+    file.seekp(TOTAL_STEPS_OFFSET);
+    writeValue(file, totalSteps);
+    file.close();
+
+    std::cout << "ReplayRecorder::close(), recorded " << totalSteps
+              << " steps" << std::endl;
+}
+
+void ReplayPlayer::open(const std::string& filename, float timeStep,
+                        uint32_t sceneObjectCount) {
+    file.open(filename, std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file: " + filename + "!");
+    }
+
+    char magic[4];
+    uint32_t version, recordedSceneObjects;
+    float recordedTimeStep;
+
+    file.read(magic, sizeof(magic));
+    readValue(file, version);
+    readValue(file, recordedTimeStep);
+    readValue(file, recordedSceneObjects);
+    readValue(file, totalSteps);
+
+    if (!file || std::string(magic, 4) != std::string(REPLAY_MAGIC, 4) ||
+        version != REPLAY_VERSION) {
+        throw std::runtime_error("not a replay file: " + filename);
+    }
+
+    // a different step or scene would not reproduce the recorded simulation
+    if (recordedTimeStep != timeStep ||
+        recordedSceneObjects != sceneObjectCount) {
+        throw std::runtime_error("replay was recorded with a different "
+                                 "time step or scene: " +
+                                 filename);
+    }
+
+    if (totalSteps == 0) {
+        throw std::runtime_error("replay is empty or was not closed: " +
+                                 filename);
+    }
+
+    readRecordHeader();
+
+    std::cout << "ReplayPlayer::open(), " << totalSteps << " steps from "
+              << filename << std::endl;
+}
+
+void ReplayPlayer::readRecordHeader() {
+    readValue(file, pendingStep);
+    readValue(file, pendingFlags);
+
+    hasPending = static_cast<bool>(file);
+}
+
+void ReplayPlayer::readStep(uint32_t step, ReplayStep& replayStep) {
+    replayStep.step = step;
+    replayStep.commands.clear();
+
+    if (hasPending && pendingStep < step) {
+        throw std::runtime_error("replay records are out of order!");
+    }
+
+    if (hasPending && pendingStep == step) {
+        if (pendingFlags & RECORD_CAMERA) {
+            readVec3(file, cameraPos);
+            readVec3(file, cameraFront);
+        }
+
+        if (pendingFlags & RECORD_COMMANDS) {
+            uint16_t count;
+            readValue(file, count);
+
+            replayStep.commands.resize(count);
+            for (SceneCommand& command : replayStep.commands) {
+                uint8_t type;
+                readValue(file, type);
+                command.type = static_cast<SceneCommand::Type>(type);
+
+                if (command.type == SceneCommand::Spawn) {
+                    readVec3(file, command.position);
+                    readVec3(file, command.velocity);
+                    readValue(file, command.scale);
+                    readValue(file, command.mass);
+                }
+            }
+        }
+
+        if (!file) {
+            throw std::runtime_error("replay file is truncated!");
+        }
+
+        readRecordHeader();
+    }
+
+    replayStep.cameraPos = cameraPos;
+    replayStep.cameraFront = cameraFront;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <fstream> // std::ifstream, std::ofstream
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include <glm/glm.hpp> // glm::vec3
+
+// A change to the scene made between two physics steps. Commands are
+// replayed in order before the step they were recorded for.
+struct SceneCommand {
+    enum Type : uint8_t {
+        // spawn a box, uses all fields below
+        Spawn,
+        // remove every spawned object
+        Clear,
+    };
+
+    Type type = Spawn;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    float scale = 1.0f;
+    float mass = 1.0f;
+};
+
+// Everything that influences the simulation (and the rendered view) during
+// one fixed physics step
+struct ReplayStep {
+    uint32_t step = 0;
+    glm::vec3 cameraPos;
+    glm::vec3 cameraFront;
+    std::vector<SceneCommand> commands;
+};
+
+// File layout (native endianness):
+//   header: char[4] "VKRP", uint32 version, float timeStep,
+//           uint32 sceneObjectCount, uint32 totalSteps
+//   records: uint32 step, uint8 flags,
+//            [flags & CAMERA] float[6] cameraPos, cameraFront
+//            [flags & COMMANDS] uint16 count,
+//                count * (uint8 type, [Spawn] float[8])
+// Records are only written for steps where the camera moved or the scene
+// changed, which keeps idle stretches free.
+class ReplayRecorder {
+  public:
+    void open(const std::string& filename, float timeStep,
+              uint32_t sceneObjectCount);
+    void recordStep(const ReplayStep& replayStep);
+    void close();
+
+    bool isOpen() { return file.is_open(); }
+
+  private:
+    std::ofstream file;
+    uint32_t totalSteps = 0;
+
+    bool hasCamera = false;
+    glm::vec3 lastCameraPos;
+    glm::vec3 lastCameraFront;
+};
+
+class ReplayPlayer {
+  public:
+    void open(const std::string& filename, float timeStep,
+              uint32_t sceneObjectCount);
+
+    // Fills `replayStep` with the state for `step`. The camera carries over
+    // from the last record that changed it.
+    void readStep(uint32_t step, ReplayStep& replayStep);
+
+    bool isOpen() { return file.is_open(); }
+    bool isFinished(uint32_t step) { return step >= totalSteps; }
+    uint32_t getTotalSteps() { return totalSteps; }
+
+  private:
+    std::ifstream file;
+    uint32_t totalSteps = 0;
+
+    glm::vec3 cameraPos = glm::vec3(0.0f, 2.0f, 3.0f);
+    glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+
+    bool hasPending = false;
+    uint32_t pendingStep = 0;
+    uint8_t pendingFlags = 0;
+
+    void readRecordHeader();
+};
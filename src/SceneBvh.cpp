@@ -0,0 +1,653 @@
+#include <algorithm> // std::max, std::min, std::nth_element, std::partition
+#include <limits>    // std::numeric_limits
+
+#include "SceneBvh.hpp"
+
+Aabb Aabb::merge(const Aabb& a, const Aabb& b) {
+    return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+}
+
+float Aabb::getArea() const {
+    glm::vec3 size = max - min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+bool Aabb::contains(const Aabb& other) const {
+    return min.x <= other.min.x && min.y <= other.min.y &&
+           min.z <= other.min.z && other.max.x <= max.x &&
+           other.max.y <= max.y && other.max.z <= max.z;
+}
+
+bool Aabb::overlaps(const Aabb& other) const {
+    return min.x <= other.max.x && other.min.x <= max.x &&
+           min.y <= other.max.y && other.min.y <= max.y &&
+           min.z <= other.max.z && other.min.z <= max.z;
+}
+
+bool Aabb::overlapsSphere(const glm::vec3& center, float radius) const {
+    glm::vec3 offset = glm::clamp(center, min, max) - center;
+    return glm::dot(offset, offset) <= radius * radius;
+}
+
+int Aabb::classifyFrustum(const std::array<glm::vec4, 6>& planes) const {
+    int result = 1;
+    for (const glm::vec4& plane : planes) {
+        glm::vec3 normal(plane);
+
+        // the corners farthest along the normal and against it
+        glm::vec3 positive(normal.x >= 0.0f ? max.x : min.x,
+                           normal.y >= 0.0f ? max.y : min.y,
+                           normal.z >= 0.0f ? max.z : min.z);
+        glm::vec3 negative(normal.x >= 0.0f ? min.x : max.x,
+                           normal.y >= 0.0f ? min.y : max.y,
+                           normal.z >= 0.0f ? min.z : max.z);
+
+        if (glm::dot(normal, positive) + plane.w < 0.0f) {
+            return -1;
+        }
+        if (glm::dot(normal, negative) + plane.w < 0.0f) {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+bool Aabb::intersectRay(const glm::vec3& origin,
+                        const glm::vec3& inverseDirection, float maxDistance,
+                        float& distance) const {
+    // the slabs of the three axes, the ray is inside all of them between
+    // the last entry and the first exit
+    glm::vec3 t1 = (min - origin) * inverseDirection;
+    glm::vec3 t2 = (max - origin) * inverseDirection;
+    glm::vec3 tMin = glm::min(t1, t2);
+    glm::vec3 tMax = glm::max(t1, t2);
+
+    float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+    float exit = std::min(std::min(tMax.x, tMax.y), tMax.z);
+
+    if (enter > exit || enter > maxDistance) {
+        return false;
+    }
+    distance = enter;
+    return true;
+}
+
+std::array<glm::vec4, 6> getFrustumPlanes(const glm::mat4& viewProj) {
+    // the rows of the column major matrix
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i],
+                            viewProj[3][i]);
+    }
+
+    std::array<glm::vec4, 6> planes = {rows[3] + rows[0], rows[3] - rows[0],
+                                       rows[3] + rows[1], rows[3] - rows[1],
+                                       rows[2],           rows[3] - rows[2]};
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
+void SceneBvh::build(const std::vector<Aabb>& bounds,
+                     std::vector<int>& proxies) {
+    clear();
+
+    proxies.resize(bounds.size());
+    std::vector<int> leaves(bounds.size());
+    nodes.resize(bounds.size() * 2);
+    for (size_t i = 0; i < bounds.size(); i++) {
+        Node& leaf = nodes[i];
+        leaf.bounds = grow(bounds[i]);
+        leaf.itemBounds = bounds[i];
+        leaf.item = static_cast<uint32_t>(i);
+        proxies[i] = static_cast<int>(i);
+        leaves[i] = static_cast<int>(i);
+    }
+
+    // the rest for the internal nodes, one less than the leaves
+    for (size_t i = nodes.size(); i > bounds.size(); i--) {
+        freeNode(static_cast<int>(i - 1));
+    }
+
+    leafCount = bounds.size();
+    if (!leaves.empty()) {
+        root = buildRange(leaves, 0, leaves.size());
+        nodes[root].parent = NULL_NODE;
+    }
+
+    builtCost = getCost();
+    changeCount = 0;
+}
+
+int SceneBvh::insert(const Aabb& bounds, uint32_t item) {
+    int leaf = allocateNode();
+    nodes[leaf].bounds = grow(bounds);
+    nodes[leaf].itemBounds = bounds;
+    nodes[leaf].item = item;
+
+    insertLeaf(leaf);
+    leafCount++;
+    changeCount++;
+
+    return leaf;
+}
+
+void SceneBvh::remove(int proxy) {
+    removeLeaf(proxy);
+    freeNode(proxy);
+    leafCount--;
+    changeCount++;
+}
+
+bool SceneBvh::update(int proxy, const Aabb& bounds) {
+    Node& leaf = nodes[proxy];
+    leaf.itemBounds = bounds;
+
+    if (leaf.bounds.contains(bounds)) {
+        return false;
+    }
+
+    leaf.bounds = grow(bounds);
+    refit(leaf.parent);
+    changeCount++;
+
+    return true;
+}
+
+void SceneBvh::rebuild() {
+    if (root == NULL_NODE) {
+        return;
+    }
+
+    // the leaves stay where they are, only the internal nodes are replaced
+    std::vector<int> leaves;
+    leaves.reserve(leafCount);
+    std::vector<int> stack = {root};
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+
+        if (nodes[node].isLeaf()) {
+            leaves.push_back(node);
+        } else {
+            stack.push_back(nodes[node].left);
+            stack.push_back(nodes[node].right);
+            freeNode(node);
+        }
+    }
+
+    root = buildRange(leaves, 0, leaves.size());
+    nodes[root].parent = NULL_NODE;
+
+    builtCost = getCost();
+    changeCount = 0;
+    rebuildCount++;
+}
+
+bool SceneBvh::rebuildIfDegraded() {
+    // the cost walks the whole tree
+    if (changeCount < std::max<size_t>(leafCount / 8, 64)) {
+        return false;
+    }
+    changeCount = 0;
+
+    if (getCost() <= builtCost * REBUILD_COST_FACTOR) {
+        return false;
+    }
+
+    rebuild();
+    return true;
+}
+
+void SceneBvh::clear() {
+    nodes.clear();
+    root = NULL_NODE;
+    freeList = NULL_NODE;
+    leafCount = 0;
+    builtCost = 0.0f;
+    changeCount = 0;
+}
+
+void SceneBvh::queryFrustum(const std::array<glm::vec4, 6>& planes,
+                            std::vector<uint32_t>& items) const {
+    if (root == NULL_NODE) {
+        return;
+    }
+
+    std::vector<int> stack = {root};
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.isLeaf()) {
+            if (node.itemBounds.classifyFrustum(planes) >= 0) {
+                items.push_back(node.item);
+            }
+            continue;
+        }
+
+        int side = node.bounds.classifyFrustum(planes);
+        if (side > 0) {
+            // every item below is inside, no need to test them
+            collectItems(node.left, items);
+            collectItems(node.right, items);
+        } else if (side == 0) {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+void SceneBvh::queryAabb(const Aabb& bounds,
+                         std::vector<uint32_t>& items) const {
+    if (root == NULL_NODE) {
+        return;
+    }
+
+    std::vector<int> stack = {root};
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (!node.bounds.overlaps(bounds)) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            if (node.itemBounds.overlaps(bounds)) {
+                items.push_back(node.item);
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+void SceneBvh::querySphere(const glm::vec3& center, float radius,
+                           std::vector<uint32_t>& items) const {
+    if (root == NULL_NODE) {
+        return;
+    }
+
+    std::vector<int> stack = {root};
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (!node.bounds.overlapsSphere(center, radius)) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            if (node.itemBounds.overlapsSphere(center, radius)) {
+                items.push_back(node.item);
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+bool SceneBvh::raycast(const glm::vec3& origin, const glm::vec3& direction,
+                       float maxDistance, uint32_t& item,
+                       float& distance) const {
+    if (root == NULL_NODE) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+    float nearest = maxDistance;
+    bool hit = false;
+
+    float entry;
+    if (!nodes[root].bounds.intersectRay(origin, inverseDirection, nearest,
+                                         entry)) {
+        return false;
+    }
+
+    // nodes with the distance the ray enters them, the nearer child is
+    // visited first so the farther one is often skipped
+    std::vector<std::pair<int, float>> stack = {{root, entry}};
+    while (!stack.empty()) {
+        std::pair<int, float> top = stack.back();
+        stack.pop_back();
+
+        // a nearer hit was found since it was pushed
+        if (top.second > nearest) {
+            continue;
+        }
+
+        const Node& node = nodes[top.first];
+        if (node.isLeaf()) {
+            float itemDistance;
+            if (node.itemBounds.intersectRay(origin, inverseDirection,
+                                             nearest, itemDistance)) {
+                nearest = itemDistance;
+                item = node.item;
+                hit = true;
+            }
+            continue;
+        }
+
+        float leftEntry, rightEntry;
+        bool left = nodes[node.left].bounds.intersectRay(
+            origin, inverseDirection, nearest, leftEntry);
+        bool right = nodes[node.right].bounds.intersectRay(
+            origin, inverseDirection, nearest, rightEntry);
+
+        if (left && right && leftEntry < rightEntry) {
+            stack.push_back({node.right, rightEntry});
+            stack.push_back({node.left, leftEntry});
+        } else {
+            if (left) {
+                stack.push_back({node.left, leftEntry});
+            }
+            if (right) {
+                stack.push_back({node.right, rightEntry});
+            }
+        }
+    }
+
+    if (hit) {
+        distance = nearest;
+    }
+    return hit;
+}
+
+int SceneBvh::getHeight() const {
+    if (root == NULL_NODE) {
+        return 0;
+    }
+
+    int height = 0;
+    std::vector<std::pair<int, int>> stack = {{root, 1}};
+    while (!stack.empty()) {
+        std::pair<int, int> top = stack.back();
+        stack.pop_back();
+
+        height = std::max(height, top.second);
+        const Node& node = nodes[top.first];
+        if (!node.isLeaf()) {
+            stack.push_back({node.left, top.second + 1});
+            stack.push_back({node.right, top.second + 1});
+        }
+    }
+    return height;
+}
+
+float SceneBvh::getCost() const {
+    if (root == NULL_NODE) {
+        return 0.0f;
+    }
+
+    float rootArea = std::max(nodes[root].bounds.getArea(),
+                              std::numeric_limits<float>::min());
+    double area = 0.0;
+    std::vector<int> stack = {root};
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        area += node.bounds.getArea();
+        if (!node.isLeaf()) {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+    return static_cast<float>(area / rootArea);
+}
+
+int SceneBvh::allocateNode() {
+    if (freeList == NULL_NODE) {
+        nodes.emplace_back();
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    int node = freeList;
+    freeList = nodes[node].parent;
+    nodes[node] = Node();
+    return node;
+}
+
+void SceneBvh::freeNode(int node) {
+    nodes[node].parent = freeList;
+    nodes[node].left = NULL_NODE;
+    nodes[node].right = NULL_NODE;
+    freeList = node;
+}
+
+Aabb SceneBvh::grow(const Aabb& bounds) const {
+    return {bounds.min - glm::vec3(margin), bounds.max + glm::vec3(margin)};
+}
+
+void SceneBvh::insertLeaf(int leaf) {
+    if (root == NULL_NODE) {
+        root = leaf;
+        nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // Walks down as long as a child is a cheaper sibling than the node
+    // itself. Everything above the sibling grows by the same, which is
+    // inherited by the children's costs.
+    Aabb leafBounds = nodes[leaf].bounds;
+    int sibling = root;
+    while (!nodes[sibling].isLeaf()) {
+        const Node& node = nodes[sibling];
+
+        float area = node.bounds.getArea();
+        float combinedArea = Aabb::merge(node.bounds, leafBounds).getArea();
+
+        // a new parent of the node and the leaf
+        float cost = 2.0f * combinedArea;
+        float inheritedCost = 2.0f * (combinedArea - area);
+
+        auto childCost = [&](int child) {
+            const Aabb& childBounds = nodes[child].bounds;
+            float childCost =
+                Aabb::merge(childBounds, leafBounds).getArea() +
+                inheritedCost;
+            if (!nodes[child].isLeaf()) {
+                childCost -= childBounds.getArea();
+            }
+            return childCost;
+        };
+        float leftCost = childCost(node.left);
+        float rightCost = childCost(node.right);
+
+        if (cost < leftCost && cost < rightCost) {
+            break;
+        }
+        sibling = leftCost < rightCost ? node.left : node.right;
+    }
+
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].left = sibling;
+    nodes[newParent].right = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent == NULL_NODE) {
+        root = newParent;
+    } else if (nodes[oldParent].left == sibling) {
+        nodes[oldParent].left = newParent;
+    } else {
+        nodes[oldParent].right = newParent;
+    }
+
+    refit(newParent);
+}
+
+void SceneBvh::removeLeaf(int leaf) {
+    if (leaf == root) {
+        root = NULL_NODE;
+        return;
+    }
+
+    // the sibling takes the parent's place
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling =
+        nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    nodes[sibling].parent = grandParent;
+    if (grandParent == NULL_NODE) {
+        root = sibling;
+    } else if (nodes[grandParent].left == parent) {
+        nodes[grandParent].left = sibling;
+    } else {
+        nodes[grandParent].right = sibling;
+    }
+    freeNode(parent);
+
+    refit(grandParent);
+}
+
+void SceneBvh::refit(int node) {
+    while (node != NULL_NODE) {
+        Node& current = nodes[node];
+        current.bounds = Aabb::merge(nodes[current.left].bounds,
+                                     nodes[current.right].bounds);
+        node = current.parent;
+    }
+}
+
+int SceneBvh::buildRange(std::vector<int>& leaves, size_t first,
+                         size_t last) {
+    size_t count = last - first;
+    if (count == 1) {
+        return leaves[first];
+    }
+
+    // the bins span the box of the leaves' centers
+    glm::vec3 firstCenter = nodes[leaves[first]].bounds.getCenter();
+    Aabb centers = {firstCenter, firstCenter};
+    for (size_t i = first + 1; i < last; i++) {
+        glm::vec3 center = nodes[leaves[i]].bounds.getCenter();
+        centers.min = glm::min(centers.min, center);
+        centers.max = glm::max(centers.max, center);
+    }
+
+    // The split between bins with the smallest SAH cost, the area of each
+    // side times its leaves, across all three axes
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    glm::vec3 extent = centers.max - centers.min;
+
+    auto getBin = [&](int axis, const Aabb& leafBounds) {
+        float offset = leafBounds.getCenter()[axis] - centers.min[axis];
+        int bin = static_cast<int>(offset / extent[axis] * SAH_BINS);
+        return std::min(bin, SAH_BINS - 1);
+    };
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] <= 0.0f) {
+            continue;
+        }
+
+        std::array<Aabb, SAH_BINS> binBounds;
+        std::array<size_t, SAH_BINS> binCounts{};
+        for (size_t i = first; i < last; i++) {
+            const Aabb& leafBounds = nodes[leaves[i]].bounds;
+            int bin = getBin(axis, leafBounds);
+            binBounds[bin] = binCounts[bin] == 0
+                                 ? leafBounds
+                                 : Aabb::merge(binBounds[bin], leafBounds);
+            binCounts[bin]++;
+        }
+
+        // the right sides swept from the end, then the left ones
+        std::array<float, SAH_BINS> rightCosts{};
+        Aabb right{};
+        size_t rightCount = 0;
+        for (int bin = SAH_BINS - 1; bin > 0; bin--) {
+            if (binCounts[bin] > 0) {
+                right = rightCount == 0 ? binBounds[bin]
+                                        : Aabb::merge(right, binBounds[bin]);
+                rightCount += binCounts[bin];
+            }
+            rightCosts[bin] = rightCount * (rightCount > 0 ? right.getArea()
+                                                           : 0.0f);
+        }
+
+        Aabb left{};
+        size_t leftCount = 0;
+        for (int split = 1; split < SAH_BINS; split++) {
+            if (binCounts[split - 1] > 0) {
+                left = leftCount == 0
+                           ? binBounds[split - 1]
+                           : Aabb::merge(left, binBounds[split - 1]);
+                leftCount += binCounts[split - 1];
+            }
+            if (leftCount == 0 || leftCount == count) {
+                continue;
+            }
+
+            float cost = leftCount * left.getArea() + rightCosts[split];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    size_t middle = first;
+    if (bestAxis >= 0) {
+        middle = std::partition(leaves.begin() + first,
+                                leaves.begin() + last,
+                                [&](int leaf) {
+                                    return getBin(bestAxis,
+                                                  nodes[leaf].bounds) <
+                                           bestSplit;
+                                }) -
+                 leaves.begin();
+    }
+
+    // Every center in one place, or in one bin, halves by count
+    if (middle == first || middle == last) {
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0
+                   : extent.y >= extent.z                      ? 1
+                                                               : 2;
+        middle = first + count / 2;
+        std::nth_element(leaves.begin() + first, leaves.begin() + middle,
+                         leaves.begin() + last, [&](int a, int b) {
+                             return nodes[a].bounds.getCenter()[axis] <
+                                    nodes[b].bounds.getCenter()[axis];
+                         });
+    }
+
+    // the children first, `allocateNode` may move `nodes`
+    int left = buildRange(leaves, first, middle);
+    int right = buildRange(leaves, middle, last);
+
+    int node = allocateNode();
+    nodes[node].left = left;
+    nodes[node].right = right;
+    nodes[node].bounds = Aabb::merge(nodes[left].bounds, nodes[right].bounds);
+    nodes[left].parent = node;
+    nodes[right].parent = node;
+
+    return node;
+}
+
+void SceneBvh::collectItems(int node, std::vector<uint32_t>& items) const {
+    std::vector<int> stack = {node};
+    while (!stack.empty()) {
+        const Node& current = nodes[stack.back()];
+        stack.pop_back();
+
+        if (current.isLeaf()) {
+            items.push_back(current.item);
+        } else {
+            stack.push_back(current.left);
+            stack.push_back(current.right);
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>   // std::array
+#include <cstdint> // uint32_t
+#include <vector>  // std::vector
+
+#include <glm/glm.hpp> // glm::vec3, glm::vec4, glm::mat4
+
+// Axis aligned box, with the tests `SceneBvh` runs on its nodes so a
+// linear scan can run exactly the same ones
+struct Aabb {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    static Aabb merge(const Aabb& a, const Aabb& b);
+    // half the surface area, which is all the SAH compares
+    float getArea() const;
+    glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+    bool contains(const Aabb& other) const;
+    bool overlaps(const Aabb& other) const;
+    bool overlapsSphere(const glm::vec3& center, float radius) const;
+    // Against planes pointing inwards, -1 outside of one of them, 1 inside
+    // of all and 0 crossing one
+    int classifyFrustum(const std::array<glm::vec4, 6>& planes) const;
+    // Distance along the ray to where it enters the box, 0 from inside.
+    // `inverseDirection` is 1 over each component of the direction.
+    bool intersectRay(const glm::vec3& origin,
+                      const glm::vec3& inverseDirection, float maxDistance,
+                      float& distance) const;
+};
+
+// The planes of the clip space cube of a zero to one `viewProj` (Gribb and
+// Hartmann 2001), left, right, bottom, top, near and far. Normalized and
+// pointing inwards, in the space `viewProj` transforms from.
+std::array<glm::vec4, 6> getFrustumPlanes(const glm::mat4& viewProj);
+
+// Dynamic bounding volume hierarchy over the bounds of items, so frustum,
+// ray and range queries only visit the branches that can hold a result.
+// Every leaf is one item, and its proxy is the leaf's node, which stays
+// the same until the item is removed.
+//
+// `build` and `rebuild` split the items top down with a binned surface area
+// heuristic (SAH). `insert` walks down to the sibling that grows the total
+// area least, like Box2D's dynamic tree. The leaves are kept a margin
+// larger than their items, so `update` only refits the ancestors of items
+// that moved out of it. Refits and insertions make the tree worse over
+// time, `rebuildIfDegraded` builds it again once its SAH cost grew too
+// much.
+class SceneBvh {
+  public:
+    static constexpr int NULL_NODE = -1;
+    // bins per axis when splitting
+    static constexpr int SAH_BINS = 16;
+    // `rebuildIfDegraded` rebuilds past this times the cost of the build
+    static constexpr float REBUILD_COST_FACTOR = 1.5f;
+
+    explicit SceneBvh(float margin = 0.1f) : margin(margin) {}
+
+    // Replaces everything with `bounds`, item i being `bounds[i]`, and
+    // writes their proxies
+    void build(const std::vector<Aabb>& bounds, std::vector<int>& proxies);
+    int insert(const Aabb& bounds, uint32_t item);
+    void remove(int proxy);
+    // New bounds of `proxy`'s item, false if they are still inside its
+    // leaf and nothing was refitted
+    bool update(int proxy, const Aabb& bounds);
+    // Builds the tree again from its leaves with the SAH, the proxies stay
+    void rebuild();
+    // Checks the cost once many leaves were refitted or inserted since the
+    // last check, true if that rebuilt the tree
+    bool rebuildIfDegraded();
+    void clear();
+
+    // Items whose bounds intersect the planes, see `getFrustumPlanes`
+    void queryFrustum(const std::array<glm::vec4, 6>& planes,
+                      std::vector<uint32_t>& items) const;
+    void queryAabb(const Aabb& bounds, std::vector<uint32_t>& items) const;
+    void querySphere(const glm::vec3& center, float radius,
+                     std::vector<uint32_t>& items) const;
+    // The item whose bounds `direction` enters first within `maxDistance`,
+    // the caller tests its geometry if it needs more than its bounds
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+                 float maxDistance, uint32_t& item, float& distance) const;
+
+    uint32_t getItem(int proxy) const { return nodes[proxy].item; }
+    size_t size() const { return leafCount; }
+    // these walk the whole tree, for statistics
+    int getHeight() const;
+    // Area of every node over the root's, the nodes a ray through the
+    // root's box visits on average
+    float getCost() const;
+    uint32_t getRebuildCount() const { return rebuildCount; }
+
+  private:
+    struct Node {
+        // of the subtree, a leaf's is its item's grown by `margin`
+        Aabb bounds;
+        // the exact bounds of a leaf's item, which the queries test
+        Aabb itemBounds;
+        // next free node while on the free list
+        int parent = NULL_NODE;
+        // both NULL_NODE for leaves
+        int left = NULL_NODE;
+        int right = NULL_NODE;
+        uint32_t item = 0;
+
+        bool isLeaf() const { return left == NULL_NODE; }
+    };
+
+    std::vector<Node> nodes;
+    int root = NULL_NODE;
+    int freeList = NULL_NODE;
+    size_t leafCount = 0;
+    float margin;
+
+    // of the last build, and leaves refitted or inserted since its check
+    float builtCost = 0.0f;
+    size_t changeCount = 0;
+    uint32_t rebuildCount = 0;
+
+    // may grow `nodes`, no reference into it survives
+    int allocateNode();
+    void freeNode(int node);
+    Aabb grow(const Aabb& bounds) const;
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    // recomputes the bounds of `node` and every node above it
+    void refit(int node);
+    // The subtree of `leaves[first, last)`, ordered in place, returns its
+    // root
+    int buildRange(std::vector<int>& leaves, size_t first, size_t last);
+    void collectItems(int node, std::vector<uint32_t>& items) const;
+};
@@ -1,3 +1,5 @@
+#include <array>     // std::array
+#include <chrono>    // std::chrono
 #include <fstream>   // std::ifstream
 #include <iostream>  // std::cout
 #include <stdexcept> // std::runtime_error
@@ -8,12 +10,57 @@
 #include "Shader.hpp"
 #include "Vertex.hpp"
 
+// vertex and fragment shader of every `ShaderVariant`, in enum order, and
+// its vertex shader for `PositionVertexLayout`
+static const char* SHADER_VARIANTS[SHADER_VARIANT_COUNT][3] = {
+    {"shaders/vert.spv", "shaders/frag.spv", "shaders/vert_position.spv"},
+    // shaders.vert compiled with CPU_MVP defined, see the Makefile
+    {"shaders/vert_mvp.spv", "shaders/frag.spv",
+     "shaders/vert_position_mvp.spv"},
+};
+static const char* OVERDRAW_SHADER = "shaders/overdraw.spv";
+
 void Shader::loadShaders() {
-    auto vertShaderCode = readFile("shaders/vert.spv");
-    auto fragShaderCode = readFile("shaders/frag.spv");
+    for (uint32_t variant = 0; variant < SHADER_VARIANT_COUNT; variant++) {
+        ShaderModules modules{};
+
+        try {
+            auto vertShaderCode = readFile(SHADER_VARIANTS[variant][0]);
+            auto fragShaderCode = readFile(SHADER_VARIANTS[variant][1]);
+
+            modules.vert = createShaderModule(vertShaderCode);
+            modules.frag = createShaderModule(fragShaderCode);
+        } catch (const std::exception& exception) {
+            // Only the default variant is required, the pipelines of a
+            // missing one fail and `PipelineManager` falls back
+            if (variant == ViewProjectionVariant) {
+                throw;
+            }
+            std::cerr << "Shader::loadShaders(), skipping variant " << variant
+                      << ": " << exception.what() << std::endl;
+        }
+
+        // the depth pre-pass is optional as well
+        try {
+            if (modules.vert != VK_NULL_HANDLE) {
+                modules.positionVert =
+                    createShaderModule(readFile(SHADER_VARIANTS[variant][2]));
+            }
+        } catch (const std::exception& exception) {
+            std::cerr << "Shader::loadShaders(), no depth pre-pass for "
+                         "variant "
+                      << variant << ": " << exception.what() << std::endl;
+        }
+
+        shaderModules.push_back(modules);
+    }
 
-    vertShaderModule = createShaderModule(vertShaderCode);
-    fragShaderModule = createShaderModule(fragShaderCode);
+    try {
+        overdrawFrag = createShaderModule(readFile(OVERDRAW_SHADER));
+    } catch (const std::exception& exception) {
+        std::cerr << "Shader::loadShaders(), no overdraw view: "
+                  << exception.what() << std::endl;
+    }
 }
 
 VkShaderModule Shader::createShaderModule(const std::vector<char>& code) {
@@ -32,50 +79,122 @@ VkShaderModule Shader::createShaderModule(const std::vector<char>& code) {
 }
 
 void Shader::createDescriptorSetLayout() {
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // vertex shader
-    uboLayoutBinding.pImmutableSamplers = nullptr;            // Optional
-
+    // Every texture in one array, indexed with `InstanceData::textureIndex`
     VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = MAX_TEXTURES;
     samplerLayoutBinding.descriptorType =
         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.pImmutableSamplers = nullptr;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
-        uboLayoutBinding, samplerLayoutBinding};
+    // Slots past the loaded textures stay unwritten, and textures loaded at
+    // runtime are written while the set is bound in pending frames
+    VkDescriptorBindingFlags bindingFlags =
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings =
-        bindings.data(); // array of VkDescriptorSetLayoutBinding
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &samplerLayoutBinding;
 
     if (vkCreateDescriptorSetLayout(*devicePtr, &layoutInfo, nullptr,
                                     &descriptorSetLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor set layout!");
     }
+
+    // The buffers of the frame set never change while the ring buffers keep
+    // their size, the dynamic offsets pick the frame's region
+    VkDescriptorSetLayoutBinding uboLayoutBinding{};
+    uboLayoutBinding.binding = 0;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uboLayoutBinding.descriptorCount = 1;
+    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // vertex shader
+    uboLayoutBinding.pImmutableSamplers = nullptr;            // Optional
+
+    VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+    instanceLayoutBinding.binding = 1;
+    instanceLayoutBinding.descriptorType =
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> frameBindings = {
+        uboLayoutBinding, instanceLayoutBinding};
+
+    VkDescriptorSetLayoutCreateInfo frameLayoutInfo{};
+    frameLayoutInfo.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    frameLayoutInfo.bindingCount = static_cast<uint32_t>(frameBindings.size());
+    frameLayoutInfo.pBindings = frameBindings.data();
+
+    if (vkCreateDescriptorSetLayout(*devicePtr, &frameLayoutInfo, nullptr,
+                                    &frameSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void Shader::createPipelineLayout() {
+    // per-draw data is in the instance buffer, no push constants
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {descriptorSetLayout,
+                                                       frameSetLayout};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount =
+        static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+    if (vkCreatePipelineLayout(*devicePtr, &pipelineLayoutInfo, nullptr,
+                               &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
 }
 
-void Shader::createGraphicsPipeline() {
+VkPipeline Shader::createPipeline(const PipelineKey& key) {
+    if (key.vertexLayout > PositionVertexLayout ||
+        key.shaderVariant >= shaderModules.size()) {
+        throw std::runtime_error("unknown vertex layout or shader variant!");
+    }
+
+    // the depth pre-pass writes no color, it needs no fragment shader
+    bool positionOnly = key.vertexLayout == PositionVertexLayout;
+
+    const ShaderModules& modules = shaderModules[key.shaderVariant];
+    VkShaderModule vertModule =
+        positionOnly ? modules.positionVert : modules.vert;
+    VkShaderModule fragModule = key.overdraw ? overdrawFrag : modules.frag;
+    if (vertModule == VK_NULL_HANDLE ||
+        (!positionOnly && fragModule == VK_NULL_HANDLE)) {
+        throw std::runtime_error("shader variant was not loaded!");
+    }
+
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType =
         VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
 
-    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.module = vertModule;
     vertShaderStageInfo.pName = "main";
 
     VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
     fragShaderStageInfo.sType =
         VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
+    fragShaderStageInfo.module = fragModule;
     fragShaderStageInfo.pName = "main";
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
@@ -87,12 +206,21 @@ void Shader::createGraphicsPipeline() {
 
     auto bindingDescription = Vertex::getBindingDescription();
     auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    auto positionBinding = Vertex::getPositionBindingDescription();
+    auto positionAttribute = Vertex::getPositionAttributeDescription();
 
     vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount =
-        static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    if (positionOnly) {
+        vertexInputInfo.vertexAttributeDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &positionBinding;
+        vertexInputInfo.pVertexAttributeDescriptions = &positionAttribute;
+    } else {
+        vertexInputInfo.vertexAttributeDescriptionCount =
+            static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexAttributeDescriptions =
+            attributeDescriptions.data();
+    }
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType =
@@ -110,11 +238,10 @@ void Shader::createGraphicsPipeline() {
         VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
     rasterizer.depthClampEnable = VK_FALSE;
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    // rasterizer.polygonMode = VK_POLYGON_MODE_LINE; // Wireframe, [TODO] have
-    // this as an option
+    // VK_POLYGON_MODE_LINE needs the fillModeNonSolid feature
+    rasterizer.polygonMode = key.polygonMode;
     rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.cullMode = key.cullMode;
     rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
     rasterizer.depthBiasEnable = VK_FALSE;
@@ -136,10 +263,21 @@ void Shader::createGraphicsPipeline() {
     colorBlendAttachment.colorWriteMask =
         VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
         VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;  // Optional
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;             // Optional
+    colorBlendAttachment.blendEnable = key.blend ? VK_TRUE : VK_FALSE;
+    colorBlendAttachment.srcColorBlendFactor =
+        key.blend ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstColorBlendFactor =
+        key.blend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
+    if (key.overdraw) {
+        // every shaded fragment adds up
+        colorBlendAttachment.blendEnable = VK_TRUE;
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    }
+    if (positionOnly) {
+        colorBlendAttachment.colorWriteMask = 0;
+    }
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
     colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;  // Optional
     colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
     colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;             // Optional
@@ -168,8 +306,8 @@ void Shader::createGraphicsPipeline() {
     depthStencil.sType =
         VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthWriteEnable = key.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = key.depthCompareOp;
     depthStencil.depthBoundsTestEnable = VK_FALSE;
     depthStencil.minDepthBounds = 0.0f; // Optional
     depthStencil.maxDepthBounds = 1.0f; // Optional
@@ -177,27 +315,10 @@ void Shader::createGraphicsPipeline() {
     depthStencil.front = {}; // Optional
     depthStencil.back = {};  // Optional
 
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(glm::mat4); // Size of the data being passed
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-    if (vkCreatePipelineLayout(*devicePtr, &pipelineLayoutInfo, nullptr,
-                               &pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-
     // VkGraphicsPipelineCreateInfo
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;         // number of shader stages
+    pipelineInfo.stageCount = positionOnly ? 1 : 2; // number of shader stages
     pipelineInfo.pStages = shaderStages; // shader stages
     pipelineInfo.pVertexInputState = &vertexInputInfo;
     pipelineInfo.pInputAssemblyState = &inputAssembly;
@@ -215,24 +336,28 @@ void Shader::createGraphicsPipeline() {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1;              // Optional
 
-    // [TODO] pipeline cache
-    if (vkCreateGraphicsPipelines(*devicePtr, VK_NULL_HANDLE, 1, &pipelineInfo,
-                                  nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    auto start = std::chrono::steady_clock::now();
+
+    // the pipeline cache is internally synchronized
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(*devicePtr, *pipelineCachePtr, 1,
+                                  &pipelineInfo, nullptr,
+                                  &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
-    vkDestroyShaderModule(*devicePtr, fragShaderModule, nullptr);
-    vkDestroyShaderModule(*devicePtr, vertShaderModule, nullptr);
+    std::chrono::duration<float, std::milli> compileTime =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Shader::createPipeline(), " << compileTime.count() << " ms"
+              << std::endl;
+
+    return pipeline;
 }
 
 void Shader::destroyPipelineLayout() {
     vkDestroyPipelineLayout(*devicePtr, pipelineLayout, nullptr);
 }
 
-void Shader::destroyGraphicsPipeline() {
-    vkDestroyPipeline(*devicePtr, graphicsPipeline, nullptr);
-}
-
 std::vector<char> Shader::readFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
@@ -253,5 +378,16 @@ std::vector<char> Shader::readFile(const std::string& filename) {
 }
 
 void Shader::cleanup() {
+    // null handles of skipped variants are ignored
+    for (const ShaderModules& modules : shaderModules) {
+        vkDestroyShaderModule(*devicePtr, modules.frag, nullptr);
+        vkDestroyShaderModule(*devicePtr, modules.vert, nullptr);
+        vkDestroyShaderModule(*devicePtr, modules.positionVert, nullptr);
+    }
+    shaderModules.clear();
+    vkDestroyShaderModule(*devicePtr, overdrawFrag, nullptr);
+    overdrawFrag = VK_NULL_HANDLE;
+
     vkDestroyDescriptorSetLayout(*devicePtr, descriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(*devicePtr, frameSetLayout, nullptr);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream> // std::cout
+#include <vector>   // std::vector
 
 #include <vulkan/vulkan.h>
 
@@ -9,39 +10,133 @@
 #include <glm/glm.hpp> // glm::mat4
 
 // I'm still undecided if this is the right place for this struct.
+// The camera, the header of every `Render::frameData` region. Projection
+// times view, multiplied once per frame on the CPU instead of per vertex.
 struct UniformBufferObject {
-    glm::mat4 model;
-    glm::mat4 view;
-    glm::mat4 proj;
+    glm::mat4 viewProj;
+};
+
+// `PipelineKey::shaderVariant`, which vertex shader computes the position
+enum ShaderVariant : uint32_t {
+    // view-projection from the UBO times the instance's model matrix
+    ViewProjectionVariant,
+    // `InstanceData::transform` is the whole model-view-projection, one
+    // matrix-vector product per vertex
+    MvpVariant,
+    SHADER_VARIANT_COUNT,
+};
+
+// `PipelineKey::vertexLayout`, the vertex buffer the pipeline reads
+enum VertexLayout : uint32_t {
+    // every attribute of `Vertex` from `VulkanSetup::vertexBuffer`
+    FullVertexLayout,
+    // only the position from `VulkanSetup::positionBuffer`, for the depth
+    // pre-pass, which has no fragment shader and writes no color
+    PositionVertexLayout,
+};
+
+// Size of the bindless texture array (set 0), no texture can be created
+// past it. See `VulkanSetup::createDescriptorSets`.
+const uint32_t MAX_TEXTURES = 1024;
+
+// One element of the instance buffer (set 1, binding 1), indexed with
+// gl_InstanceIndex. Padded to the std430 array stride.
+struct InstanceData {
+    // model matrix, or the model-view-projection with `MvpVariant`
+    glm::mat4 transform;
+    // into the bindless texture array
+    uint32_t textureIndex;
+    uint32_t padding[3];
+};
+static_assert(sizeof(InstanceData) == 80, "std430 stride of InstanceData");
+
+// Everything a graphics pipeline is built from besides the render pass and
+// the layout, which are shared by all pipelines. See `PipelineManager`.
+struct PipelineKey {
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    // standard alpha blending
+    bool blend = false;
+    // `VertexLayout`
+    uint32_t vertexLayout = FullVertexLayout;
+    // `ShaderVariant`, index into the shader pairs of `Shader::loadShaders`
+    uint32_t shaderVariant = ViewProjectionVariant;
+    // EQUAL without writes draws the colors after a depth pre-pass
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+    bool depthWrite = true;
+    // Every fragment adds the same color instead of its texture, so the
+    // brightness shows how often each pixel was shaded
+    bool overdraw = false;
+
+    bool operator==(const PipelineKey& other) const {
+        return polygonMode == other.polygonMode &&
+               cullMode == other.cullMode && blend == other.blend &&
+               vertexLayout == other.vertexLayout &&
+               shaderVariant == other.shaderVariant &&
+               depthCompareOp == other.depthCompareOp &&
+               depthWrite == other.depthWrite && overdraw == other.overdraw;
+    }
+};
+
+struct PipelineKeyHash {
+    size_t operator()(const PipelineKey& key) const {
+        // every field fits into a few bits
+        return static_cast<size_t>(key.polygonMode) |
+               static_cast<size_t>(key.cullMode) << 4 |
+               static_cast<size_t>(key.blend) << 8 |
+               static_cast<size_t>(key.vertexLayout) << 12 |
+               static_cast<size_t>(key.shaderVariant) << 20 |
+               static_cast<size_t>(key.depthCompareOp) << 24 |
+               static_cast<size_t>(key.depthWrite) << 28 |
+               static_cast<size_t>(key.overdraw) << 29;
+    }
 };
 
 class Shader {
     VkDevice* devicePtr;
     VkRenderPass* renderPassPtr;
+    VkPipelineCache* pipelineCachePtr;
 
-    VkShaderModule vertShaderModule;
-    VkShaderModule fragShaderModule;
+    struct ShaderModules {
+        VkShaderModule vert;
+        VkShaderModule frag;
+        // `PositionVertexLayout`, null if it was not built
+        VkShaderModule positionVert;
+    };
+
+    // one pair per shader variant, kept alive for pipelines compiled later
+    std::vector<ShaderModules> shaderModules;
+    // of every `PipelineKey::overdraw` pipeline, null if it was not built
+    VkShaderModule overdrawFrag = VK_NULL_HANDLE;
 
   public:
-    VkPipeline graphicsPipeline;
+    // set 0, the bindless textures
     VkDescriptorSetLayout descriptorSetLayout;
+    // set 1, the camera and the instances in `FrameRingBuffer`s, both with
+    // dynamic offsets
+    VkDescriptorSetLayout frameSetLayout;
     VkPipelineLayout pipelineLayout;
 
-    Shader(VkDevice* devicePtr, VkRenderPass* renderPassPtr)
-        : devicePtr(devicePtr), renderPassPtr(renderPassPtr) {
+    Shader(VkDevice* devicePtr, VkRenderPass* renderPassPtr,
+           VkPipelineCache* pipelineCachePtr)
+        : devicePtr(devicePtr), renderPassPtr(renderPassPtr),
+          pipelineCachePtr(pipelineCachePtr) {
         // print the render pass pointer
         std::cout << "Shader, devicePtr: " << devicePtr << std::endl;
         std::cout << "Shader, renderPassPtr: " << renderPassPtr << std::endl;
     }
 
     void loadShaders();
-    void createGraphicsPipeline();
-    void destroyGraphicsPipeline();
+    void createPipelineLayout();
+    // Safe to call from any thread once the layout exists
+    VkPipeline createPipeline(const PipelineKey& key);
     void destroyPipelineLayout();
     void createDescriptorSetLayout();
     void cleanup();
 
-  private:
+    // the whole file, throws if it cannot be opened
     static std::vector<char> readFile(const std::string& filename);
+
+  private:
     VkShaderModule createShaderModule(const std::vector<char>& code);
 };
@@ -0,0 +1,114 @@
+#include <stdexcept> // std::runtime_error
+
+#include "ShapeCache.hpp"
+
+rp3d::BoxShape* ShapeCache::getBoxShape(const rp3d::Vector3& halfExtents) {
+    Key key = makeKey(ShapeKind::Box, nullptr, halfExtents);
+
+    if (rp3d::CollisionShape* shape = find(key)) {
+        return static_cast<rp3d::BoxShape*>(shape);
+    }
+
+    rp3d::BoxShape* shape = physicsCommon->createBoxShape(halfExtents);
+    insert(key, shape);
+
+    return shape;
+}
+
+rp3d::ConvexMeshShape*
+ShapeCache::getConvexMeshShape(rp3d::ConvexMesh* convexMesh,
+                               const rp3d::Vector3& scaling) {
+    Key key = makeKey(ShapeKind::ConvexMesh, convexMesh, scaling);
+
+    if (rp3d::CollisionShape* shape = find(key)) {
+        return static_cast<rp3d::ConvexMeshShape*>(shape);
+    }
+
+    rp3d::ConvexMeshShape* shape =
+        physicsCommon->createConvexMeshShape(convexMesh, scaling);
+    insert(key, shape);
+
+    return shape;
+}
+
+rp3d::ConcaveMeshShape*
+ShapeCache::getConcaveMeshShape(rp3d::TriangleMesh* triangleMesh,
+                                const rp3d::Vector3& scaling) {
+    Key key = makeKey(ShapeKind::ConcaveMesh, triangleMesh, scaling);
+
+    if (rp3d::CollisionShape* shape = find(key)) {
+        return static_cast<rp3d::ConcaveMeshShape*>(shape);
+    }
+
+    rp3d::ConcaveMeshShape* shape =
+        physicsCommon->createConcaveMeshShape(triangleMesh, scaling);
+    insert(key, shape);
+
+    return shape;
+}
+
+void ShapeCache::release(rp3d::CollisionShape* shape) {
+    auto keyIt = keys.find(shape);
+
+    if (keyIt == keys.end()) {
+        throw std::runtime_error("released a shape not owned by ShapeCache!");
+    }
+
+    auto entryIt = entries.find(keyIt->second);
+    referenceCount--;
+
+    if (--entryIt->second.references > 0) {
+        return;
+    }
+
+    // no collider uses the shape any more
+    switch (keyIt->second.kind) {
+    case ShapeKind::Box:
+        physicsCommon->destroyBoxShape(static_cast<rp3d::BoxShape*>(shape));
+        break;
+    case ShapeKind::ConvexMesh:
+        physicsCommon->destroyConvexMeshShape(
+            static_cast<rp3d::ConvexMeshShape*>(shape));
+        break;
+    case ShapeKind::ConcaveMesh:
+        physicsCommon->destroyConcaveMeshShape(
+            static_cast<rp3d::ConcaveMeshShape*>(shape));
+        break;
+    }
+
+    entries.erase(entryIt);
+    keys.erase(keyIt);
+}
+
+ShapeCache::Key ShapeCache::makeKey(ShapeKind kind, const void* mesh,
+                                    const rp3d::Vector3& vector) {
+    Key key{};
+    key.kind = kind;
+    key.mesh = mesh;
+
+    float values[3] = {static_cast<float>(vector.x),
+                       static_cast<float>(vector.y),
+                       static_cast<float>(vector.z)};
+    memcpy(key.parameters, values, sizeof(key.parameters));
+
+    return key;
+}
+
+rp3d::CollisionShape* ShapeCache::find(const Key& key) {
+    auto it = entries.find(key);
+
+    if (it == entries.end()) {
+        return nullptr;
+    }
+
+    it->second.references++;
+    referenceCount++;
+
+    return it->second.shape;
+}
+
+void ShapeCache::insert(const Key& key, rp3d::CollisionShape* shape) {
+    entries[key] = Entry{shape, 1};
+    keys[shape] = key;
+    referenceCount++;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstring>       // memcpy
+#include <functional>    // std::hash
+#include <unordered_map> // std::unordered_map
+
+#include <reactphysics3d/reactphysics3d.h>
+
+// Shares collision shapes between bodies. rp3d shapes are immutable once
+// created and can be attached to any number of colliders, so instances with
+// the same shape type and parameters reuse one shape. Every `get*` call takes
+// a reference which is given back with `release`; the shape is destroyed when
+// the last reference goes.
+class ShapeCache {
+    rp3d::PhysicsCommon* physicsCommon;
+
+  public:
+    ShapeCache(rp3d::PhysicsCommon* physicsCommon)
+        : physicsCommon(physicsCommon) {}
+
+    rp3d::BoxShape* getBoxShape(const rp3d::Vector3& halfExtents);
+    rp3d::ConvexMeshShape* getConvexMeshShape(rp3d::ConvexMesh* convexMesh,
+                                              const rp3d::Vector3& scaling);
+    rp3d::ConcaveMeshShape*
+    getConcaveMeshShape(rp3d::TriangleMesh* triangleMesh,
+                        const rp3d::Vector3& scaling);
+
+    void release(rp3d::CollisionShape* shape);
+
+    size_t getShapeCount() const { return entries.size(); }
+    size_t getReferenceCount() const { return referenceCount; }
+
+  private:
+    enum class ShapeKind { Box, ConvexMesh, ConcaveMesh };
+
+    struct Key {
+        ShapeKind kind;
+        const void* mesh;
+        // compared bit-for-bit, shapes created from the same float values
+        // are shared
+        uint32_t parameters[3];
+
+        bool operator==(const Key& other) const {
+            return kind == other.kind && mesh == other.mesh &&
+                   parameters[0] == other.parameters[0] &&
+                   parameters[1] == other.parameters[1] &&
+                   parameters[2] == other.parameters[2];
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            size_t hash = std::hash<const void*>()(key.mesh) ^
+                          static_cast<size_t>(key.kind);
+            for (uint32_t parameter : key.parameters) {
+                hash ^= std::hash<uint32_t>()(parameter) + 0x9e3779b9 +
+                        (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    struct Entry {
+        rp3d::CollisionShape* shape;
+        int references;
+    };
+
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::unordered_map<rp3d::CollisionShape*, Key> keys;
+    size_t referenceCount = 0;
+
+    static Key makeKey(ShapeKind kind, const void* mesh,
+                       const rp3d::Vector3& vector);
+    rp3d::CollisionShape* find(const Key& key);
+    void insert(const Key& key, rp3d::CollisionShape* shape);
+};
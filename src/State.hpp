@@ -6,6 +6,7 @@ struct gameState {
 
     int noBoxes = 0;
     int noUserIntendedBoxes = 0;
+    bool clearSpawnedObjects = false;
 
     float newObjectVelocity = 25.0f;
     float newObjectScale = 0.2f;
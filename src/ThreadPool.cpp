@@ -0,0 +1,80 @@
+#include <string> // std::to_string
+
+#include "Profiler.hpp"
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    for (uint32_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    tasksDone.wait(lock, [this] { return tasks.empty() && runningTasks == 0; });
+
+    if (firstException) {
+        std::exception_ptr exception = firstException;
+        firstException = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void ThreadPool::workerLoop(uint32_t index) {
+    Profiler::get().setThreadName("worker " + std::to_string(index));
+
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAvailable.wait(lock,
+                               [this] { return stopping || !tasks.empty(); });
+
+            if (stopping && tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop();
+            runningTasks++;
+        }
+
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!firstException) {
+                firstException = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            runningTasks--;
+            if (tasks.empty() && runningTasks == 0) {
+                tasksDone.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable> // std::condition_variable
+#include <exception>          // std::exception_ptr
+#include <functional>         // std::function
+#include <mutex>              // std::mutex
+#include <queue>              // std::queue
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+// Fixed number of worker threads running submitted tasks in FIFO order. The
+// submitting thread calls `wait` to block until every task has finished.
+class ThreadPool {
+  public:
+    explicit ThreadPool(uint32_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t getThreadCount() const { return workers.size(); }
+
+    void submit(std::function<void()> task);
+    // Blocks until the queue is empty and no task is running. Rethrows the
+    // first exception thrown by a task since the last `wait`.
+    void wait();
+
+  private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable tasksDone;
+
+    uint32_t runningTasks = 0;
+    bool stopping = false;
+    std::exception_ptr firstException;
+
+    void workerLoop(uint32_t index);
+};
@@ -16,6 +16,9 @@ struct Vertex {
     static VkVertexInputBindingDescription getBindingDescription();
     static std::array<VkVertexInputAttributeDescription, 3>
     getAttributeDescriptions();
+    // `pos` alone, tightly packed in `VulkanSetup::positionBuffer`
+    static VkVertexInputBindingDescription getPositionBindingDescription();
+    static VkVertexInputAttributeDescription getPositionAttributeDescription();
 
     bool operator==(const Vertex& other) const {
         return pos == other.pos && color == other.color &&
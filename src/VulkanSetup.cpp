@@ -1,4 +1,4 @@
-#include <algorithm> // std::clamp
+#include <algorithm> // std::clamp, std::max
 #include <cstring>   // strcmp
 #include <iostream>  // std::cerr
 #include <limits>    // std::numeric_limits
@@ -9,6 +9,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "PngWriter.hpp"
 #include "Shader.hpp"
 #include "Vertex.hpp"
 #include "VulkanSetup.hpp"
@@ -38,6 +39,12 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
 
 int VulkanSetup::createTexture(std::string texturePath,
                                VkCommandPool* commandPoolPtr) {
+    if (textures.size() >= MAX_TEXTURES) {
+        throw std::runtime_error("too many textures, the bindless array "
+                                 "holds " +
+                                 std::to_string(MAX_TEXTURES) + "!");
+    }
+
     VkImage textureImage;
     VkDeviceMemory textureImageMemory;
     VkImageView textureImageView;
@@ -60,6 +67,13 @@ int VulkanSetup::createTexture(std::string texturePath,
 
     textures.push_back(texture);
 
+    // Textures loaded before the descriptor set exists are written by
+    // `createDescriptorSets`. Later ones go into a slot no pending frame
+    // uses, which update-after-bind allows while the set is bound.
+    if (textureDescriptorSet != VK_NULL_HANDLE) {
+        writeTextureDescriptor(textures.size() - 1);
+    }
+
     return textures.size() - 1;
 }
 
@@ -189,7 +203,8 @@ void VulkanSetup::createTextureImage(VkCommandPool* commandPoolPtr,
 void VulkanSetup::createImage(uint32_t width, uint32_t height, VkFormat format,
                               VkImageTiling tiling, VkImageUsageFlags usage,
                               VkMemoryPropertyFlags properties, VkImage& image,
-                              VkDeviceMemory& imageMemory) {
+                              VkDeviceMemory& imageMemory,
+                              uint32_t mipLevels) {
 
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -197,7 +212,7 @@ void VulkanSetup::createImage(uint32_t width, uint32_t height, VkFormat format,
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
     imageInfo.format = format;
     imageInfo.tiling = tiling;
@@ -385,12 +400,17 @@ bool VulkanSetup::checkValidationLayerSupport() {
 }
 
 std::vector<const char*> VulkanSetup::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    std::vector<const char*> extensions;
+
+    // headless rendering needs no surface extensions (and no GLFW at all)
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions =
+            glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-    std::vector<const char*> extensions(glfwExtensions,
-                                        glfwExtensions + glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -437,6 +457,10 @@ void VulkanSetup::setupDebugMessenger() {
 }
 
 void VulkanSetup::createSurface() {
+    if (headless) {
+        return;
+    }
+
     if (glfwCreateWindowSurface(instance, window.window, nullptr, &surface) !=
         VK_SUCCESS) {
         throw std::runtime_error("failed to create window surface!");
@@ -496,6 +520,16 @@ int VulkanSetup::rateDeviceSuitability(VkPhysicalDevice device) {
     // Maximum possible size of textures affects graphics quality
     score += deviceProperties.limits.maxImageDimension2D;
 
+    if (!isDeviceSuitable(device)) {
+        return 0;
+    }
+
+    // Software rasterizers are all a headless run on a build machine has, so
+    // they are only ruled out when rendering to a window
+    if (headless) {
+        return score;
+    }
+
     // Application can't function without geometry shaders
     if (!deviceFeatures.geometryShader) {
         return 0;
@@ -512,10 +546,6 @@ int VulkanSetup::rateDeviceSuitability(VkPhysicalDevice device) {
         return 0;
     }
 
-    if (!isDeviceSuitable(device)) {
-        return 0;
-    }
-
     return score;
 }
 
@@ -524,8 +554,8 @@ bool VulkanSetup::isDeviceSuitable(VkPhysicalDevice device) {
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    bool swapChainAdequate = headless;
+    if (extensionsSupported && !headless) {
         SwapChainSupportDetails swapChainSupport =
             querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() &&
@@ -535,7 +565,48 @@ bool VulkanSetup::isDeviceSuitable(VkPhysicalDevice device) {
     VkPhysicalDeviceFeatures supportedFeatures;
     vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
+    return indices.isComplete() && extensionsSupported && swapChainAdequate &&
+           supportsBindlessTextures(device);
+}
+
+bool VulkanSetup::supportsBindlessTextures(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    // descriptor indexing is core since Vulkan 1.2, the structs below can
+    // not be chained before
+    if (properties.apiVersion < VK_API_VERSION_1_2) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+    indexingFeatures.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &indexingFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+    indexingProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(device, &properties2);
+
+    // a combined image sampler counts as a sampler and a sampled image
+    uint32_t maxTextures = std::min(
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages);
+
+    return features.features.shaderSampledImageArrayDynamicIndexing &&
+           indexingFeatures.runtimeDescriptorArray &&
+           indexingFeatures.descriptorBindingPartiallyBound &&
+           indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+           maxTextures >= MAX_TEXTURES;
 }
 
 QueueFamilyIndices VulkanSetup::findQueueFamilies(VkPhysicalDevice device) {
@@ -555,6 +626,14 @@ QueueFamilyIndices VulkanSetup::findQueueFamilies(VkPhysicalDevice device) {
             indices.graphicsFamily = i;
         }
 
+        // nothing is presented, the graphics queue stands in so the rest of
+        // the setup stays the same
+        if (headless) {
+            indices.presentFamily = indices.graphicsFamily;
+            i++;
+            continue;
+        }
+
         VkBool32 presentSupport = false;
         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
                                              &presentSupport);
@@ -581,8 +660,8 @@ bool VulkanSetup::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
                                          availableExtensions.data());
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(),
-                                             deviceExtensions.end());
+    std::vector<const char*> required = getRequiredDeviceExtensions();
+    std::set<std::string> requiredExtensions(required.begin(), required.end());
 
     for (const auto& extension : availableExtensions) {
         requiredExtensions.erase(extension.extensionName);
@@ -591,6 +670,33 @@ bool VulkanSetup::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+bool VulkanSetup::hasDeviceExtension(VkPhysicalDevice device,
+                                     const char* name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<const char*> VulkanSetup::getRequiredDeviceExtensions() {
+    if (headless) {
+        return {};
+    }
+
+    return deviceExtensions;
+}
+
 SwapChainSupportDetails
 VulkanSetup::querySwapChainSupport(VkPhysicalDevice device) {
     SwapChainSupportDetails details;
@@ -639,11 +745,42 @@ void VulkanSetup::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // optional, only used by the GPU profiler
+    deviceFeatures.pipelineStatisticsQuery =
+        supportedFeatures.pipelineStatisticsQuery;
+    pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery;
+    // lets secondary command buffers run inside an active statistics query
+    deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+    inheritedQueriesSupported = supportedFeatures.inheritedQueries;
+    // wireframe pipelines, see `Render::getPipelineKey`
+    deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+    fillModeNonSolidSupported = supportedFeatures.fillModeNonSolid;
+
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance =
+        supportedFeatures.drawIndirectFirstInstance;
+    drawIndirectFirstInstanceSupported =
+        supportedFeatures.drawIndirectFirstInstance;
+    // the bindless texture array is indexed with a per-object index
+    deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+    // required by `isDeviceSuitable`, see `createDescriptorSets`
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+    indexingFeatures.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &indexingFeatures;
 
     createInfo.queueCreateInfoCount =
         static_cast<uint32_t>(queueCreateInfos.size());
@@ -651,9 +788,46 @@ void VulkanSetup::createLogicalDevice() {
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount =
-        static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    std::vector<const char*> extensions = getRequiredDeviceExtensions();
+
+#ifdef VK_EXT_mesh_shader
+    // optional, `ClusterCuller` falls back to indirect draws without it
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    if (hasDeviceExtension(physicalDevice,
+                           VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        // one draw covers many objects, so the fragment shader indexes the
+        // texture array with a non-uniform index
+        VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing{};
+        supportedIndexing.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        meshShaderFeatures.pNext = &supportedIndexing;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &meshShaderFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        meshShaderSupported =
+            meshShaderFeatures.taskShader && meshShaderFeatures.meshShader &&
+            supportedIndexing.shaderSampledImageArrayNonUniformIndexing;
+    }
+    if (meshShaderSupported) {
+        // only the ones that are used, the others need more of the device
+        meshShaderFeatures = {};
+        meshShaderFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        meshShaderFeatures.taskShader = VK_TRUE;
+        meshShaderFeatures.meshShader = VK_TRUE;
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        indexingFeatures.pNext = &meshShaderFeatures;
+        extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+    }
+#endif
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (enableValidationLayers) {
         createInfo.enabledLayerCount =
@@ -678,15 +852,22 @@ void VulkanSetup::createSwapChain() {
 
     VkSurfaceFormatKHR surfaceFormat =
         chooseSwapSurfaceFormat(swapChainSupport.formats);
-    VkPresentModeKHR presentMode =
-        chooseSwapPresentMode(swapChainSupport.presentModes);
+    presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    availablePresentModes = swapChainSupport.presentModes;
+    minImageCount = swapChainSupport.capabilities.minImageCount;
+    // 0 means there is no limit
+    maxImageCount = swapChainSupport.capabilities.maxImageCount;
+
+    uint32_t imageCount = preferredImageCount;
+    if (imageCount == 0) {
+        imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    }
 
-    if (swapChainSupport.capabilities.maxImageCount > 0 &&
-        imageCount > swapChainSupport.capabilities.maxImageCount) {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
+    imageCount = std::max(imageCount, minImageCount);
+    if (maxImageCount > 0 && imageCount > maxImageCount) {
+        imageCount = maxImageCount;
     }
 
     VkSwapchainCreateInfoKHR createInfo{};
@@ -734,6 +915,122 @@ void VulkanSetup::createSwapChain() {
 
     swapChainImageFormat = surfaceFormat.format;
     swapChainExtent = extent;
+    swapChainImageCount = imageCount;
+
+    std::cout << "VulkanSetup::createSwapChain(), "
+              << getPresentModeName(presentMode) << " (asked for "
+              << getPresentModeName(preferredPresentMode) << "), "
+              << imageCount << " images" << std::endl;
+}
+
+void VulkanSetup::createOffscreenImages() {
+    // one target per frame in flight, so recording a frame never has to wait
+    // for the previous one to be read
+    swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    swapChainExtent = {WIDTH, HEIGHT};
+
+    swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        createImage(swapChainExtent.width, swapChainExtent.height,
+                    swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i],
+                    offscreenImagesMemory[i]);
+    }
+}
+
+void VulkanSetup::saveOffscreenImage(uint32_t imageIndex,
+                                     const std::string& filename,
+                                     VkCommandPool* commandPoolPtr) {
+    uint32_t width = swapChainExtent.width;
+    uint32_t height = swapChainExtent.height;
+    VkDeviceSize imageSize = width * height * 4;
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+
+    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer, stagingBufferMemory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPoolPtr);
+
+    // the render pass leaves the image in TRANSFER_SRC_OPTIMAL, only the
+    // color writes have to be made visible to the copy
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = swapChainImages[imageIndex];
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {width, height, 1};
+
+    vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex],
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer,
+                           1, &region);
+
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = stagingBuffer;
+    hostBarrier.offset = 0;
+    hostBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                         &hostBarrier, 0, nullptr);
+
+    endSingleTimeCommands(commandBuffer, commandPoolPtr);
+
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+
+    // BGRA -> RGBA
+    std::vector<uint8_t> pixels(imageSize);
+    const uint8_t* bgra = static_cast<const uint8_t*>(data);
+    for (VkDeviceSize i = 0; i < imageSize; i += 4) {
+        pixels[i + 0] = bgra[i + 2];
+        pixels[i + 1] = bgra[i + 1];
+        pixels[i + 2] = bgra[i + 0];
+        pixels[i + 3] = 255;
+    }
+
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+
+    writePng(filename, width, height, pixels);
+
+    std::cout << "VulkanSetup::saveOffscreenImage(), wrote " << filename
+              << std::endl;
 }
 
 void VulkanSetup::cleanupSwapChain() {
@@ -749,6 +1046,15 @@ void VulkanSetup::cleanupSwapChain() {
         vkDestroyImageView(device, imageView, nullptr);
     }
 
+    if (headless) {
+        for (size_t i = 0; i < swapChainImages.size(); i++) {
+            vkDestroyImage(device, swapChainImages[i], nullptr);
+            vkFreeMemory(device, offscreenImagesMemory[i], nullptr);
+        }
+
+        return;
+    }
+
     vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
@@ -774,12 +1080,16 @@ void VulkanSetup::recreateSwapChain(VkCommandPool* commandPoolPtr) {
 
     vkDeviceWaitIdle(device);
 
+    swapChainSettingsChanged = false;
+
     cleanupSwapChain();
 
     createSwapChain();
     createImageViews();
     createDepthResources(commandPoolPtr);
     createFramebuffers();
+
+    swapChainGeneration++;
 }
 
 void VulkanSetup::createFramebuffers() {
@@ -830,15 +1140,65 @@ VkSurfaceFormatKHR VulkanSetup::chooseSwapSurfaceFormat(
 
 VkPresentModeKHR VulkanSetup::chooseSwapPresentMode(
     const std::vector<VkPresentModeKHR>& availablePresentModes) {
-    for (const auto& availablePresentMode : availablePresentModes) {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return availablePresentMode;
+    // Fallbacks from the fastest to the most compatible mode. A tear free
+    // preference never falls back to a mode that tears, and FIFO is the only
+    // mode every device has to support.
+    std::vector<VkPresentModeKHR> candidates;
+
+    switch (preferredPresentMode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        candidates = {VK_PRESENT_MODE_IMMEDIATE_KHR,
+                      VK_PRESENT_MODE_MAILBOX_KHR,
+                      VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+        break;
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        candidates = {VK_PRESENT_MODE_MAILBOX_KHR};
+        break;
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        candidates = {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+        break;
+    default:
+        break;
+    }
+
+    for (VkPresentModeKHR candidate : candidates) {
+        for (const auto& availablePresentMode : availablePresentModes) {
+            if (availablePresentMode == candidate) {
+                return availablePresentMode;
+            }
         }
     }
 
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+const char* VulkanSetup::getPresentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo_relaxed";
+    default:
+        return "unknown";
+    }
+}
+
+VkPresentModeKHR VulkanSetup::getPresentModeFromName(const std::string& name) {
+    for (VkPresentModeKHR mode :
+         {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+          VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR}) {
+        if (name == getPresentModeName(mode)) {
+            return mode;
+        }
+    }
+
+    throw std::runtime_error("unknown present mode: " + name);
+}
+
 VkExtent2D
 VulkanSetup::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
     if (capabilities.currentExtent.width !=
@@ -879,12 +1239,11 @@ void VulkanSetup::cleanup() {
     vkDestroyBuffer(device, vertexBuffer, nullptr);
     vkFreeMemory(device, vertexBufferMemory, nullptr);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-        vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-    }
+    vkDestroyBuffer(device, positionBuffer, nullptr);
+    vkFreeMemory(device, positionBufferMemory, nullptr);
 
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    descriptorAllocator.destroy();
+    vkDestroyDescriptorPool(device, textureDescriptorPool, nullptr);
 
     vkDestroyDevice(device, nullptr);
 
@@ -892,7 +1251,9 @@ void VulkanSetup::cleanup() {
         DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (!headless) {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
 }
 
@@ -960,6 +1321,39 @@ void VulkanSetup::createIndexBuffer(VkCommandPool* commandPoolPtr,
     vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
+void VulkanSetup::createPositionBuffer(VkCommandPool* commandPoolPtr,
+                                       const std::vector<Vertex>& vertices) {
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].pos;
+    }
+
+    VkDeviceSize bufferSize = sizeof(positions[0]) * positions.size();
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+    memcpy(data, positions.data(), (size_t)bufferSize);
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    createBuffer(bufferSize,
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, positionBuffer,
+                 positionBufferMemory);
+
+    copyBuffer(stagingBuffer, positionBuffer, bufferSize, commandPoolPtr);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
 void VulkanSetup::createVertexBuffer(VkCommandPool* commandPoolPtr,
                                      std::vector<Vertex> vertices) {
     setVertexBuffer(vertices, commandPoolPtr, true);
@@ -986,9 +1380,11 @@ void VulkanSetup::setVertexBuffer(std::vector<Vertex> vertices,
 
     if (createVertexBuffer) {
         // Create the vertex buffer
+        // mesh shaders read the vertices as a storage buffer
         createBuffer(bufferSize,
                      VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer,
                      vertexBufferMemory);
     }
@@ -1001,121 +1397,75 @@ void VulkanSetup::setVertexBuffer(std::vector<Vertex> vertices,
     vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
-void VulkanSetup::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     uniformBuffers[i], uniformBuffersMemory[i]);
-
-        vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0,
-                    &uniformBuffersMapped[i]);
-    }
-}
-
 void VulkanSetup::createDescriptorPool() {
-    const int numDescriptorSets = MAX_FRAMES_IN_FLIGHT * textures.size() + 1;
-
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(numDescriptorSets);
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(numDescriptorSets);
+    // The texture set is the only one with MAX_TEXTURES samplers, its pool
+    // holds exactly that set so the growing pools below carry none of
+    // them. UPDATE_AFTER_BIND is needed by the layout of the texture array,
+    // see `Shader::createDescriptorSetLayout`.
+    VkDescriptorPoolSize textureSize{};
+    textureSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    textureSize.descriptorCount = MAX_TEXTURES;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(numDescriptorSets);
-    poolInfo.flags = 0; // Optional
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &textureSize;
 
-    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) !=
-        VK_SUCCESS) {
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr,
+                               &textureDescriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
     }
+
+    // The first pool fits the frame sets of `Render::frameData`, the
+    // allocator adds pools if more are allocated later
+    descriptorAllocator.create(
+        device, MAX_FRAMES_IN_FLIGHT,
+        {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f}});
 }
 
 void VulkanSetup::createDescriptorSets(
     VkDescriptorSetLayout* descriptorSetLayoutPtr) {
-    const int numDescriptorSets = MAX_FRAMES_IN_FLIGHT * textures.size();
-    // const int numDescriptorSets = 2;
-
-    std::cout << "numDescriptorSets: " << numDescriptorSets << std::endl;
-
-    std::vector<VkDescriptorSetLayout> layouts(numDescriptorSets,
-                                               *descriptorSetLayoutPtr);
+    // Bound once per command buffer, draws pick their texture with
+    // `InstanceData::textureIndex`. The textures are written below and as
+    // they load.
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = numDescriptorSets;
-    allocInfo.pSetLayouts = layouts.data();
+    allocInfo.descriptorPool = textureDescriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = descriptorSetLayoutPtr;
 
-    descriptorSets.resize(numDescriptorSets);
-    if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) !=
-        VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(device, &allocInfo,
+                                 &textureDescriptorSet) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    // >>> for i in range(8):
-    // ...   print("{0:b} ds:{1} ti:{2}".format(i, i, i % 4))
-    // ...
-    // 0 ds:0 ti:0
-    // 1 ds:1 ti:1
-    // 10 ds:2 ti:2
-    // 11 ds:3 ti:3
-    // 100 ds:4 ti:0
-    // 101 ds:5 ti:1
-    // 110 ds:6 ti:2
-    // 111 ds:7 ti:3
-    for (size_t i = 0; i < numDescriptorSets; i++) {
-        // std::cout << "creating descriptor set: " << i << std::endl;
-
-        int textureId = i % textures.size();
-
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i % MAX_FRAMES_IN_FLIGHT];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkDescriptorImageInfo imageInfo{};
-
-        // std::cout << "creating descriptor set for textureId: " << textureId
-        //           << std::endl;
-
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = textures[textureId].image.view;
-        imageInfo.sampler = textures[textureId].sampler;
-
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = descriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-        descriptorWrites[0].pImageInfo = nullptr;       // Optional
-        descriptorWrites[0].pTexelBufferView = nullptr; // Optional
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = descriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType =
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-
-        vkUpdateDescriptorSets(device,
-                               static_cast<uint32_t>(descriptorWrites.size()),
-                               descriptorWrites.data(), 0, nullptr);
+    for (size_t textureId = 0; textureId < textures.size(); textureId++) {
+        writeTextureDescriptor(textureId);
     }
+
+    std::cout << "VulkanSetup::createDescriptorSets(), " << textures.size()
+              << "/" << MAX_TEXTURES << " textures" << std::endl;
+}
+
+void VulkanSetup::writeTextureDescriptor(int textureId) {
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = textures[textureId].image.view;
+    imageInfo.sampler = textures[textureId].sampler;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = textureDescriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = textureId;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
 void VulkanSetup::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
@@ -1186,10 +1536,22 @@ uint32_t VulkanSetup::findMemoryType(uint32_t typeFilter,
 void VulkanSetup::createDepthResources(VkCommandPool* commandPoolPtr) {
     VkFormat depthFormat = findDepthFormat();
 
-    createImage(
-        swapChainExtent.width, swapChainExtent.height, depthFormat,
-        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+    // the occlusion culling builds its depth pyramid from it
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat,
+                                        &formatProperties);
+    depthSampled = (formatProperties.optimalTilingFeatures &
+                    VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (depthSampled) {
+        usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+
+    createImage(swapChainExtent.width, swapChainExtent.height, depthFormat,
+                VK_IMAGE_TILING_OPTIMAL, usage,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage,
+                depthImageMemory);
     depthImageView =
         createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
@@ -4,6 +4,7 @@
 #include <optional>      // std::optional
 #include <unordered_map> // std::unordered_map
 
+#include "DescriptorAllocator.hpp"
 #include "Vertex.hpp"
 #include "Window.hpp"
 
@@ -15,7 +16,9 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// Upper bound of `Render::framesInFlight`, per-frame resources are created for
+// this many frames so the count can change at runtime
+const int MAX_FRAMES_IN_FLIGHT = 4;
 
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"};
@@ -64,22 +67,71 @@ class VulkanSetup {
     const uint32_t WIDTH = 1920;
     const uint32_t HEIGHT = 1080;
 
+    // Render into offscreen images instead of a window. No surface or swap
+    // chain is created and CPU implementations (llvmpipe, SwiftShader) are
+    // accepted, so this also runs on machines without a GPU or display.
+    // Has to be set before `createInstance`.
+    bool headless = false;
+    // set by `createLogicalDevice`, pipeline statistics queries are optional
+    bool pipelineStatisticsSupported = false;
+    bool inheritedQueriesSupported = false;
+    bool fillModeNonSolidSupported = false;
+    // indirect draws of `OcclusionCuller`, several per call and with a first
+    // instance other than 0
+    bool multiDrawIndirectSupported = false;
+    bool drawIndirectFirstInstanceSupported = false;
+    // VK_EXT_mesh_shader with task shaders and non-uniform indexing of the
+    // texture array, see `ClusterCuller`
+    bool meshShaderSupported = false;
+    // set by `createDepthResources`, the depth attachment can be sampled
+    bool depthSampled = false;
+
+    // Present mode to ask for, `chooseSwapPresentMode` falls back to the
+    // closest supported one. MAILBOX renders uncapped without tearing.
+    VkPresentModeKHR preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    // swap chain images to ask for, clamped to the surface limits. 0 uses
+    // one more than the minimum.
+    uint32_t preferredImageCount = 0;
+    // Set after changing the two above, the swap chain is recreated after
+    // the next present
+    bool swapChainSettingsChanged = false;
+
+    // what the current swap chain was created with
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    uint32_t swapChainImageCount = 0;
+    std::vector<VkPresentModeKHR> availablePresentModes;
+    uint32_t minImageCount = 0;
+    uint32_t maxImageCount = 0;
+    // bumped by `recreateSwapChain`, command buffers kept across frames
+    // compare it to know when they have to be recorded again
+    uint32_t swapChainGeneration = 0;
+
+    static const char* getPresentModeName(VkPresentModeKHR mode);
+    // Accepts the names returned by `getPresentModeName`, throws otherwise
+    static VkPresentModeKHR getPresentModeFromName(const std::string& name);
+
     VkDevice device;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkSwapchainKHR swapChain;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     VkBuffer vertexBuffer;
+    // the positions of `vertexBuffer` alone, for the depth pre-pass
+    VkBuffer positionBuffer = VK_NULL_HANDLE;
     VkBuffer indexBuffer;
 
     VkQueue graphicsQueue;
     VkQueue presentQueue;
 
     std::vector<VkFramebuffer> swapChainFramebuffers;
-    std::vector<void*> uniformBuffersMapped;
 
-    VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
+    // grows as sets are allocated, ImGui has a pool of its own
+    DescriptorAllocator descriptorAllocator;
+    // Every texture, shared by all frames since nothing in it changes per
+    // frame. The per-frame data is in `Render::frameData`.
+    VkDescriptorSet textureDescriptorSet = VK_NULL_HANDLE;
+    // sized once for `textureDescriptorSet` alone
+    VkDescriptorPool textureDescriptorPool = VK_NULL_HANDLE;
 
     struct Image {
         VkImage image;
@@ -113,16 +165,22 @@ class VulkanSetup {
     void pickPhysicalDevice();
     void createLogicalDevice();
     void createSwapChain();
+    void createOffscreenImages();
     void createImageViews();
     void createFramebuffers();
     void createVertexBuffer(VkCommandPool* commandPool,
                             std::vector<Vertex> vertices);
+    // Packs the positions of `vertices` into `positionBuffer`, a third of
+    // the bytes per vertex
+    void createPositionBuffer(VkCommandPool* commandPool,
+                              const std::vector<Vertex>& vertices);
     void createIndexBuffer(VkCommandPool* commandPool,
                            std::vector<uint32_t> indices,
                            VkDeviceSize bufferSize);
-    void createUniformBuffers();
     void createDescriptorPool();
     void createDescriptorSets(VkDescriptorSetLayout* descriptorSetLayoutPtr);
+    // Writes the texture into the bindless array
+    void writeTextureDescriptor(int textureId);
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties, VkBuffer& buffer,
                       VkDeviceMemory& bufferMemory);
@@ -136,7 +194,7 @@ class VulkanSetup {
     void createImage(uint32_t width, uint32_t height, VkFormat format,
                      VkImageTiling tiling, VkImageUsageFlags usage,
                      VkMemoryPropertyFlags properties, VkImage& image,
-                     VkDeviceMemory& imageMemory);
+                     VkDeviceMemory& imageMemory, uint32_t mipLevels = 1);
     VkCommandBuffer beginSingleTimeCommands(VkCommandPool* commandPoolPtr);
     void endSingleTimeCommands(VkCommandBuffer commandBuffer,
                                VkCommandPool* commandPoolPtr);
@@ -150,22 +208,25 @@ class VulkanSetup {
     void createTextureSampler(VkSampler* textureSamplerPtr);
     void createDepthResources(VkCommandPool* commandPoolPtr);
     VkFormat findDepthFormat();
+    // Copies a rendered offscreen image back to the host and writes it as PNG
+    void saveOffscreenImage(uint32_t imageIndex, const std::string& filename,
+                            VkCommandPool* commandPoolPtr);
 
   private:
     VkDebugUtilsMessengerEXT debugMessenger;
 
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
 
     std::vector<VkImage> swapChainImages;
+    // only used in headless mode, the swap chain owns its images otherwise
+    std::vector<VkDeviceMemory> offscreenImagesMemory;
 
     std::vector<VkImageView> swapChainImageViews;
 
     VkDeviceMemory vertexBufferMemory;
+    VkDeviceMemory positionBufferMemory = VK_NULL_HANDLE;
     VkDeviceMemory indexBufferMemory;
 
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
-
     bool checkValidationLayerSupport();
     std::vector<const char*> getRequiredExtensions();
     void populateDebugMessengerCreateInfo(
@@ -177,7 +238,12 @@ class VulkanSetup {
                   void* pUserData);
     int rateDeviceSuitability(VkPhysicalDevice device);
     bool isDeviceSuitable(VkPhysicalDevice device);
+    // descriptor indexing features the bindless texture array needs
+    bool supportsBindlessTextures(VkPhysicalDevice device);
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    // for the optional extensions
+    bool hasDeviceExtension(VkPhysicalDevice device, const char* name);
+    std::vector<const char*> getRequiredDeviceExtensions();
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
     void cleanupSwapChain();
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(
@@ -2,16 +2,21 @@
 #include <iostream>
 #include <stdexcept>
 
-#include "imgui.h"
-#include "imgui_impl_glfw.h"
-#include "imgui_impl_vulkan.h"
-
 #include "Application.hpp"
+#include "Options.hpp"
+
+int main(int argc, char** argv) {
+    launchOptions options;
 
-int main() {
-    Application app;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    ImGui::CreateContext();
+    // the ImGui context is created by `Render::initImgui`
+    Application app(options);
 
     try {
         app.run();